@@ -0,0 +1,625 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/Log.h"
+
+#include <vender/tlsf.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+namespace Air
+{
+    static constexpr uint32_t FIXED_ALLOCATION_COUNT = 100000;
+    static constexpr size_t FIXED_ALLOCATION_SIZE = 64;
+
+    static constexpr uint32_t CHURN_LIVE_SLOTS = 4096;
+    static constexpr uint32_t CHURN_OPERATIONS = 500000;
+
+    static constexpr uint32_t SCOPED_SCOPES = 64;
+    static constexpr uint32_t SCOPED_ALLOCATIONS = 1024;
+
+    static constexpr uint32_t FRAGMENTATION_PHASES = 8;
+    static constexpr uint32_t FRAGMENTATION_OPERATIONS_PER_PHASE = 100000;
+
+    static constexpr uint32_t CONTENTION_SLOTS = 256;
+    static constexpr uint32_t CONTENTION_OPERATIONS = 200000;
+
+    //Several times MEMORY_MAX_THREADS short lived threads, so indices have to be recycled to keep the caches.
+    static constexpr uint32_t THREAD_CHURN_THREADS = MEMORY_MAX_THREADS * 4;
+    static constexpr uint32_t THREAD_CHURN_WAVE = 4;
+    static constexpr uint32_t THREAD_CHURN_ALLOCATIONS = 64;
+
+    //Big enough to blow well past what the TLB covers with 4KB pages.
+    static constexpr size_t TLB_BUFFER_SIZE = size_t(256) * 1024 * 1024;
+    static constexpr size_t TLB_NODE_SIZE = 64;
+    static constexpr uint32_t TLB_ACCESSES = 4 * 1024 * 1024;
+
+    static constexpr size_t BENCHMARK_HEAP_SIZE = size_t(32) * 1024 * 1024;
+    static constexpr size_t BENCHMARK_HEAP_RESERVE = size_t(2) * 1024 * 1024 * 1024;
+
+    struct AllocatorCase
+    {
+        const char* name;
+        Allocator* allocator;
+    };
+
+    //Power of 2 bucket between 2^minShift and 2^maxShift with a random offset inside the bucket,
+    //so small sizes are as common as big ones like in real workloads.
+    static size_t randomSize(BenchmarkRandom& random, uint32_t minShift, uint32_t maxShift)
+    {
+        const size_t base = size_t(1) << (minShift + random.range(maxShift - minShift));
+        return base + random.range((uint32_t)base);
+    }
+
+    static void touch(void* pointer)
+    {
+        *(volatile uint8_t*)pointer = 1;
+    }
+
+    static void fragmentationWalker(void* /*ptr*/, size_t size, int used, void* user)
+    {
+        size_t* freeBytes = (size_t*)user;
+        if (used == 0)
+        {
+            freeBytes[0] += size;
+            freeBytes[1] = size > freeBytes[1] ? size : freeBytes[1];
+        }
+    }
+
+    //1 - largest free block / total free bytes. 0 means all free memory is one block.
+    static double heapFragmentation(HeapAllocator& heap)
+    {
+        //Total and largest.
+        size_t freeBytes[2] = {};
+        for (uint32_t i = 0; i < HEAP_MAX_POOLS; ++i)
+        {
+            if (heap.pools[i].tlsfPool)
+            {
+                tlsf_walk_pool(heap.pools[i].tlsfPool, fragmentationWalker, freeBytes);
+            }
+        }
+
+        return freeBytes[0] ? 1.0 - (double)freeBytes[1] / (double)freeBytes[0] : 0.0;
+    }
+
+    static uint32_t heapPoolCount(HeapAllocator& heap)
+    {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < HEAP_MAX_POOLS; ++i)
+        {
+            count += heap.pools[i].tlsfPool ? 1 : 0;
+        }
+        return count;
+    }
+
+    static void benchmarkFixed(BenchmarkRunner& runner, const AllocatorCase& allocatorCase, void** pointers)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "alloc_free_fixed/%s", allocatorCase.name);
+        runner.run("allocator", name, [&](BenchmarkState& state)
+        {
+            Allocator* allocator = allocatorCase.allocator;
+
+            state.begin();
+            for (uint32_t i = 0; i < FIXED_ALLOCATION_COUNT; ++i)
+            {
+                pointers[i] = allocator->allocate(FIXED_ALLOCATION_SIZE, 16);
+                touch(pointers[i]);
+            }
+            //Reverse order so the stack allocator can take part.
+            for (uint32_t i = FIXED_ALLOCATION_COUNT; i > 0; --i)
+            {
+                allocator->deallocate(pointers[i - 1]);
+            }
+            state.end();
+
+            state.operations = FIXED_ALLOCATION_COUNT;
+        });
+    }
+
+    static void benchmarkFixedLinear(BenchmarkRunner& runner, LinearAllocator& linear)
+    {
+        runner.run("allocator", "alloc_free_fixed/linear", [&](BenchmarkState& state)
+        {
+            state.begin();
+            for (uint32_t i = 0; i < FIXED_ALLOCATION_COUNT; ++i)
+            {
+                touch(linear.allocate(FIXED_ALLOCATION_SIZE, 16));
+            }
+            linear.clear();
+            state.end();
+
+            state.operations = FIXED_ALLOCATION_COUNT;
+        });
+    }
+
+    static void benchmarkFixedDoubleStack(BenchmarkRunner& runner, DoubleStackAllocator& doubleStack)
+    {
+        runner.run("allocator", "alloc_free_fixed/double_stack", [&](BenchmarkState& state)
+        {
+            state.begin();
+            for (uint32_t i = 0; i < FIXED_ALLOCATION_COUNT; ++i)
+            {
+                touch((i & 1) ? doubleStack.allocateTop(FIXED_ALLOCATION_SIZE, 16) : doubleStack.allocateBottom(FIXED_ALLOCATION_SIZE, 16));
+            }
+            for (uint32_t i = FIXED_ALLOCATION_COUNT; i > 0; --i)
+            {
+                if ((i - 1) & 1)
+                {
+                    doubleStack.deallocateTop(FIXED_ALLOCATION_SIZE);
+                }
+                else
+                {
+                    doubleStack.deallocateBottom(FIXED_ALLOCATION_SIZE);
+                }
+            }
+            state.end();
+
+            //Alignment padding isn't given back by deallocate.
+            doubleStack.clearTop();
+            doubleStack.clearBottom();
+            state.operations = FIXED_ALLOCATION_COUNT;
+        });
+    }
+
+    static void benchmarkChurn(BenchmarkRunner& runner, const AllocatorCase& allocatorCase, const char* prefix, uint32_t maxShift,
+                               void** pointers, HeapAllocator* heap)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "%s/%s", prefix, allocatorCase.name);
+        runner.run("allocator", name, [&](BenchmarkState& state)
+        {
+            Allocator* allocator = allocatorCase.allocator;
+            BenchmarkRandom random;
+            random.init(0xA11C);
+
+            for (uint32_t i = 0; i < CHURN_LIVE_SLOTS; ++i)
+            {
+                pointers[i] = allocator->allocate(randomSize(random, 4, maxShift), 16);
+            }
+
+            state.begin();
+            for (uint32_t i = 0; i < CHURN_OPERATIONS; ++i)
+            {
+                const uint32_t slot = random.range(CHURN_LIVE_SLOTS);
+                allocator->deallocate(pointers[slot]);
+                pointers[slot] = allocator->allocate(randomSize(random, 4, maxShift), 16);
+                touch(pointers[slot]);
+            }
+            state.end();
+
+            if (heap)
+            {
+                state.addMetric("fragmentation", heapFragmentation(*heap));
+                state.addMetric("committed_bytes", (double)heap->maxSize);
+            }
+
+            for (uint32_t i = 0; i < CHURN_LIVE_SLOTS; ++i)
+            {
+                allocator->deallocate(pointers[i]);
+            }
+
+            state.operations = CHURN_OPERATIONS;
+        });
+    }
+
+    //The frame pattern the linear style allocators are built for: a burst of mixed sizes thrown away all at once.
+    static void benchmarkScoped(BenchmarkRunner& runner, const char* allocatorName, LinearAllocator* linear, StackAllocator* stack,
+                                DoubleStackAllocator* doubleStack, Allocator* general, void** pointers)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "scoped_mixed/%s", allocatorName);
+        runner.run("allocator", name, [&](BenchmarkState& state)
+        {
+            BenchmarkRandom random;
+            random.init(0x5C0BE);
+
+            state.begin();
+            for (uint32_t scope = 0; scope < SCOPED_SCOPES; ++scope)
+            {
+                const size_t stackMarker = stack ? stack->getMarker() : 0;
+                const size_t bottomMarker = doubleStack ? doubleStack->getBottomMarker() : 0;
+
+                for (uint32_t i = 0; i < SCOPED_ALLOCATIONS; ++i)
+                {
+                    const size_t size = randomSize(random, 4, 11);
+                    void* pointer = nullptr;
+                    if (linear)
+                    {
+                        pointer = linear->allocate(size, 16);
+                    }
+                    else if (stack)
+                    {
+                        pointer = stack->allocate(size, 16);
+                    }
+                    else if (doubleStack)
+                    {
+                        pointer = (i & 1) ? doubleStack->allocateTop(size, 16) : doubleStack->allocateBottom(size, 16);
+                    }
+                    else
+                    {
+                        pointer = general->allocate(size, 16);
+                        pointers[i] = pointer;
+                    }
+                    touch(pointer);
+                }
+
+                if (linear)
+                {
+                    linear->clear();
+                }
+                else if (stack)
+                {
+                    stack->freeMarker(stackMarker);
+                }
+                else if (doubleStack)
+                {
+                    doubleStack->freeBottomMarker(bottomMarker);
+                    doubleStack->clearTop();
+                }
+                else
+                {
+                    for (uint32_t i = SCOPED_ALLOCATIONS; i > 0; --i)
+                    {
+                        general->deallocate(pointers[i - 1]);
+                    }
+                }
+            }
+            state.end();
+
+            state.operations = SCOPED_SCOPES * SCOPED_ALLOCATIONS;
+        });
+    }
+
+    //Long running churn where the size distribution drifts every phase, the way a level load replaces
+    //meshes with textures. Shows how badly the heap fragments and how much it has to grow.
+    static void benchmarkFragmentation(BenchmarkRunner& runner, void** pointers, size_t* sizes)
+    {
+        runner.run("allocator", "fragmentation/heap", [&](BenchmarkState& state)
+        {
+            HeapAllocator heap;
+            heap.init(BENCHMARK_HEAP_SIZE, false, BENCHMARK_HEAP_RESERVE);
+
+            BenchmarkRandom random;
+            random.init(0xF7A6);
+
+            for (uint32_t i = 0; i < CHURN_LIVE_SLOTS; ++i)
+            {
+                sizes[i] = randomSize(random, 4, 8);
+                pointers[i] = heap.allocate(sizes[i], 16);
+            }
+
+            double peakFragmentation = 0.0;
+            double fragmentationSum = 0.0;
+            size_t peakLiveBytes = 0;
+
+            state.begin();
+            for (uint32_t phase = 0; phase < FRAGMENTATION_PHASES; ++phase)
+            {
+                //Sizes creep from 16 bytes up to 64KB over the phases.
+                const uint32_t minShift = 4 + phase;
+                const uint32_t maxShift = minShift + 5;
+                for (uint32_t i = 0; i < FRAGMENTATION_OPERATIONS_PER_PHASE; ++i)
+                {
+                    const uint32_t slot = random.range(CHURN_LIVE_SLOTS);
+                    heap.deallocate(pointers[slot]);
+                    sizes[slot] = randomSize(random, minShift, maxShift);
+                    pointers[slot] = heap.allocate(sizes[slot], 16);
+                }
+
+                size_t liveBytes = 0;
+                for (uint32_t i = 0; i < CHURN_LIVE_SLOTS; ++i)
+                {
+                    liveBytes += sizes[i];
+                }
+
+                const double fragmentation = heapFragmentation(heap);
+                peakFragmentation = fragmentation > peakFragmentation ? fragmentation : peakFragmentation;
+                fragmentationSum += fragmentation;
+                peakLiveBytes = liveBytes > peakLiveBytes ? liveBytes : peakLiveBytes;
+            }
+            state.end();
+
+            state.addMetric("final_fragmentation", heapFragmentation(heap));
+            state.addMetric("peak_fragmentation", peakFragmentation);
+            state.addMetric("average_fragmentation", fragmentationSum / FRAGMENTATION_PHASES);
+            state.addMetric("committed_bytes", (double)heap.maxSize);
+            state.addMetric("peak_live_bytes", (double)peakLiveBytes);
+            state.addMetric("pools", (double)heapPoolCount(heap));
+
+            for (uint32_t i = 0; i < CHURN_LIVE_SLOTS; ++i)
+            {
+                heap.deallocate(pointers[i]);
+            }
+            heap.shutdown();
+
+            state.operations = FRAGMENTATION_PHASES * FRAGMENTATION_OPERATIONS_PER_PHASE;
+        });
+    }
+
+    static void benchmarkContention(BenchmarkRunner& runner, const AllocatorCase& allocatorCase, uint32_t threadCount, void** pointers)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "contention/%s/%u", allocatorCase.name, threadCount);
+        runner.run("allocator", name, [&](BenchmarkState& state)
+        {
+            Allocator* allocator = allocatorCase.allocator;
+            benchmarkParallel(state, threadCount, [&](uint32_t threadIndex)
+            {
+                void** slots = pointers + threadIndex * CONTENTION_SLOTS;
+                BenchmarkRandom random;
+                random.init(0xC0DE + threadIndex);
+
+                for (uint32_t i = 0; i < CONTENTION_SLOTS; ++i)
+                {
+                    slots[i] = allocator->allocate(randomSize(random, 4, 7), 16);
+                }
+                for (uint32_t i = 0; i < CONTENTION_OPERATIONS; ++i)
+                {
+                    const uint32_t slot = random.range(CONTENTION_SLOTS);
+                    allocator->deallocate(slots[slot]);
+                    slots[slot] = allocator->allocate(randomSize(random, 4, 7), 16);
+                    touch(slots[slot]);
+                }
+                for (uint32_t i = 0; i < CONTENTION_SLOTS; ++i)
+                {
+                    allocator->deallocate(slots[i]);
+                }
+            });
+
+            state.operations = (uint64_t)threadCount * CONTENTION_OPERATIONS;
+        });
+    }
+
+    //Threads that come and go, like loaders spun up per job. Each one leaves half its blocks for the main thread to
+    //free after it exited, which lands them in the remote frees of an index the next wave picks up again.
+    static void benchmarkThreadChurn(BenchmarkRunner& runner, HeapAllocator& heap, void** pointers)
+    {
+        runner.run("allocator", "thread_churn/heap_mt", [&](BenchmarkState& state)
+        {
+            std::atomic<uint32_t> uncachedThreads{ 0 };
+
+            state.begin();
+            for (uint32_t wave = 0; wave < THREAD_CHURN_THREADS; wave += THREAD_CHURN_WAVE)
+            {
+                std::thread threads[THREAD_CHURN_WAVE];
+                for (uint32_t t = 0; t < THREAD_CHURN_WAVE; ++t)
+                {
+                    threads[t] = std::thread([&, t]()
+                    {
+                        if (memoryThreadIndex() >= MEMORY_MAX_THREADS)
+                        {
+                            uncachedThreads.fetch_add(1, std::memory_order_relaxed);
+                        }
+
+                        void** slots = pointers + t * THREAD_CHURN_ALLOCATIONS;
+                        for (uint32_t i = 0; i < THREAD_CHURN_ALLOCATIONS; ++i)
+                        {
+                            slots[i] = heap.allocate(16 << (i & 3), 16);
+                            touch(slots[i]);
+                        }
+                        for (uint32_t i = 0; i < THREAD_CHURN_ALLOCATIONS; i += 2)
+                        {
+                            heap.deallocate(slots[i]);
+                        }
+                    });
+                }
+
+                for (uint32_t t = 0; t < THREAD_CHURN_WAVE; ++t)
+                {
+                    threads[t].join();
+                }
+                for (uint32_t i = 1; i < THREAD_CHURN_WAVE * THREAD_CHURN_ALLOCATIONS; i += 2)
+                {
+                    heap.deallocate(pointers[i]);
+                }
+            }
+            state.end();
+
+            AIR_ASSERTM(uncachedThreads.load() == 0, "%u short lived threads got no thread index, exited threads aren't giving theirs back.", uncachedThreads.load());
+
+            state.operations = THREAD_CHURN_THREADS;
+        });
+    }
+
+    static void benchmarkContentionLinear(BenchmarkRunner& runner, ConcurrentLinearAllocator& linear, uint32_t threadCount)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "contention/concurrent_linear/%u", threadCount);
+        runner.run("allocator", name, [&](BenchmarkState& state)
+        {
+            linear.clear();
+            benchmarkParallel(state, threadCount, [&](uint32_t threadIndex)
+            {
+                BenchmarkRandom random;
+                random.init(0xC0DE + threadIndex);
+
+                for (uint32_t i = 0; i < CONTENTION_OPERATIONS; ++i)
+                {
+                    touch(linear.allocate(randomSize(random, 4, 7), 16));
+                }
+            });
+
+            state.operations = (uint64_t)threadCount * CONTENTION_OPERATIONS;
+        });
+    }
+
+    static const char* backingName(MemoryBackingType type)
+    {
+        switch (type)
+        {
+            case MEMORY_BACKING_MALLOC: return "malloc";
+            case MEMORY_BACKING_PAGES: return "pages";
+            case MEMORY_BACKING_TRANSPARENT_HUGE_PAGES: return "transparent_huge_pages";
+            case MEMORY_BACKING_EXPLICIT_HUGE_PAGES: return "explicit_huge_pages";
+        }
+        return "unknown";
+    }
+
+    //Random accesses over a buffer much bigger than the TLB reach. The pointer chase is latency bound and shows
+    //the page walk cost directly, the random update lets the CPU overlap misses and shows throughput.
+    static void benchmarkBacking(BenchmarkRunner& runner, MemoryBackingType type, uint32_t* order)
+    {
+        char chaseName[96];
+        char updateName[96];
+        snprintf(chaseName, sizeof(chaseName), "tlb_pointer_chase/%s", backingName(type));
+        snprintf(updateName, sizeof(updateName), "tlb_random_update/%s", backingName(type));
+        if (runner.matches("allocator", chaseName) == false && runner.matches("allocator", updateName) == false)
+        {
+            return;
+        }
+
+        MemoryBacking backing;
+        backing.type = type;
+        LinearAllocator buffer;
+        buffer.init(TLB_BUFFER_SIZE, backing);
+        uint8_t* nodes = (uint8_t*)buffer.allocate(TLB_BUFFER_SIZE, 64);
+
+        //Sattolo's shuffle gives a single cycle through every node so the chase never gets stuck in a short loop.
+        const uint32_t nodeCount = (uint32_t)(TLB_BUFFER_SIZE / TLB_NODE_SIZE);
+        BenchmarkRandom random;
+        random.init(0x71B);
+        for (uint32_t i = 0; i < nodeCount; ++i)
+        {
+            order[i] = i;
+        }
+        for (uint32_t i = nodeCount - 1; i > 0; --i)
+        {
+            const uint32_t j = random.range(i);
+            const uint32_t swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+        for (uint32_t i = 0; i < nodeCount; ++i)
+        {
+            *(uint32_t*)(nodes + (size_t)i * TLB_NODE_SIZE) = order[i];
+        }
+
+        runner.run("allocator", chaseName, [&](BenchmarkState& state)
+        {
+            uint32_t node = 0;
+            state.begin();
+            for (uint32_t i = 0; i < TLB_ACCESSES; ++i)
+            {
+                node = *(uint32_t*)(nodes + (size_t)node * TLB_NODE_SIZE);
+            }
+            state.end();
+            benchmarkDoNotOptimise(node);
+
+            state.addMetric("backing", (double)buffer.backing.type);
+            state.addMetric("buffer_bytes", (double)TLB_BUFFER_SIZE);
+            state.operations = TLB_ACCESSES;
+        });
+
+        runner.run("allocator", updateName, [&](BenchmarkState& state)
+        {
+            BenchmarkRandom updateRandom;
+            updateRandom.init(0x7E57);
+            state.begin();
+            for (uint32_t i = 0; i < TLB_ACCESSES; ++i)
+            {
+                const uint32_t node = updateRandom.range(nodeCount);
+                ++*(uint32_t*)(nodes + (size_t)node * TLB_NODE_SIZE + sizeof(uint32_t));
+            }
+            state.end();
+
+            state.addMetric("backing", (double)buffer.backing.type);
+            state.addMetric("buffer_bytes", (double)TLB_BUFFER_SIZE);
+            state.operations = TLB_ACCESSES;
+        });
+
+        buffer.shutdown();
+    }
+
+    void benchmarkAllocators(BenchmarkRunner& runner)
+    {
+        uint32_t maxThreads = std::thread::hardware_concurrency();
+        maxThreads = maxThreads == 0 ? 1 : (maxThreads > BENCHMARK_MAX_THREADS ? BENCHMARK_MAX_THREADS : maxThreads);
+
+        const size_t pointerCount = FIXED_ALLOCATION_COUNT > BENCHMARK_MAX_THREADS * CONTENTION_SLOTS ? FIXED_ALLOCATION_COUNT : BENCHMARK_MAX_THREADS * CONTENTION_SLOTS;
+        void** pointers = (void**)malloc(pointerCount * sizeof(void*));
+        size_t* sizes = (size_t*)malloc(CHURN_LIVE_SLOTS * sizeof(size_t));
+
+        MallocAllocator mallocAllocator;
+
+        HeapAllocator heap;
+        heap.init(BENCHMARK_HEAP_SIZE, false, BENCHMARK_HEAP_RESERVE);
+
+        HeapAllocator heapMultiThreaded;
+        heapMultiThreaded.init(BENCHMARK_HEAP_SIZE, true, BENCHMARK_HEAP_RESERVE);
+
+        //Big enough to hold the worst case scoped burst and the fixed run.
+        const size_t linearSize = size_t(16) * 1024 * 1024;
+        LinearAllocator linear;
+        linear.init(linearSize);
+        StackAllocator stack;
+        stack.init(linearSize, 16);
+        DoubleStackAllocator doubleStack;
+        doubleStack.init(linearSize);
+
+        SlabAllocator slab;
+        slab.init(&heapMultiThreaded, 64 * 1024, true);
+
+        ConcurrentLinearAllocator concurrentLinear;
+        concurrentLinear.init(size_t(64) * 1024 * 1024, 64 * 1024);
+
+        const AllocatorCase heapCase = { "heap", &heap };
+        const AllocatorCase heapMultiThreadedCase = { "heap_mt", &heapMultiThreaded };
+        const AllocatorCase mallocCase = { "malloc", &mallocAllocator };
+        const AllocatorCase stackCase = { "stack", &stack };
+        const AllocatorCase slabCase = { "slab", &slab };
+
+        benchmarkFixed(runner, heapCase, pointers);
+        benchmarkFixed(runner, heapMultiThreadedCase, pointers);
+        benchmarkFixed(runner, mallocCase, pointers);
+        benchmarkFixed(runner, stackCase, pointers);
+        benchmarkFixed(runner, slabCase, pointers);
+        benchmarkFixedLinear(runner, linear);
+        benchmarkFixedDoubleStack(runner, doubleStack);
+
+        benchmarkChurn(runner, heapCase, "mixed_churn", 11, pointers, &heap);
+        benchmarkChurn(runner, heapMultiThreadedCase, "mixed_churn", 11, pointers, &heapMultiThreaded);
+        benchmarkChurn(runner, mallocCase, "mixed_churn", 11, pointers, nullptr);
+        benchmarkChurn(runner, heapCase, "small_churn", 7, pointers, &heap);
+        benchmarkChurn(runner, mallocCase, "small_churn", 7, pointers, nullptr);
+        benchmarkChurn(runner, slabCase, "small_churn", 7, pointers, nullptr);
+
+        benchmarkScoped(runner, "linear", &linear, nullptr, nullptr, nullptr, pointers);
+        benchmarkScoped(runner, "stack", nullptr, &stack, nullptr, nullptr, pointers);
+        benchmarkScoped(runner, "double_stack", nullptr, nullptr, &doubleStack, nullptr, pointers);
+        benchmarkScoped(runner, "heap", nullptr, nullptr, nullptr, &heap, pointers);
+        benchmarkScoped(runner, "malloc", nullptr, nullptr, nullptr, &mallocAllocator, pointers);
+
+        benchmarkFragmentation(runner, pointers, sizes);
+
+        //The single threaded heap, linear and stack allocators aren't thread safe so they sit this one out.
+        for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+        {
+            benchmarkContention(runner, heapMultiThreadedCase, threadCount, pointers);
+            benchmarkContention(runner, mallocCase, threadCount, pointers);
+            benchmarkContention(runner, slabCase, threadCount, pointers);
+            benchmarkContentionLinear(runner, concurrentLinear, threadCount);
+        }
+        benchmarkThreadChurn(runner, heapMultiThreaded, pointers);
+
+        uint32_t* order = (uint32_t*)malloc((TLB_BUFFER_SIZE / TLB_NODE_SIZE) * sizeof(uint32_t));
+        benchmarkBacking(runner, MEMORY_BACKING_MALLOC, order);
+        benchmarkBacking(runner, MEMORY_BACKING_PAGES, order);
+        benchmarkBacking(runner, MEMORY_BACKING_TRANSPARENT_HUGE_PAGES, order);
+        benchmarkBacking(runner, MEMORY_BACKING_EXPLICIT_HUGE_PAGES, order);
+        free(order);
+
+        concurrentLinear.shutdown();
+        slab.shutdown();
+        doubleStack.shutdown();
+        stack.shutdown();
+        linear.shutdown();
+        heapMultiThreaded.shutdown();
+        heap.shutdown();
+
+        free(sizes);
+        free(pointers);
+    }
+}
@@ -0,0 +1,154 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/File.h"
+#include "Foundation/Log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace Air
+{
+    void BenchmarkState::begin()
+    {
+        startTime = timeNow();
+    }
+
+    void BenchmarkState::end()
+    {
+        elapsed = timeFrom(startTime);
+    }
+
+    void BenchmarkState::addMetric(const char* name, double value)
+    {
+        for (uint32_t i = 0; i < metricCount; ++i)
+        {
+            if (strcmp(metrics[i].name, name) == 0)
+            {
+                metrics[i].value = value;
+                return;
+            }
+        }
+
+        AIR_ASSERTM(metricCount < BENCHMARK_MAX_METRICS, "Too many metrics on one benchmark.");
+        metrics[metricCount++] = { name, value };
+    }
+
+    void BenchmarkRunner::init(Allocator* allocator, const char* filter, uint32_t repetitions)
+    {
+        results.init(allocator, 64);
+        this->filter = filter;
+        this->repetitions = repetitions == 0 ? 1 : (repetitions > BENCHMARK_MAX_REPETITIONS ? BENCHMARK_MAX_REPETITIONS : repetitions);
+    }
+
+    void BenchmarkRunner::shutdown()
+    {
+        results.shutdown();
+    }
+
+    bool BenchmarkRunner::matches(const char* suite, const char* name) const
+    {
+        if (filter == nullptr || filter[0] == 0)
+        {
+            return true;
+        }
+
+        char fullName[128];
+        snprintf(fullName, sizeof(fullName), "%s/%s", suite, name);
+        return strstr(fullName, filter) != nullptr;
+    }
+
+    void BenchmarkRunner::run(const char* suite, const char* name, BenchmarkFunction function, void* userData)
+    {
+        if (matches(suite, name) == false)
+        {
+            return;
+        }
+
+        double nanosecondsPerOperation[BENCHMARK_MAX_REPETITIONS];
+        BenchmarkState state;
+        for (uint32_t i = 0; i < repetitions; ++i)
+        {
+            state.elapsed = 0;
+            state.operations = 0;
+            state.threadCount = 1;
+            function(state, userData);
+
+            AIR_ASSERTM(state.operations > 0, "Benchmark %s/%s didn't report how many operations it did.", suite, name);
+            nanosecondsPerOperation[i] = timeMicroseconds(state.elapsed) * 1000.0 / (double)state.operations;
+        }
+
+        //Insertion sort, there are only a handful of repetitions.
+        for (uint32_t i = 1; i < repetitions; ++i)
+        {
+            const double value = nanosecondsPerOperation[i];
+            uint32_t j = i;
+            for (; j > 0 && nanosecondsPerOperation[j - 1] > value; --j)
+            {
+                nanosecondsPerOperation[j] = nanosecondsPerOperation[j - 1];
+            }
+            nanosecondsPerOperation[j] = value;
+        }
+
+        BenchmarkResult& result = results.push_use();
+        result.suite = suite;
+        snprintf(result.name, sizeof(result.name), "%s", name);
+        result.threadCount = state.threadCount;
+        result.operations = state.operations;
+        result.bestNanoseconds = nanosecondsPerOperation[0];
+        result.medianNanoseconds = nanosecondsPerOperation[repetitions / 2];
+        result.metricCount = state.metricCount;
+        memcpy(result.metrics, state.metrics, sizeof(BenchmarkMetric) * state.metricCount);
+
+        aprint("%-12s %-48s %2u thread(s) %12.2f ns/op (median %.2f)\n", suite, name, result.threadCount, result.bestNanoseconds, result.medianNanoseconds);
+    }
+
+    void BenchmarkRunner::printSummary() const
+    {
+        aprint("%u benchmarks run, %u repetitions each.\n", results.size, repetitions);
+    }
+
+    bool BenchmarkRunner::writeJson(const char* path) const
+    {
+        FileHandle file = nullptr;
+        fileOpen(path, "w", &file);
+        if (file == nullptr)
+        {
+            aprint("Can't open %s to write the benchmark results.\n", path);
+            return false;
+        }
+
+#if defined(AIR_DEBUG)
+        const char* configuration = "debug";
+#else
+        const char* configuration = "release";
+#endif
+
+        fprintf(file, "{\n");
+        fprintf(file, "  \"version\": 1,\n");
+        fprintf(file, "  \"timestamp\": %lld,\n", (long long)time(nullptr));
+        fprintf(file, "  \"configuration\": \"%s\",\n", configuration);
+        fprintf(file, "  \"repetitions\": %u,\n", repetitions);
+        fprintf(file, "  \"results\": [\n");
+        for (uint32_t i = 0; i < results.size; ++i)
+        {
+            const BenchmarkResult& result = results[i];
+            fprintf(file, "    {\"suite\": \"%s\", \"name\": \"%s\", \"threads\": %u, \"operations\": %llu, ",
+                    result.suite, result.name, result.threadCount, (unsigned long long)result.operations);
+            fprintf(file, "\"best_ns_per_op\": %.3f, \"median_ns_per_op\": %.3f, \"metrics\": {",
+                    result.bestNanoseconds, result.medianNanoseconds);
+            for (uint32_t m = 0; m < result.metricCount; ++m)
+            {
+                fprintf(file, "%s\"%s\": %.10g", m ? ", " : "", result.metrics[m].name, result.metrics[m].value);
+            }
+            fprintf(file, "}}%s\n", i + 1 < results.size ? "," : "");
+        }
+        fprintf(file, "  ]\n");
+        fprintf(file, "}\n");
+
+        fileClose(file);
+        aprint("Benchmark results written to %s.\n", path);
+        return true;
+    }
+}
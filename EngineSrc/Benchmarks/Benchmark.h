@@ -0,0 +1,170 @@
+#ifndef BENCHMARK_HDR
+#define BENCHMARK_HDR
+
+#include "Foundation/Platform.h"
+#include "Foundation/Memory.h"
+#include "Foundation/Array.h"
+#include "Foundation/Time.h"
+
+#include <atomic>
+#include <thread>
+
+namespace Air
+{
+    static constexpr uint32_t BENCHMARK_MAX_METRICS = 8;
+    static constexpr uint32_t BENCHMARK_MAX_THREADS = 32;
+    static constexpr uint32_t BENCHMARK_MAX_REPETITIONS = 64;
+
+    //Extra numbers a benchmark wants to report next to the timing, like fragmentation or bytes committed.
+    struct BenchmarkMetric
+    {
+        const char* name;
+        double value;
+    };
+
+    struct BenchmarkResult
+    {
+        const char* suite;
+        char name[96];
+        uint32_t threadCount;
+        uint64_t operations;
+        //Per operation timings over all the repetitions.
+        double bestNanoseconds;
+        double medianNanoseconds;
+
+        BenchmarkMetric metrics[BENCHMARK_MAX_METRICS];
+        uint32_t metricCount;
+    };
+
+    //Handed to the benchmark on every repetition. The benchmark does its setup, then wraps the part
+    //being measured in begin() and end() and says how many operations it did.
+    struct BenchmarkState
+    {
+        void begin();
+        void end();
+
+        //Metrics are kept from the last repetition.
+        void addMetric(const char* name, double value);
+
+        int64_t startTime = 0;
+        int64_t elapsed = 0;
+        uint64_t operations = 0;
+        uint32_t threadCount = 1;
+
+        BenchmarkMetric metrics[BENCHMARK_MAX_METRICS];
+        uint32_t metricCount = 0;
+    };
+
+    //Deterministic xorshift so every run of a benchmark sees the same sequence.
+    struct BenchmarkRandom
+    {
+        void init(uint64_t seed)
+        {
+            state = seed ? seed : 0x9E3779B97F4A7C15ull;
+        }
+
+        uint64_t next()
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        //Value in [0, range).
+        uint32_t range(uint32_t range)
+        {
+            return (uint32_t)(((next() >> 32) * range) >> 32);
+        }
+
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+    };
+
+    using BenchmarkFunction = void(*)(BenchmarkState& state, void* userData);
+
+    struct BenchmarkRunner
+    {
+        //Only benchmarks whose "suite/name" contains filter are run. A null filter runs everything.
+        void init(Allocator* allocator, const char* filter, uint32_t repetitions);
+        void shutdown();
+
+        bool matches(const char* suite, const char* name) const;
+
+        //Runs the benchmark repetitions times and records the best and median time per operation.
+        void run(const char* suite, const char* name, BenchmarkFunction function, void* userData);
+
+        template<typename Function>
+        void run(const char* suite, const char* name, Function function)
+        {
+            run(suite, name, [](BenchmarkState& state, void* userData) { (*(Function*)userData)(state); }, &function);
+        }
+
+        void printSummary() const;
+        //Writes all the results as JSON so runs of different versions can be diffed by tools.
+        bool writeJson(const char* path) const;
+
+        Array<BenchmarkResult> results;
+        const char* filter = nullptr;
+        uint32_t repetitions = 5;
+    };
+
+    //Runs function(threadIndex) on threadCount threads. Timing covers from the moment all threads are
+    //released until the last one finishes, thread creation is left out.
+    template<typename Function>
+    void benchmarkParallel(BenchmarkState& state, uint32_t threadCount, Function function)
+    {
+        std::atomic<uint32_t> readyCount{ 0 };
+        std::atomic<bool> go{ false };
+        std::thread threads[BENCHMARK_MAX_THREADS];
+
+        state.threadCount = threadCount;
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            threads[i] = std::thread([&, i]()
+            {
+                readyCount.fetch_add(1, std::memory_order_release);
+                while (go.load(std::memory_order_acquire) == false)
+                {
+                    std::this_thread::yield();
+                }
+
+                function(i);
+            });
+        }
+
+        while (readyCount.load(std::memory_order_acquire) < threadCount)
+        {
+            std::this_thread::yield();
+        }
+
+        state.begin();
+        go.store(true, std::memory_order_release);
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            threads[i].join();
+        }
+        state.end();
+    }
+
+    //Keeps the compiler from throwing away work whose result is never used.
+    template<typename T>
+    inline void benchmarkDoNotOptimise(const T& value)
+    {
+#if defined(_MSC_VER)
+        static const void* volatile sink;
+        sink = &value;
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    void benchmarkAllocators(BenchmarkRunner& runner);
+    void benchmarkQueues(BenchmarkRunner& runner);
+    void benchmarkHashMaps(BenchmarkRunner& runner);
+    void benchmarkConcurrentHashMaps(BenchmarkRunner& runner);
+    void benchmarkStrings(BenchmarkRunner& runner);
+    void benchmarkParallelAlgorithms(BenchmarkRunner& runner);
+    void benchmarkResourcePools(BenchmarkRunner& runner);
+}
+
+#endif // !BENCHMARK_HDR
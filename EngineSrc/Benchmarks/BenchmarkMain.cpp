@@ -0,0 +1,58 @@
+#include "Benchmark.h"
+
+#include "Foundation/Log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//Usage: AirBenchmarks [--filter text] [--repetitions count] [--json path]
+//Without --json the results are written to AirBenchmarks.json in the working directory.
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    const char* jsonPath = "AirBenchmarks.json";
+    uint32_t repetitions = 5;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+        {
+            repetitions = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else
+        {
+            aprint("Unknown argument %s.\nUsage: AirBenchmarks [--filter text] [--repetitions count] [--json path]\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Air::timeServiceInit();
+
+    Air::MallocAllocator mallocAllocator;
+    Air::BenchmarkRunner runner;
+    runner.init(&mallocAllocator, filter, repetitions);
+
+    Air::benchmarkAllocators(runner);
+    Air::benchmarkQueues(runner);
+    Air::benchmarkHashMaps(runner);
+    Air::benchmarkConcurrentHashMaps(runner);
+    Air::benchmarkStrings(runner);
+    Air::benchmarkParallelAlgorithms(runner);
+    Air::benchmarkResourcePools(runner);
+
+    runner.printSummary();
+    const bool written = runner.writeJson(jsonPath);
+    runner.shutdown();
+
+    Air::timeServiceShutdown();
+
+    return written ? 0 : 1;
+}
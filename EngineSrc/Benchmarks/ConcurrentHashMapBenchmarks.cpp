@@ -0,0 +1,153 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/ConcurrentHashMap.h"
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+
+namespace Air
+{
+    //About as many entries as the service and resource loader registries hold.
+    static constexpr uint32_t REGISTRY_ENTRIES = 64;
+    static constexpr uint32_t REGISTRY_READS_PER_THREAD = 1u << 19;
+    static constexpr uint64_t REGISTRY_WRITER_KEY = 0xFFFFFFFFull;
+
+    //The shape ServiceManager and ResourceManager would need without SnapshotHashMap.
+    struct MutexHashMap
+    {
+        void init(Allocator* allocator, uint64_t initialCapacity)
+        {
+            map.init(allocator, initialCapacity);
+        }
+
+        void shutdown()
+        {
+            map.shutdown();
+        }
+
+        uint64_t get(uint64_t key)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return map.get(key);
+        }
+
+        void insert(uint64_t key, uint64_t value)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            map.insert(key, value);
+        }
+
+        uint32_t remove(uint64_t key)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return map.remove(key);
+        }
+
+        FlatHashMap<uint64_t, uint64_t, HashMapIdentityHasher> map;
+        std::mutex mutex;
+    };
+
+    //Key i is the hash of a made up name and maps to i + 1, so readers can check every value they get back.
+    static uint64_t registryKey(uint32_t index)
+    {
+        return hashCalculate((uint64_t)index * 0x9E3779B97F4A7C15ull);
+    }
+
+    //readers threads each do a fixed number of lookups. With a writer an extra thread keeps adding and removing an
+    //entry the readers never ask for until they are all done, like the main thread registering types during loading.
+    template<typename Map>
+    static void benchmarkRegistryReads(BenchmarkRunner& runner, const char* mapName, Map& map, uint32_t readers, bool withWriter)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "%s/%s/%ut", mapName, withWriter ? "read_while_writing" : "read", readers);
+        runner.run("concurrent_hash_map", name, [&](BenchmarkState& state)
+        {
+            std::atomic<uint32_t> readersDone{ 0 };
+            std::atomic<uint64_t> wrongValues{ 0 };
+            std::atomic<uint64_t> writes{ 0 };
+
+            benchmarkParallel(state, readers + (withWriter ? 1 : 0), [&](uint32_t threadIndex)
+            {
+                if (threadIndex == readers)
+                {
+                    uint64_t written = 0;
+                    while (readersDone.load(std::memory_order_acquire) < readers)
+                    {
+                        map.insert(REGISTRY_WRITER_KEY, 1);
+                        map.remove(REGISTRY_WRITER_KEY);
+                        written += 2;
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    }
+                    writes.store(written, std::memory_order_relaxed);
+                    return;
+                }
+
+                BenchmarkRandom random;
+                random.init(threadIndex + 1);
+                uint64_t wrong = 0;
+                for (uint32_t i = 0; i < REGISTRY_READS_PER_THREAD; ++i)
+                {
+                    const uint32_t index = random.range(REGISTRY_ENTRIES);
+                    wrong += map.get(registryKey(index)) != (uint64_t)index + 1;
+                }
+
+                wrongValues.fetch_add(wrong, std::memory_order_relaxed);
+                readersDone.fetch_add(1, std::memory_order_release);
+            });
+
+            AIR_ASSERTM(wrongValues.load() == 0, "%s returned %llu wrong values.", mapName, (unsigned long long)wrongValues.load());
+            state.operations = (uint64_t)readers * REGISTRY_READS_PER_THREAD;
+            state.addMetric("writes", (double)writes.load());
+        });
+    }
+
+    void benchmarkConcurrentHashMaps(BenchmarkRunner& runner)
+    {
+        uint32_t maxThreads = std::thread::hardware_concurrency();
+        maxThreads = maxThreads == 0 ? 1 : (maxThreads > BENCHMARK_MAX_THREADS ? BENCHMARK_MAX_THREADS : maxThreads);
+
+        MallocAllocator mallocAllocator;
+
+        SnapshotHashMap<uint64_t, uint64_t, HashMapIdentityHasher> snapshot;
+        snapshot.init(&mallocAllocator, REGISTRY_ENTRIES);
+        MutexHashMap mutexMap;
+        mutexMap.init(&mallocAllocator, REGISTRY_ENTRIES);
+
+        snapshot.update([&](FlatHashMap<uint64_t, uint64_t, HashMapIdentityHasher>& table)
+        {
+            for (uint32_t i = 0; i < REGISTRY_ENTRIES; ++i)
+            {
+                table.insert(registryKey(i), (uint64_t)i + 1);
+            }
+        });
+
+        for (uint32_t i = 0; i < REGISTRY_ENTRIES; ++i)
+        {
+            mutexMap.insert(registryKey(i), (uint64_t)i + 1);
+        }
+
+        const uint32_t readerCounts[] = { 1, 2, 4, 8, 16, 32 };
+        for (uint32_t readers : readerCounts)
+        {
+            //Oversubscribed runs only measure the scheduler.
+            if (readers > maxThreads)
+            {
+                continue;
+            }
+
+            benchmarkRegistryReads(runner, "snapshot", snapshot, readers, false);
+            benchmarkRegistryReads(runner, "mutex", mutexMap, readers, false);
+
+            if (readers + 1 <= maxThreads)
+            {
+                benchmarkRegistryReads(runner, "snapshot", snapshot, readers, true);
+                benchmarkRegistryReads(runner, "mutex", mutexMap, readers, true);
+            }
+        }
+
+        mutexMap.shutdown();
+        snapshot.shutdown();
+    }
+}
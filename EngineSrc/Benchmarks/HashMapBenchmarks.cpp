@@ -0,0 +1,1225 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/HashMap.h"
+#include "Foundation/HashMapBlob.h"
+#include "Foundation/String.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Air
+{
+    static constexpr uint32_t DIFFERENTIAL_OPERATIONS = 400000;
+    static constexpr uint32_t DIFFERENTIAL_STRING_COUNT = 4096;
+    static constexpr uint32_t LOOKUP_COUNT = 1u << 20;
+    static constexpr uint32_t BATCH_KEY_COUNT = 917000;
+    //Roughly a quarter of the vertices in an indexed mesh are unique.
+    static constexpr uint32_t DEDUP_VERTEX_COUNT = 1u << 20;
+    static constexpr uint32_t DEDUP_UNIQUE_VERTICES = DEDUP_VERTEX_COUNT / 4;
+    //A cache that keeps about this many entries alive while they are replaced one by one.
+    static constexpr uint32_t CHURN_LIVE_ENTRIES = 57000;
+    static constexpr uint32_t CHURN_OPERATIONS = 1u << 22;
+    //Grows through every doubling up to an 8M slot table.
+    static constexpr uint32_t GROWTH_ENTRIES = 1u << 22;
+    //A large asset catalogue, hashed asset names to offsets in the pack files.
+    static constexpr uint32_t CATALOGUE_ENTRIES = 1u << 21;
+
+    //Throws away most of the hash so keys pile up in the same few probe sequences and tag bytes.
+    //This is what catches probe loops that give up after the first group.
+    struct HashMapCollidingHasher
+    {
+        static uint64_t hash(uint64_t value)
+        {
+            const uint64_t mixed = hashCalculate(value % 61);
+            return mixed;
+        }
+    };
+
+    template<typename Map>
+    static void differentialCheckEntries(Map& map, const std::unordered_map<uint64_t, uint64_t>& reference)
+    {
+        AIR_ASSERTM(map.size == reference.size(), "Hash map has %llu entries, the reference has %llu.",
+                    (unsigned long long)map.size, (unsigned long long)reference.size());
+
+        uint64_t visited = 0;
+        for (FlatHashMapIterator it = map.iteratorBegin(); it.isValid(); map.iteratorAdvance(it))
+        {
+            const auto& keyValue = map.getStructure(it);
+            const auto found = reference.find(keyValue.key);
+            AIR_ASSERTM(found != reference.end() && found->second == keyValue.value, "Hash map iterated an entry the reference doesn't have.");
+            ++visited;
+        }
+        AIR_ASSERTM(visited == reference.size(), "Hash map iteration visited %llu of %llu entries.",
+                    (unsigned long long)visited, (unsigned long long)reference.size());
+    }
+
+    //Runs the same random inserts, overwrites, removes, lookups and clears against FlatHashMap and std::unordered_map
+    //and asserts they never disagree. keyRange controls how often operations land on keys that are already there.
+    template<typename Hasher, typename Group>
+    static uint64_t differentialRun(Allocator* allocator, uint64_t seed, uint32_t keyRange, uint32_t compactionSlots = 0, uint32_t resizeGroups = 0)
+    {
+        FlatHashMap<uint64_t, uint64_t, Hasher, Group> map;
+        map.init(allocator, 4);
+        map.setDefaultValue(UINT64_MAX);
+        map.setIncrementalCompaction(compactionSlots);
+        map.setIncrementalResize(resizeGroups);
+        std::unordered_map<uint64_t, uint64_t> reference;
+
+        BenchmarkRandom random;
+        random.init(seed);
+        for (uint32_t i = 0; i < DIFFERENTIAL_OPERATIONS; ++i)
+        {
+            const uint64_t key = random.range(keyRange);
+            const uint32_t operation = random.range(100);
+            if (operation < 45)
+            {
+                const uint64_t value = random.next();
+                map.insert(key, value);
+                reference[key] = value;
+            }
+            else if (operation < 75)
+            {
+                const uint32_t removed = map.remove(key);
+                AIR_ASSERTM(removed == reference.erase(key), "Remove of key %llu disagrees with the reference.", (unsigned long long)key);
+            }
+            else
+            {
+                const auto found = reference.find(key);
+                const FlatHashMapIterator it = map.find(key);
+                AIR_ASSERTM(it.isValid() == (found != reference.end()), "Lookup of key %llu disagrees with the reference.", (unsigned long long)key);
+                AIR_ASSERTM(map.get(key) == (found != reference.end() ? found->second : UINT64_MAX), "Value of key %llu disagrees with the reference.", (unsigned long long)key);
+            }
+
+            if (i % 100000 == 99999)
+            {
+                map.clear();
+                reference.clear();
+            }
+
+            //Iterating finishes a running resize, so leave most of them to run their course.
+            if (i % 16384 == 0)
+            {
+                differentialCheckEntries(map, reference);
+            }
+        }
+
+        differentialCheckEntries(map, reference);
+        map.shutdown();
+        return DIFFERENTIAL_OPERATIONS;
+    }
+
+    //Interned const char* keys looked up through StringViews into a different buffer, and through findByHash.
+    static uint64_t differentialStrings(Allocator* allocator)
+    {
+        char* names = (char*)allocator->allocate(DIFFERENTIAL_STRING_COUNT * 32, 1);
+        char* queries = (char*)allocator->allocate(DIFFERENTIAL_STRING_COUNT * 40, 1);
+
+        FlatHashMap<const char*, uint32_t> map;
+        map.init(allocator, 4);
+        map.setDefaultValue(UINT32_MAX);
+        for (uint32_t i = 0; i < DIFFERENTIAL_STRING_COUNT; ++i)
+        {
+            snprintf(names + i * 32, 32, "resource/texture_%u.png", i);
+            map.insert(names + i * 32, i);
+        }
+
+        uint64_t operations = 0;
+        for (uint32_t i = 0; i < DIFFERENTIAL_STRING_COUNT * 2; ++i)
+        {
+            //Queries aren't null terminated where the view ends, so the comparison has to respect the length.
+            char* query = queries + (i % DIFFERENTIAL_STRING_COUNT) * 40;
+            const int length = snprintf(query, 40, "resource/texture_%u.pngXYZ", i);
+            const StringView view = { query, (size_t)length - 3 };
+
+            const FlatHashMapIterator it = map.find(view);
+            AIR_ASSERTM(it.isValid() == (i < DIFFERENTIAL_STRING_COUNT), "StringView lookup of %u disagrees.", i);
+            if (it.isValid())
+            {
+                AIR_ASSERTM(map.get(it) == i, "StringView lookup of %u found the wrong entry.", i);
+            }
+
+            const uint64_t hash = HashMapHasher::hash(view);
+            const FlatHashMapIterator byHash = map.findByHash(hash, [&](const char* key) { return hashKeyEquals(key, view); });
+            AIR_ASSERTM(byHash.index == it.index, "findByHash of %u disagrees with find.", i);
+            operations += 2;
+        }
+
+        map.shutdown();
+        allocator->deallocate(queries);
+        allocator->deallocate(names);
+        return operations;
+    }
+
+    enum LookupKeys : uint8_t
+    {
+        LOOKUP_KEYS_SEQUENTIAL = 0,
+        LOOKUP_KEYS_RANDOM,
+        //Hashes of resource names, stored with the identity hasher like the service and resource maps do.
+        LOOKUP_KEYS_NAME_HASHES,
+        LOOKUP_KEYS_COUNT
+    };
+
+    static const char* LOOKUP_KEY_NAMES[LOOKUP_KEYS_COUNT] = { "sequential", "random", "name_hashes" };
+
+    //Fills keys with count keys that are in the map and misses with count keys that aren't.
+    static void lookupKeysGenerate(LookupKeys distribution, uint64_t* keys, uint64_t* misses, uint32_t count)
+    {
+        BenchmarkRandom random;
+        random.init(0x10C4);
+        char name[64];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            switch (distribution)
+            {
+                case LOOKUP_KEYS_SEQUENTIAL:
+                    keys[i] = i;
+                    misses[i] = (uint64_t)count + i;
+                    break;
+                case LOOKUP_KEYS_RANDOM:
+                    //The top bit splits hits from misses so the two can never collide.
+                    keys[i] = random.next() & ~(1ull << 63);
+                    misses[i] = random.next() | (1ull << 63);
+                    break;
+                default:
+                {
+                    const int length = snprintf(name, sizeof(name), "resource/mesh_%u.gltf", i);
+                    keys[i] = hashBytes(name, (size_t)length);
+                    const int missLength = snprintf(name, sizeof(name), "resource/missing_%u.gltf", i);
+                    misses[i] = hashBytes(name, (size_t)missLength);
+                    break;
+                }
+            }
+        }
+    }
+
+    //Same walk as findByHash, counting the groups it loads on the way.
+    template<typename Hasher, typename Group>
+    static double averageGroupsProbed(FlatHashMap<uint64_t, uint64_t, Hasher, Group>& map, const uint64_t* keys, uint32_t count)
+    {
+        uint64_t totalGroups = 0;
+        for (uint32_t k = 0; k < count; ++k)
+        {
+            const uint64_t hash = Hasher::hash(keys[k]);
+            ProbeSequence sequence = map.probe(hash);
+            bool done = false;
+            while (done == false)
+            {
+                ++totalGroups;
+                const Group group{ map.controlBytes + sequence.getOffset() };
+                for (uint32_t i : group.match(hash2(hash)))
+                {
+                    if (map.slots[sequence.getOffset(i)].key == keys[k])
+                    {
+                        done = true;
+                        break;
+                    }
+                }
+
+                done = done || group.matchEmpty();
+                sequence.next();
+            }
+        }
+
+        return (double)totalGroups / count;
+    }
+
+    //Lookups that hit or miss a map filled to size keys, once per group width. Misses are where the widths differ
+    //most: a lookup only stops at a group with an empty slot, so a wider group gives up sooner on a loaded table.
+    template<typename Hasher, typename Group>
+    static void benchmarkLookups(BenchmarkRunner& runner, Allocator* allocator, HashMapGroupKind kind, LookupKeys distribution, uint32_t size)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "lookup/%s/%s/%u/hit", hashMapGroupName(kind), LOOKUP_KEY_NAMES[distribution], size);
+        if (runner.matches("hash_map", name) == false)
+        {
+            //The miss name shares everything up to the last part, so neither would run.
+            snprintf(name, sizeof(name), "lookup/%s/%s/%u/miss", hashMapGroupName(kind), LOOKUP_KEY_NAMES[distribution], size);
+            if (runner.matches("hash_map", name) == false)
+            {
+                return;
+            }
+        }
+
+        uint64_t* keys = (uint64_t*)air_alloca(sizeof(uint64_t) * size, allocator);
+        uint64_t* misses = (uint64_t*)air_alloca(sizeof(uint64_t) * size, allocator);
+        uint32_t* order = (uint32_t*)air_alloca(sizeof(uint32_t) * LOOKUP_COUNT, allocator);
+        lookupKeysGenerate(distribution, keys, misses, size);
+
+        //Random order so the lookups don't walk the keys in insertion order.
+        BenchmarkRandom random;
+        random.init(0x0DE7);
+        for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+        {
+            order[i] = random.range(size);
+        }
+
+        FlatHashMap<uint64_t, uint64_t, Hasher, Group> map;
+        map.init(allocator, 4);
+        map.setDefaultValue(UINT64_MAX);
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            map.insert(keys[i], i);
+        }
+
+        const double loadFactor = (double)map.size / map.capacity;
+        const uint64_t* const sets[2] = { keys, misses };
+        const char* const outcomes[2] = { "hit", "miss" };
+        for (uint32_t s = 0; s < 2; ++s)
+        {
+            snprintf(name, sizeof(name), "lookup/%s/%s/%u/%s", hashMapGroupName(kind), LOOKUP_KEY_NAMES[distribution], size, outcomes[s]);
+            const uint64_t* lookups = sets[s];
+            runner.run("hash_map", name, [&](BenchmarkState& state)
+            {
+                uint64_t found = 0;
+                state.begin();
+                for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+                {
+                    found += map.find(lookups[order[i]]).isValid();
+                }
+                state.end();
+
+                benchmarkDoNotOptimise(found);
+                AIR_ASSERTM(found == (s == 0 ? LOOKUP_COUNT : 0), "Lookup %s found %llu of %u keys.", name, (unsigned long long)found, LOOKUP_COUNT);
+                state.operations = LOOKUP_COUNT;
+                state.addMetric("groups_probed", averageGroupsProbed(map, lookups, size));
+                state.addMetric("load_factor", loadFactor);
+            });
+        }
+
+        map.shutdown();
+        air_free(order, allocator);
+        air_free(misses, allocator);
+        air_free(keys, allocator);
+    }
+
+    //Batched lookups against the same lookups done one at a time, on a table too big for the cache.
+    static void benchmarkBatchFind(BenchmarkRunner& runner, Allocator* allocator)
+    {
+        if (runner.matches("hash_map", "batch/find/single") == false && runner.matches("hash_map", "batch/find/batched") == false)
+        {
+            return;
+        }
+
+        uint64_t* keys = (uint64_t*)air_alloca(sizeof(uint64_t) * BATCH_KEY_COUNT, allocator);
+        uint64_t* misses = (uint64_t*)air_alloca(sizeof(uint64_t) * BATCH_KEY_COUNT, allocator);
+        uint64_t* queries = (uint64_t*)air_alloca(sizeof(uint64_t) * LOOKUP_COUNT, allocator);
+        FlatHashMapIterator* single = (FlatHashMapIterator*)air_alloca(sizeof(FlatHashMapIterator) * LOOKUP_COUNT, allocator);
+        FlatHashMapIterator* batched = (FlatHashMapIterator*)air_alloca(sizeof(FlatHashMapIterator) * LOOKUP_COUNT, allocator);
+        lookupKeysGenerate(LOOKUP_KEYS_RANDOM, keys, misses, BATCH_KEY_COUNT);
+
+        FlatHashMap<uint64_t, uint64_t> map;
+        map.init(allocator, BATCH_KEY_COUNT);
+        map.insertBatch(keys, keys, BATCH_KEY_COUNT);
+
+        //One in eight queries misses.
+        BenchmarkRandom random;
+        random.init(0xBA7C);
+        for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+        {
+            const uint32_t index = random.range(BATCH_KEY_COUNT);
+            queries[i] = random.range(8) == 0 ? misses[index] : keys[index];
+        }
+
+        runner.run("hash_map", "batch/find/single", [&](BenchmarkState& state)
+        {
+            state.begin();
+            for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+            {
+                single[i] = map.find(queries[i]);
+            }
+            state.end();
+            state.operations = LOOKUP_COUNT;
+        });
+
+        runner.run("hash_map", "batch/find/batched", [&](BenchmarkState& state)
+        {
+            state.begin();
+            map.findBatch(queries, LOOKUP_COUNT, batched);
+            state.end();
+            state.operations = LOOKUP_COUNT;
+
+            for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+            {
+                AIR_ASSERTM(batched[i].index == map.find(queries[i]).index, "findBatch disagrees with find for query %u.", i);
+            }
+        });
+
+        map.shutdown();
+        air_free(batched, allocator);
+        air_free(single, allocator);
+        air_free(queries, allocator);
+        air_free(misses, allocator);
+        air_free(keys, allocator);
+    }
+
+    //Filling an empty map the way callers do today, with a reserve but one key at a time, and as one batch.
+    static void benchmarkBatchInsert(BenchmarkRunner& runner, Allocator* allocator)
+    {
+        if (runner.matches("hash_map", "batch/insert/") == false)
+        {
+            return;
+        }
+
+        uint64_t* keys = (uint64_t*)air_alloca(sizeof(uint64_t) * BATCH_KEY_COUNT, allocator);
+        uint64_t* misses = (uint64_t*)air_alloca(sizeof(uint64_t) * BATCH_KEY_COUNT, allocator);
+        lookupKeysGenerate(LOOKUP_KEYS_RANDOM, keys, misses, BATCH_KEY_COUNT);
+
+        const auto checkFilled = [&](FlatHashMap<uint64_t, uint64_t>& map)
+        {
+            AIR_ASSERTM(map.size == BATCH_KEY_COUNT, "Map has %llu of %u keys after the insert.", (unsigned long long)map.size, BATCH_KEY_COUNT);
+            for (uint32_t i = 0; i < BATCH_KEY_COUNT; i += 97)
+            {
+                AIR_ASSERTM(map.get(keys[i]) == misses[i], "Key %u has the wrong value after the insert.", i);
+            }
+        };
+
+        runner.run("hash_map", "batch/insert/single", [&](BenchmarkState& state)
+        {
+            FlatHashMap<uint64_t, uint64_t> map;
+            map.init(allocator, 4);
+            state.begin();
+            for (uint32_t i = 0; i < BATCH_KEY_COUNT; ++i)
+            {
+                map.insert(keys[i], misses[i]);
+            }
+            state.end();
+            state.operations = BATCH_KEY_COUNT;
+            checkFilled(map);
+            map.shutdown();
+        });
+
+        runner.run("hash_map", "batch/insert/single_reserved", [&](BenchmarkState& state)
+        {
+            FlatHashMap<uint64_t, uint64_t> map;
+            map.init(allocator, 4);
+            state.begin();
+            map.reserve(BATCH_KEY_COUNT);
+            for (uint32_t i = 0; i < BATCH_KEY_COUNT; ++i)
+            {
+                map.insert(keys[i], misses[i]);
+            }
+            state.end();
+            state.operations = BATCH_KEY_COUNT;
+            checkFilled(map);
+            map.shutdown();
+        });
+
+        runner.run("hash_map", "batch/insert/batched", [&](BenchmarkState& state)
+        {
+            FlatHashMap<uint64_t, uint64_t> map;
+            map.init(allocator, 4);
+            state.begin();
+            map.insertBatch(keys, misses, BATCH_KEY_COUNT);
+            state.end();
+            state.operations = BATCH_KEY_COUNT;
+            checkFilled(map);
+            map.shutdown();
+        });
+
+        air_free(misses, allocator);
+        air_free(keys, allocator);
+    }
+
+    //Deduplicating vertex hashes, with a map of key to nothing in particular as we had to before, and with a set.
+    static void benchmarkDedup(BenchmarkRunner& runner, Allocator* allocator)
+    {
+        if (runner.matches("hash_map", "set/dedup/") == false)
+        {
+            return;
+        }
+
+        uint64_t* vertices = (uint64_t*)air_alloca(sizeof(uint64_t) * DEDUP_VERTEX_COUNT, allocator);
+        BenchmarkRandom random;
+        random.init(0xDED0);
+        for (uint32_t i = 0; i < DEDUP_VERTEX_COUNT; ++i)
+        {
+            vertices[i] = hashCalculate((uint64_t)random.range(DEDUP_UNIQUE_VERTICES));
+        }
+
+        std::unordered_set<uint64_t> reference(vertices, vertices + DEDUP_VERTEX_COUNT);
+
+        runner.run("hash_map", "set/dedup/map", [&](BenchmarkState& state)
+        {
+            FlatHashMap<uint64_t, uint8_t, HashMapIdentityHasher> map;
+            map.init(allocator, 4);
+            uint64_t unique = 0;
+            state.begin();
+            for (uint32_t i = 0; i < DEDUP_VERTEX_COUNT; ++i)
+            {
+                if (map.find(vertices[i]).isInvalid())
+                {
+                    map.insert(vertices[i], 0);
+                    ++unique;
+                }
+            }
+            state.end();
+            AIR_ASSERTM(unique == reference.size(), "Map found %llu unique vertices, expected %llu.", (unsigned long long)unique, (unsigned long long)reference.size());
+            state.operations = DEDUP_VERTEX_COUNT;
+            state.addMetric("table_bytes", (double)map.calculateSize(map.capacity));
+            map.shutdown();
+        });
+
+        runner.run("hash_map", "set/dedup/set", [&](BenchmarkState& state)
+        {
+            FlatHashSet<uint64_t, HashMapIdentityHasher> set;
+            set.init(allocator, 4);
+            uint64_t unique = 0;
+            state.begin();
+            for (uint32_t i = 0; i < DEDUP_VERTEX_COUNT; ++i)
+            {
+                unique += set.insert(vertices[i]);
+            }
+            state.end();
+            AIR_ASSERTM(unique == reference.size(), "Set found %llu unique vertices, expected %llu.", (unsigned long long)unique, (unsigned long long)reference.size());
+            state.operations = DEDUP_VERTEX_COUNT;
+            state.addMetric("table_bytes", (double)set.calculateSize(set.capacity));
+            set.shutdown();
+        });
+
+        runner.run("hash_map", "set/dedup/set_batched", [&](BenchmarkState& state)
+        {
+            FlatHashSet<uint64_t, HashMapIdentityHasher> set;
+            set.init(allocator, 4);
+            state.begin();
+            const uint64_t unique = set.insertBatch(vertices, DEDUP_VERTEX_COUNT);
+            state.end();
+            AIR_ASSERTM(unique == reference.size() && set.size == unique, "Batched set found %llu unique vertices, expected %llu.", (unsigned long long)unique, (unsigned long long)reference.size());
+            for (uint64_t vertex : reference)
+            {
+                AIR_ASSERTM(set.contains(vertex), "Batched set lost a vertex.");
+            }
+            state.operations = DEDUP_VERTEX_COUNT;
+            state.addMetric("table_bytes", (double)set.calculateSize(set.capacity));
+            set.shutdown();
+        });
+
+        air_free(vertices, allocator);
+    }
+
+    //Every group width this CPU can run. The portable group runs everywhere so its numbers can be compared on x86 too.
+    template<typename Function>
+    static void forEachHashMapGroup(Function function)
+    {
+        const HashMapGroupKind kinds[] = { HASH_MAP_GROUP_PORTABLE, HASH_MAP_GROUP_SSE2, HASH_MAP_GROUP_AVX2 };
+        for (HashMapGroupKind kind : kinds)
+        {
+#if AIR_HASH_MAP_X86
+            if (kind == HASH_MAP_GROUP_AVX2 && hashMapCpuFeatures().avx2 == false)
+            {
+                continue;
+            }
+#else
+            if (kind != HASH_MAP_GROUP_PORTABLE)
+            {
+                continue;
+            }
+#endif
+            hashMapDispatchGroup(kind, [&](auto tag)
+            {
+                function(kind, tag);
+            });
+        }
+    }
+
+    static double insertPercentile(const int64_t* sortedTimes, uint32_t count, double percentile)
+    {
+        const uint32_t index = (uint32_t)(percentile * (count - 1));
+        return timeMicroseconds(sortedTimes[index]) * 1000.0;
+    }
+
+    //Replaces entries of a long lived map one at a time, like a resource cache, and times every insert on its own so
+    //the spikes from squashing tombstones show up in the tail. slotsPerInsert of 0 leaves it to the full rehash.
+    static void benchmarkChurn(BenchmarkRunner& runner, Allocator* allocator, const char* name, uint32_t slotsPerInsert)
+    {
+        runner.run("hash_map", name, [&](BenchmarkState& state)
+        {
+            uint64_t* live = (uint64_t*)air_alloca(sizeof(uint64_t) * CHURN_LIVE_ENTRIES, allocator);
+            int64_t* insertTimes = (int64_t*)air_alloca(sizeof(int64_t) * CHURN_OPERATIONS, allocator);
+
+            FlatHashMap<uint64_t, uint64_t> map;
+            //Sized up front like a cache would be, so the only rehashes are the ones squashing tombstones.
+            map.init(allocator, CHURN_LIVE_ENTRIES * 2);
+            map.setIncrementalCompaction(slotsPerInsert);
+
+            uint64_t nextKey = 0;
+            for (uint32_t i = 0; i < CHURN_LIVE_ENTRIES; ++i)
+            {
+                live[i] = nextKey++;
+                map.insert(live[i], live[i]);
+            }
+
+            BenchmarkRandom random;
+            random.init(0xC4A7);
+            state.begin();
+            for (uint32_t i = 0; i < CHURN_OPERATIONS; ++i)
+            {
+                const uint32_t victim = random.range(CHURN_LIVE_ENTRIES);
+                map.remove(live[victim]);
+                live[victim] = nextKey++;
+
+                const int64_t start = timeNow();
+                map.insert(live[victim], live[victim]);
+                insertTimes[i] = timeFrom(start);
+            }
+            state.end();
+            state.operations = CHURN_OPERATIONS;
+
+            AIR_ASSERTM(map.size == CHURN_LIVE_ENTRIES, "Churned map has %llu entries, expected %u.", (unsigned long long)map.size, CHURN_LIVE_ENTRIES);
+            for (uint32_t i = 0; i < CHURN_LIVE_ENTRIES; ++i)
+            {
+                AIR_ASSERTM(map.get(live[i]) == live[i], "Churned map lost key %llu.", (unsigned long long)live[i]);
+            }
+
+            const FlatHashMapStats stats = map.getStats();
+            AIR_ASSERTM(stats.tombstones == map.tombstones, "Map counts %llu tombstones but has %llu.", (unsigned long long)map.tombstones, (unsigned long long)stats.tombstones);
+
+            std::sort(insertTimes, insertTimes + CHURN_OPERATIONS);
+            const int64_t* slowInserts = std::upper_bound(insertTimes, insertTimes + CHURN_OPERATIONS, (int64_t)100);
+            state.addMetric("insert_p99_ns", insertPercentile(insertTimes, CHURN_OPERATIONS, 0.99));
+            state.addMetric("insert_p999_ns", insertPercentile(insertTimes, CHURN_OPERATIONS, 0.999));
+            state.addMetric("insert_max_ns", insertPercentile(insertTimes, CHURN_OPERATIONS, 1.0));
+            state.addMetric("inserts_over_100us", (double)(insertTimes + CHURN_OPERATIONS - slowInserts));
+            state.addMetric("tombstone_ratio", stats.tombstoneRatio);
+            state.addMetric("average_probe_length", stats.averageProbeLength);
+            state.addMetric("in_place_rehashes", (double)stats.inPlaceRehashCount);
+
+            map.shutdown();
+            air_free(insertTimes, allocator);
+            air_free(live, allocator);
+        });
+    }
+
+    //Fills a map from empty, timing every insert on its own. With a full resize the inserts that double the table
+    //are the slowest by far, with groupsPerOperation > 0 the copying is spread over the inserts that follow.
+    static void benchmarkGrowth(BenchmarkRunner& runner, Allocator* allocator, const char* name, uint32_t groupsPerOperation)
+    {
+        runner.run("hash_map", name, [&](BenchmarkState& state)
+        {
+            int64_t* insertTimes = (int64_t*)air_alloca(sizeof(int64_t) * GROWTH_ENTRIES, allocator);
+
+            FlatHashMap<uint64_t, uint64_t> map;
+            map.init(allocator, 4);
+            map.setIncrementalResize(groupsPerOperation);
+
+            //Every 16th insert also looks up an older key, which has to be found in whichever table it's in.
+            uint64_t lookupsMissed = 0;
+            state.begin();
+            for (uint32_t i = 0; i < GROWTH_ENTRIES; ++i)
+            {
+                const uint64_t key = hashCalculate(i);
+                const int64_t start = timeNow();
+                map.insert(key, i);
+                insertTimes[i] = timeFrom(start);
+
+                if ((i & 15) == 0)
+                {
+                    const uint32_t older = i / 2;
+                    lookupsMissed += map.get(hashCalculate(older)) != older;
+                }
+            }
+            state.end();
+            state.operations = GROWTH_ENTRIES;
+
+            AIR_ASSERTM(lookupsMissed == 0, "%llu lookups during growth missed.", (unsigned long long)lookupsMissed);
+            AIR_ASSERTM(map.size == GROWTH_ENTRIES, "Grown map has %llu entries, expected %u.", (unsigned long long)map.size, GROWTH_ENTRIES);
+            for (uint32_t i = 0; i < GROWTH_ENTRIES; ++i)
+            {
+                AIR_ASSERTM(map.get(hashCalculate(i)) == i, "Grown map lost entry %u.", i);
+            }
+
+            const FlatHashMapStats stats = map.getStats();
+            const uint64_t bound = map.resizeSlotsPerOperationBound();
+            AIR_ASSERTM(groupsPerOperation == 0 || stats.resizeLargestStep <= bound,
+                        "An operation moved %llu slots, over the bound of %llu.", (unsigned long long)stats.resizeLargestStep, (unsigned long long)bound);
+
+            std::sort(insertTimes, insertTimes + GROWTH_ENTRIES);
+            const int64_t* slowInserts = std::upper_bound(insertTimes, insertTimes + GROWTH_ENTRIES, (int64_t)100);
+            state.addMetric("insert_p999_ns", insertPercentile(insertTimes, GROWTH_ENTRIES, 0.999));
+            state.addMetric("insert_p9999_ns", insertPercentile(insertTimes, GROWTH_ENTRIES, 0.9999));
+            state.addMetric("insert_max_ns", insertPercentile(insertTimes, GROWTH_ENTRIES, 1.0));
+            state.addMetric("inserts_over_100us", (double)(insertTimes + GROWTH_ENTRIES - slowInserts));
+            state.addMetric("slots_per_operation_bound", (double)bound);
+            state.addMetric("largest_step_slots", (double)stats.resizeLargestStep);
+            state.addMetric("grow_rehashes", (double)stats.growRehashCount);
+
+            map.shutdown();
+            air_free(insertTimes, allocator);
+        });
+    }
+
+    //Starting up from a saved asset catalogue either inserts every entry again or opens a blob of the table and
+    //queries it in place. The blob is copied to another buffer first, like reading or mapping it at a new address.
+    //Startup numbers are per catalogue entry so the two can be compared.
+    static void benchmarkBlob(BenchmarkRunner& runner, Allocator* allocator)
+    {
+        using Catalogue = FlatHashMap<uint64_t, uint64_t, HashMapIdentityHasher>;
+        using CatalogueView = FlatHashMapView<uint64_t, uint64_t, HashMapIdentityHasher>;
+
+        //Building and checking the blob is most of the cost, skip it when none of these would run.
+        if (runner.matches("hash_map", "blob/startup/rebuild") == false && runner.matches("hash_map", "blob/startup/open_view") == false &&
+            runner.matches("hash_map", "blob/lookup/map") == false && runner.matches("hash_map", "blob/lookup/view") == false)
+        {
+            return;
+        }
+
+        uint64_t* names = (uint64_t*)air_alloca(sizeof(uint64_t) * CATALOGUE_ENTRIES, allocator);
+        uint64_t* offsets = (uint64_t*)air_alloca(sizeof(uint64_t) * CATALOGUE_ENTRIES, allocator);
+        for (uint32_t i = 0; i < CATALOGUE_ENTRIES; ++i)
+        {
+            names[i] = hashCalculate((uint64_t)i);
+            offsets[i] = (uint64_t)i * 4096;
+        }
+
+        Catalogue catalogue;
+        catalogue.init(allocator, CATALOGUE_ENTRIES);
+        catalogue.setDefaultValue(UINT64_MAX);
+        catalogue.insertBatch(names, offsets, CATALOGUE_ENTRIES);
+
+        BlobSerialiser serialiser;
+        flatHashMapWriteBlob(serialiser, allocator, catalogue);
+        const uint32_t blobSize = serialiser.allocatedOffset;
+        char* loaded = (char*)air_allocaa(blobSize, allocator, alignof(uint64_t));
+        memoryCopy(loaded, serialiser.blobMemory, blobSize);
+        serialiser.shutdown();
+
+        CatalogueView view;
+        AIR_ASSERTM(view.init(loaded, blobSize - 1) == false, "A truncated hash map blob opened.");
+        AIR_ASSERTM(view.init(loaded, blobSize), "Catalogue blob didn't open.");
+
+        runner.run("hash_map", "blob/startup/rebuild", [&](BenchmarkState& state)
+        {
+            Catalogue rebuilt;
+            state.begin();
+            rebuilt.init(allocator, CATALOGUE_ENTRIES);
+            rebuilt.insertBatch(names, offsets, CATALOGUE_ENTRIES);
+            state.end();
+            state.operations = CATALOGUE_ENTRIES;
+
+            AIR_ASSERTM(rebuilt.size == CATALOGUE_ENTRIES, "Rebuilt catalogue has %llu entries.", (unsigned long long)rebuilt.size);
+            rebuilt.shutdown();
+        });
+
+        runner.run("hash_map", "blob/startup/open_view", [&](BenchmarkState& state)
+        {
+            state.begin();
+            const bool opened = view.init(loaded, blobSize);
+            state.end();
+            state.operations = CATALOGUE_ENTRIES;
+
+            AIR_ASSERTM(opened, "Catalogue blob didn't open.");
+            state.addMetric("blob_bytes", (double)blobSize);
+        });
+
+        uint64_t visited = 0;
+        for (FlatHashMapIterator it = view.iteratorBegin(); it.isValid(); view.iteratorAdvance(it))
+        {
+            const auto& keyValue = view.getStructure(it);
+            AIR_ASSERTM(catalogue.get(keyValue.key) == keyValue.value, "Catalogue blob has an entry the map doesn't.");
+            ++visited;
+        }
+        AIR_ASSERTM(visited == CATALOGUE_ENTRIES && view.size == CATALOGUE_ENTRIES, "Catalogue blob iterated %llu entries.", (unsigned long long)visited);
+
+        //The same random hits and misses through the map and the view.
+        const auto lookups = [&](const char* name, auto& map)
+        {
+            runner.run("hash_map", name, [&](BenchmarkState& state)
+            {
+                BenchmarkRandom random;
+                random.init(0xB10B);
+                uint64_t wrong = 0;
+
+                state.begin();
+                for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+                {
+                    const uint32_t index = random.range(CATALOGUE_ENTRIES);
+                    wrong += map.get(names[index]) != offsets[index];
+                    wrong += map.get(hashCalculate((uint64_t)index + CATALOGUE_ENTRIES)) != UINT64_MAX;
+                }
+                state.end();
+                state.operations = (uint64_t)LOOKUP_COUNT * 2;
+
+                AIR_ASSERTM(wrong == 0, "%s got %llu lookups wrong.", name, (unsigned long long)wrong);
+            });
+        };
+        lookups("blob/lookup/map", catalogue);
+        lookups("blob/lookup/view", view);
+
+        view.shutdown();
+        catalogue.shutdown();
+        air_free(loaded, allocator);
+        air_free(offsets, allocator);
+        air_free(names, allocator);
+    }
+
+    //Grows a map, empties most of it and checks shrinkToFit hands the memory back without losing anything.
+    static void benchmarkShrink(BenchmarkRunner& runner, Allocator* allocator)
+    {
+        runner.run("hash_map", "shrink_to_fit", [&](BenchmarkState& state)
+        {
+            FlatHashMap<uint64_t, uint64_t> map;
+            map.init(allocator, 4);
+            for (uint64_t i = 0; i < BATCH_KEY_COUNT; ++i)
+            {
+                map.insert(i, i);
+            }
+            for (uint64_t i = 0; i < BATCH_KEY_COUNT; ++i)
+            {
+                if (i % 16)
+                {
+                    map.remove(i);
+                }
+            }
+
+            const uint64_t bytesBefore = map.calculateSize(map.capacity);
+            state.begin();
+            map.shrinkToFit();
+            state.end();
+            state.operations = map.size;
+
+            const FlatHashMapStats stats = map.getStats();
+            AIR_ASSERTM(stats.tombstones == 0 && map.tombstones == 0, "shrinkToFit left %llu tombstones.", (unsigned long long)stats.tombstones);
+            AIR_ASSERTM(map.size == (BATCH_KEY_COUNT + 15) / 16, "shrinkToFit changed the size to %llu.", (unsigned long long)map.size);
+            for (uint64_t i = 0; i < BATCH_KEY_COUNT; ++i)
+            {
+                AIR_ASSERTM(map.find(i).isValid() == (i % 16 == 0), "shrinkToFit got key %llu wrong.", (unsigned long long)i);
+            }
+
+            state.addMetric("bytes_before", (double)bytesBefore);
+            state.addMetric("bytes_after", (double)map.calculateSize(map.capacity));
+            state.addMetric("load_factor", stats.loadFactor);
+            map.shutdown();
+        });
+    }
+
+    //FlatHashMap and std::unordered_map behind one interface for the comparison benchmarks.
+    template<typename Key, typename Hasher, typename Group>
+    struct CompareFlatMap
+    {
+        void init(Allocator* allocator)
+        {
+            map.init(allocator, 4);
+        }
+
+        void shutdown()
+        {
+            map.shutdown();
+        }
+
+        void insert(const Key& key, uint64_t value)
+        {
+            map.insert(key, value);
+        }
+
+        bool contains(const Key& key)
+        {
+            return map.find(key).isValid();
+        }
+
+        uint32_t erase(const Key& key)
+        {
+            return map.remove(key);
+        }
+
+        uint64_t sumValues()
+        {
+            uint64_t sum = 0;
+            for (FlatHashMapIterator it = map.iteratorBegin(); it.isValid(); map.iteratorAdvance(it))
+            {
+                sum += map.get(it);
+            }
+            return sum;
+        }
+
+        uint64_t count() const
+        {
+            return map.size;
+        }
+
+        void addStats(BenchmarkState& state)
+        {
+            const FlatHashMapStats stats = map.getStats();
+            state.addMetric("load_factor", stats.loadFactor);
+            state.addMetric("average_probe_length", stats.averageProbeLength);
+            state.addMetric("max_probe_length", (double)stats.maxProbeLength);
+            state.addMetric("tombstone_ratio", stats.tombstoneRatio);
+            state.addMetric("rehashes", (double)(stats.growRehashCount + stats.inPlaceRehashCount));
+        }
+
+        FlatHashMap<Key, uint64_t, Hasher, Group> map;
+    };
+
+    template<typename Key>
+    struct CompareStdMap
+    {
+        using StdKey = std::conditional_t<std::is_same_v<Key, StringView>, std::string_view, Key>;
+
+        static StdKey toStd(const Key& key)
+        {
+            if constexpr (std::is_same_v<Key, StringView>)
+            {
+                return std::string_view(key.text, key.length);
+            }
+            else
+            {
+                return key;
+            }
+        }
+
+        void init(Allocator* /*allocator*/)
+        {
+        }
+
+        //Swapping with an empty map is the only way to make std::unordered_map give back its buckets.
+        void shutdown()
+        {
+            std::unordered_map<StdKey, uint64_t>().swap(map);
+        }
+
+        void insert(const Key& key, uint64_t value)
+        {
+            map[toStd(key)] = value;
+        }
+
+        bool contains(const Key& key)
+        {
+            return map.find(toStd(key)) != map.end();
+        }
+
+        uint32_t erase(const Key& key)
+        {
+            return (uint32_t)map.erase(toStd(key));
+        }
+
+        uint64_t sumValues()
+        {
+            uint64_t sum = 0;
+            for (const auto& keyValue : map)
+            {
+                sum += keyValue.second;
+            }
+            return sum;
+        }
+
+        uint64_t count() const
+        {
+            return map.size();
+        }
+
+        void addStats(BenchmarkState& state)
+        {
+            state.addMetric("load_factor", map.load_factor());
+        }
+
+        std::unordered_map<StdKey, uint64_t> map;
+    };
+
+    static const char* const COMPARE_OPERATIONS[] = { "insert", "lookup_hit", "lookup_miss", "erase", "iterate" };
+
+    template<typename Key>
+    struct CompareKeys
+    {
+        const char* name;
+        const Key* keys;
+        const Key* misses;
+        uint32_t count;
+        //LOOKUP_COUNT indices into keys, in random order.
+        const uint32_t* order;
+    };
+
+    //Entry i maps to i + 1, so the sum of every value is known.
+    template<typename Map, typename Key>
+    static void benchmarkCompare(BenchmarkRunner& runner, Allocator* allocator, const char* mapName, const CompareKeys<Key>& keys)
+    {
+        char names[5][96];
+        for (uint32_t i = 0; i < 5; ++i)
+        {
+            snprintf(names[i], sizeof(names[i]), "compare/%s/%u/%s/%s", keys.name, keys.count, mapName, COMPARE_OPERATIONS[i]);
+        }
+
+        const uint64_t expectedSum = (uint64_t)keys.count * (keys.count + 1) / 2;
+        const auto fill = [&](Map& map)
+        {
+            for (uint32_t i = 0; i < keys.count; ++i)
+            {
+                map.insert(keys.keys[i], (uint64_t)i + 1);
+            }
+        };
+
+        //Starting from an empty map, so growing is part of the cost.
+        runner.run("hash_map", names[0], [&](BenchmarkState& state)
+        {
+            Map map;
+            map.init(allocator);
+            state.begin();
+            fill(map);
+            state.end();
+            AIR_ASSERTM(map.count() == keys.count, "%s has %llu of %u keys after inserting.", names[0], (unsigned long long)map.count(), keys.count);
+            state.operations = keys.count;
+            map.addStats(state);
+            map.shutdown();
+        });
+
+        Map filled;
+        filled.init(allocator);
+        if (runner.matches("hash_map", names[1]) || runner.matches("hash_map", names[2]) || runner.matches("hash_map", names[4]))
+        {
+            fill(filled);
+        }
+
+        runner.run("hash_map", names[1], [&](BenchmarkState& state)
+        {
+            uint64_t found = 0;
+            state.begin();
+            for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+            {
+                found += filled.contains(keys.keys[keys.order[i]]);
+            }
+            state.end();
+            AIR_ASSERTM(found == LOOKUP_COUNT, "%s found %llu of %u keys.", names[1], (unsigned long long)found, LOOKUP_COUNT);
+            state.operations = LOOKUP_COUNT;
+            filled.addStats(state);
+        });
+
+        runner.run("hash_map", names[2], [&](BenchmarkState& state)
+        {
+            uint64_t found = 0;
+            state.begin();
+            for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+            {
+                found += filled.contains(keys.misses[keys.order[i]]);
+            }
+            state.end();
+            AIR_ASSERTM(found == 0, "%s found %llu keys that were never inserted.", names[2], (unsigned long long)found);
+            state.operations = LOOKUP_COUNT;
+        });
+
+        runner.run("hash_map", names[4], [&](BenchmarkState& state)
+        {
+            state.begin();
+            const uint64_t sum = filled.sumValues();
+            state.end();
+            AIR_ASSERTM(sum == expectedSum, "%s summed to %llu, expected %llu.", names[4], (unsigned long long)sum, (unsigned long long)expectedSum);
+            state.operations = keys.count;
+        });
+
+        filled.shutdown();
+
+        //Every other key, so the table is left half full of tombstones for the stats.
+        runner.run("hash_map", names[3], [&](BenchmarkState& state)
+        {
+            Map map;
+            map.init(allocator);
+            fill(map);
+            uint64_t erased = 0;
+            state.begin();
+            for (uint32_t i = 0; i < keys.count; i += 2)
+            {
+                erased += map.erase(keys.keys[i]);
+            }
+            state.end();
+            AIR_ASSERTM(erased == (keys.count + 1) / 2, "%s erased %llu keys, expected %u.", names[3], (unsigned long long)erased, (keys.count + 1) / 2);
+            state.operations = erased;
+            map.addStats(state);
+            map.shutdown();
+        });
+    }
+
+    template<typename Key, typename Hasher>
+    static void benchmarkCompareMaps(BenchmarkRunner& runner, Allocator* allocator, const CompareKeys<Key>& keys)
+    {
+        benchmarkCompare<CompareStdMap<Key>>(runner, allocator, "std", keys);
+        forEachHashMapGroup([&](HashMapGroupKind kind, auto tag)
+        {
+            using Group = typename decltype(tag)::Type;
+            char mapName[32];
+            snprintf(mapName, sizeof(mapName), "flat_%s", hashMapGroupName(kind));
+            benchmarkCompare<CompareFlatMap<Key, Hasher, Group>>(runner, allocator, mapName, keys);
+        });
+    }
+
+    static bool compareAnyMatches(BenchmarkRunner& runner, const char* keyName, uint32_t count)
+    {
+        const char* const mapNames[] = { "std", "flat_portable8", "flat_sse2_16", "flat_avx2_32" };
+        char name[96];
+        for (const char* mapName : mapNames)
+        {
+            for (const char* operation : COMPARE_OPERATIONS)
+            {
+                snprintf(name, sizeof(name), "compare/%s/%u/%s/%s", keyName, count, mapName, operation);
+                if (runner.matches("hash_map", name))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    //Insert, hit, miss, erase and iterate for FlatHashMap at every group width against std::unordered_map, on
+    //integer ids, 64 bit hashes and strings from 1K to 10M entries. The FlatHashMap runs report getStats() too.
+    static void benchmarkCompareAll(BenchmarkRunner& runner, Allocator* allocator)
+    {
+        const uint32_t sizes[] = { 1000, 10000, 100000, 1000000, 10000000 };
+        //Ten million strings and the reference map's nodes for them don't fit in memory on every machine.
+        const uint32_t maxStringCount = 1000000;
+
+        for (uint32_t count : sizes)
+        {
+            const bool ints = compareAnyMatches(runner, "int", count);
+            const bool hashes = compareAnyMatches(runner, "hash64", count);
+            const bool strings = count <= maxStringCount && compareAnyMatches(runner, "string", count);
+            if ((ints || hashes || strings) == false)
+            {
+                continue;
+            }
+
+            uint32_t* order = (uint32_t*)air_alloca(sizeof(uint32_t) * LOOKUP_COUNT, allocator);
+            BenchmarkRandom random;
+            random.init(0xC0DE);
+            for (uint32_t i = 0; i < LOOKUP_COUNT; ++i)
+            {
+                order[i] = random.range(count);
+            }
+
+            if (ints)
+            {
+                uint32_t* keys = (uint32_t*)air_alloca(sizeof(uint32_t) * count * 2, allocator);
+                for (uint32_t i = 0; i < count * 2; ++i)
+                {
+                    keys[i] = i;
+                }
+
+                const CompareKeys<uint32_t> compareKeys = { "int", keys, keys + count, count, order };
+                benchmarkCompareMaps<uint32_t, HashMapHasher>(runner, allocator, compareKeys);
+                air_free(keys, allocator);
+            }
+
+            if (hashes)
+            {
+                uint64_t* keys = (uint64_t*)air_alloca(sizeof(uint64_t) * count * 2, allocator);
+                lookupKeysGenerate(LOOKUP_KEYS_RANDOM, keys, keys + count, count);
+
+                const CompareKeys<uint64_t> compareKeys = { "hash64", keys, keys + count, count, order };
+                benchmarkCompareMaps<uint64_t, HashMapIdentityHasher>(runner, allocator, compareKeys);
+                air_free(keys, allocator);
+            }
+
+            if (strings)
+            {
+                static constexpr uint32_t STRING_STRIDE = 24;
+                char* text = (char*)air_alloca((size_t)STRING_STRIDE * count * 2, allocator);
+                StringView* views = (StringView*)air_alloca(sizeof(StringView) * count * 2, allocator);
+                for (uint32_t i = 0; i < count * 2; ++i)
+                {
+                    char* name = text + (size_t)i * STRING_STRIDE;
+                    const int length = snprintf(name, STRING_STRIDE, i < count ? "entity/%u/name" : "entity/%u/lost", i % count);
+                    views[i] = { name, (size_t)length };
+                }
+
+                const CompareKeys<StringView> compareKeys = { "string", views, views + count, count, order };
+                benchmarkCompareMaps<StringView, HashMapHasher>(runner, allocator, compareKeys);
+                air_free(views, allocator);
+                air_free(text, allocator);
+            }
+
+            air_free(order, allocator);
+        }
+    }
+
+    void benchmarkHashMaps(BenchmarkRunner& runner)
+    {
+        MallocAllocator mallocAllocator;
+
+        //Correctness first, timings of a map that loses entries aren't worth anything.
+        forEachHashMapGroup([&](HashMapGroupKind kind, auto tag)
+        {
+            using Group = typename decltype(tag)::Type;
+            char name[96];
+
+            snprintf(name, sizeof(name), "differential/%s/dense_keys", hashMapGroupName(kind));
+            runner.run("hash_map", name, [&](BenchmarkState& state)
+            {
+                state.begin();
+                state.operations = differentialRun<HashMapHasher, Group>(&mallocAllocator, 0xD1FF, 2048);
+                state.end();
+            });
+
+            snprintf(name, sizeof(name), "differential/%s/sparse_keys", hashMapGroupName(kind));
+            runner.run("hash_map", name, [&](BenchmarkState& state)
+            {
+                state.begin();
+                state.operations = differentialRun<HashMapHasher, Group>(&mallocAllocator, 0x5EED, 1u << 30);
+                state.end();
+            });
+
+            snprintf(name, sizeof(name), "differential/%s/colliding_hashes", hashMapGroupName(kind));
+            runner.run("hash_map", name, [&](BenchmarkState& state)
+            {
+                state.begin();
+                state.operations = differentialRun<HashMapCollidingHasher, Group>(&mallocAllocator, 0xC011, 4096);
+                state.end();
+            });
+
+            //Colliding keys leave plenty of displaced entries for the compaction to move around.
+            snprintf(name, sizeof(name), "differential/%s/incremental_compaction", hashMapGroupName(kind));
+            runner.run("hash_map", name, [&](BenchmarkState& state)
+            {
+                state.begin();
+                state.operations = differentialRun<HashMapCollidingHasher, Group>(&mallocAllocator, 0xC0C0, 4096, 4);
+                state.operations += differentialRun<HashMapHasher, Group>(&mallocAllocator, 0xC0C1, 2048, 4);
+                state.end();
+            });
+
+            //One group per operation keeps resizes running for as long as possible, so most operations overlap one.
+            snprintf(name, sizeof(name), "differential/%s/incremental_resize", hashMapGroupName(kind));
+            runner.run("hash_map", name, [&](BenchmarkState& state)
+            {
+                state.begin();
+                state.operations = differentialRun<HashMapHasher, Group>(&mallocAllocator, 0x6E0, 2048, 0, 1);
+                state.operations += differentialRun<HashMapHasher, Group>(&mallocAllocator, 0x6E1, 1u << 30, 0, 1);
+                state.operations += differentialRun<HashMapCollidingHasher, Group>(&mallocAllocator, 0x6E2, 4096, 4, 1);
+                state.end();
+            });
+        });
+
+        runner.run("hash_map", "differential/string_views", [&](BenchmarkState& state)
+        {
+            state.begin();
+            state.operations = differentialStrings(&mallocAllocator);
+            state.end();
+        });
+
+        //Just under the 7/8 growth point of a 64K and a 1M slot table, where probes are longest. The first stays in
+        //cache, the second makes every probe a cache miss.
+        const uint32_t sizes[] = { 57000, 917000 };
+        forEachHashMapGroup([&](HashMapGroupKind kind, auto tag)
+        {
+            using Group = typename decltype(tag)::Type;
+            for (uint32_t size : sizes)
+            {
+                benchmarkLookups<HashMapHasher, Group>(runner, &mallocAllocator, kind, LOOKUP_KEYS_SEQUENTIAL, size);
+                benchmarkLookups<HashMapHasher, Group>(runner, &mallocAllocator, kind, LOOKUP_KEYS_RANDOM, size);
+                benchmarkLookups<HashMapIdentityHasher, Group>(runner, &mallocAllocator, kind, LOOKUP_KEYS_NAME_HASHES, size);
+            }
+        });
+
+        benchmarkBatchFind(runner, &mallocAllocator);
+        benchmarkBatchInsert(runner, &mallocAllocator);
+        benchmarkDedup(runner, &mallocAllocator);
+        benchmarkChurn(runner, &mallocAllocator, "churn/full_rehash", 0);
+        benchmarkChurn(runner, &mallocAllocator, "churn/incremental_8", 8);
+        benchmarkChurn(runner, &mallocAllocator, "churn/incremental_32", 32);
+        benchmarkGrowth(runner, &mallocAllocator, "grow/full_resize", 0);
+        benchmarkGrowth(runner, &mallocAllocator, "grow/incremental_1", 1);
+        benchmarkGrowth(runner, &mallocAllocator, "grow/incremental_4", 4);
+        benchmarkShrink(runner, &mallocAllocator);
+        benchmarkBlob(runner, &mallocAllocator);
+        benchmarkCompareAll(runner, &mallocAllocator);
+    }
+}
@@ -0,0 +1,336 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/Parallel.h"
+
+#include <vender/enkiTS/TaskScheduler.h>
+
+#include <algorithm>
+#include <string.h>
+#include <thread>
+
+namespace Air
+{
+    //What the timed runs sort, scan and reduce, about the size of a large scene's draw list.
+    static constexpr uint32_t PARALLEL_ELEMENTS = 1u << 20;
+    //The checks use a count and grain that don't divide, so the last chunk is always a short one.
+    static constexpr uint32_t PARALLEL_CHECK_ELEMENTS = 100003;
+    static constexpr uint32_t PARALLEL_CHECK_GRAIN_SIZE = 4093;
+    static constexpr uint32_t PARALLEL_CHECK_THREADS = 4;
+    static constexpr size_t PARALLEL_SCRATCH_SIZE = 32 * 1024 * 1024;
+    //Too small for any algorithm's temporaries, so all of them spill to the context allocator.
+    static constexpr size_t PARALLEL_TINY_SCRATCH_SIZE = 256;
+
+    //The key and where the item started, so a sort can be checked for stability as well as order.
+    struct ParallelSortItem
+    {
+        uint32_t key;
+        uint32_t index;
+    };
+
+    static bool parallelItemLess(const ParallelSortItem& a, const ParallelSortItem& b)
+    {
+        return a.key < b.key;
+    }
+
+    //x -> a * x + b. Composing these is associative but not commutative, so a reduce that combines its chunks out of
+    //order gets a different answer.
+    struct ParallelAffine
+    {
+        uint64_t a;
+        uint64_t b;
+    };
+
+    //first, then second.
+    static ParallelAffine parallelAffineThen(const ParallelAffine& first, const ParallelAffine& second)
+    {
+        return { second.a * first.a, second.a * first.b + second.b };
+    }
+
+    //Fills items with keys from makeKey and compares parallelRadixSort with std::stable_sort, index included.
+    template<typename MakeKey>
+    static uint64_t parallelCheckRadixSort(ParallelContext& context, ParallelSortItem* items, ParallelSortItem* reference, uint32_t count,
+                                           const char* keys, MakeKey makeKey)
+    {
+        BenchmarkRandom random;
+        random.init(0x5047);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            items[i] = { makeKey(random), i };
+            reference[i] = items[i];
+        }
+
+        parallelRadixSort(context, ArrayView<ParallelSortItem>(items, count), PARALLEL_CHECK_GRAIN_SIZE, [](const ParallelSortItem& item) { return item.key; });
+        std::stable_sort(reference, reference + count, parallelItemLess);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            AIR_ASSERTM(items[i].key == reference[i].key && items[i].index == reference[i].index,
+                        "Radix sort of %s keys differs from std::stable_sort at %u.", keys, i);
+        }
+        return count;
+    }
+
+    //Every algorithm against a serial reference on context. Returns the number of elements checked.
+    static uint64_t parallelCheck(ParallelContext& context, Allocator* allocator)
+    {
+        const uint32_t count = PARALLEL_CHECK_ELEMENTS;
+        ParallelSortItem* items = (ParallelSortItem*)air_alloca(sizeof(ParallelSortItem) * count, allocator);
+        ParallelSortItem* reference = (ParallelSortItem*)air_alloca(sizeof(ParallelSortItem) * count, allocator);
+        uint64_t* values = (uint64_t*)air_alloca(sizeof(uint64_t) * count, allocator);
+        uint64_t* scanned = (uint64_t*)air_alloca(sizeof(uint64_t) * count, allocator);
+        uint64_t* output = (uint64_t*)air_alloca(sizeof(uint64_t) * count, allocator);
+        int32_t* signedValues = (int32_t*)air_alloca(sizeof(int32_t) * count, allocator);
+        int32_t* signedReference = (int32_t*)air_alloca(sizeof(int32_t) * count, allocator);
+        uint8_t* visits = (uint8_t*)air_alloca(count, allocator);
+        uint64_t checks = 0;
+
+        //Few distinct keys so most of them are duplicates, then keys whose first and last bytes are all the same so
+        //those passes are skipped, then a single key so every pass is.
+        checks += parallelCheckRadixSort(context, items, reference, count, "duplicate", [](BenchmarkRandom& random) { return random.range(1000); });
+        checks += parallelCheckRadixSort(context, items, reference, count, "shared byte", [](BenchmarkRandom& random)
+        {
+            return 0xA500003Cu | (random.range(1u << 16) << 8);
+        });
+        checks += parallelCheckRadixSort(context, items, reference, count, "equal", [](BenchmarkRandom& /*random*/) { return 0x12345678u; });
+
+        //The integer overload flips the sign bit, so negatives have to end up first.
+        BenchmarkRandom random;
+        random.init(0x5047);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            signedValues[i] = (int32_t)random.next();
+            signedReference[i] = signedValues[i];
+        }
+        parallelSort(context, ArrayView<int32_t>(signedValues, count), PARALLEL_CHECK_GRAIN_SIZE);
+        std::sort(signedReference, signedReference + count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            AIR_ASSERTM(signedValues[i] == signedReference[i], "Signed radix sort differs from std::sort at %u.", i);
+        }
+        checks += count;
+
+        //Merge sort with lots of equal keys, the runs have to keep them in their original order across every merge.
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            items[i] = { random.range(64), i };
+            reference[i] = items[i];
+        }
+        parallelSort(context, ArrayView<ParallelSortItem>(items, count), PARALLEL_CHECK_GRAIN_SIZE, parallelItemLess);
+        std::stable_sort(reference, reference + count, parallelItemLess);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            AIR_ASSERTM(items[i].key == reference[i].key && items[i].index == reference[i].index, "Merge sort differs from std::stable_sort at %u.", i);
+        }
+        checks += count;
+
+        //Prefix sums, inclusive and exclusive, into another buffer and in place. The chunk offsets have to carry over
+        //every grain boundary.
+        for (uint32_t exclusive = 0; exclusive < 2; ++exclusive)
+        {
+            for (uint32_t inPlace = 0; inPlace < 2; ++inPlace)
+            {
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    values[i] = random.range(1000);
+                    scanned[i] = values[i];
+                }
+
+                uint64_t* result = inPlace ? scanned : output;
+                const uint64_t total = parallelPrefixSum(context, ArrayView<uint64_t>(scanned, count), ArrayView<uint64_t>(result, count),
+                                                         PARALLEL_CHECK_GRAIN_SIZE, exclusive != 0);
+                uint64_t running = 0;
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    const uint64_t expected = exclusive ? running : running + values[i];
+                    running += values[i];
+                    AIR_ASSERTM(result[i] == expected, "Prefix sum is wrong at %u (exclusive %u, in place %u).", i, exclusive, inPlace);
+                }
+                AIR_ASSERTM(total == running, "Prefix sum total is %llu, not %llu.", (unsigned long long)total, (unsigned long long)running);
+                checks += count;
+            }
+        }
+
+        //A plain sum and an order dependent composition, both against folding the whole array on this thread.
+        ParallelAffine expected = { 1, 0 };
+        uint64_t expectedSum = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            values[i] = random.next();
+            expected = parallelAffineThen(expected, { values[i] | 1, values[i] });
+            expectedSum += values[i];
+        }
+        const ArrayView<uint64_t> valueView(values, count);
+        const uint64_t sum = parallelReduce(context, valueView, PARALLEL_CHECK_GRAIN_SIZE, (uint64_t)0,
+                                            [](uint64_t result, uint64_t value) { return result + value; },
+                                            [](uint64_t a, uint64_t b) { return a + b; });
+        const ParallelAffine composed = parallelReduce(context, valueView, PARALLEL_CHECK_GRAIN_SIZE, ParallelAffine{ 1, 0 },
+                                                       [](const ParallelAffine& result, uint64_t value) { return parallelAffineThen(result, { value | 1, value }); },
+                                                       parallelAffineThen);
+        AIR_ASSERTM(sum == expectedSum, "Parallel reduce sum is wrong.");
+        AIR_ASSERTM(composed.a == expected.a && composed.b == expected.b, "Parallel reduce combined its chunks out of order.");
+        checks += (uint64_t)count * 2;
+
+        //Every index handed out exactly once, on a thread the context knows about.
+        memset(visits, 0, count);
+        std::atomic<uint32_t> badThreads{ 0 };
+        parallelFor(context, count, PARALLEL_CHECK_GRAIN_SIZE, [&](uint32_t start, uint32_t end, uint32_t threadIndex)
+        {
+            badThreads.fetch_add(threadIndex >= context.workerCount ? 1 : 0, std::memory_order_relaxed);
+            for (uint32_t i = start; i < end; ++i)
+            {
+                ++visits[i];
+            }
+        });
+        parallelFor(context, ArrayView<uint8_t>(visits, count), PARALLEL_CHECK_GRAIN_SIZE, [](uint8_t& visit) { visit += 2; });
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            AIR_ASSERTM(visits[i] == 3, "parallelFor visited index %u %u times.", i, visits[i]);
+        }
+        AIR_ASSERTM(badThreads.load() == 0, "parallelFor ran ranges on threads the context has no scratch for.");
+        checks += (uint64_t)count * 2;
+
+        air_free(visits, allocator);
+        air_free(signedReference, allocator);
+        air_free(signedValues, allocator);
+        air_free(output, allocator);
+        air_free(scanned, allocator);
+        air_free(values, allocator);
+        air_free(reference, allocator);
+        air_free(items, allocator);
+        return checks;
+    }
+
+    //Times the serial context and then the threaded one on the same input and reports how much faster threads were.
+    template<typename Prepare, typename Run>
+    static void benchmarkAgainstSerial(BenchmarkRunner& runner, const char* name, ParallelContext& serial, ParallelContext& threaded,
+                                       Prepare prepare, Run run)
+    {
+        runner.run("parallel", name, [&](BenchmarkState& state)
+        {
+            prepare();
+            const int64_t serialStart = timeNow();
+            run(serial);
+            const double serialMicroseconds = timeFromMicroseconds(serialStart);
+
+            prepare();
+            state.begin();
+            run(threaded);
+            state.end();
+            state.operations = PARALLEL_ELEMENTS;
+            state.threadCount = threaded.workerCount;
+
+            const double threadedMicroseconds = timeMicroseconds(state.elapsed);
+            state.addMetric("serial_ns_per_op", serialMicroseconds * 1000.0 / PARALLEL_ELEMENTS);
+            state.addMetric("speed_up", threadedMicroseconds > 0.0 ? serialMicroseconds / threadedMicroseconds : 0.0);
+        });
+    }
+
+    void benchmarkParallelAlgorithms(BenchmarkRunner& runner)
+    {
+        MallocAllocator mallocAllocator;
+
+        uint32_t maxThreads = std::thread::hardware_concurrency();
+        maxThreads = maxThreads == 0 ? 1 : (maxThreads > BENCHMARK_MAX_THREADS ? BENCHMARK_MAX_THREADS : maxThreads);
+
+        //No scheduler, so every algorithm runs inline. That is both a reference for the checks and the serial timing.
+        ParallelContext serial;
+        serial.init(nullptr, &mallocAllocator, PARALLEL_SCRATCH_SIZE);
+
+        //The checks get their own scheduler so the work is split across threads even on a machine with one core.
+        enki::TaskScheduler checkScheduler;
+        checkScheduler.Initialize(PARALLEL_CHECK_THREADS);
+        ParallelContext checked;
+        checked.init(&checkScheduler, &mallocAllocator, PARALLEL_SCRATCH_SIZE);
+        ParallelContext tiny;
+        tiny.init(&checkScheduler, &mallocAllocator, PARALLEL_TINY_SCRATCH_SIZE);
+
+        runner.run("parallel", "check", [&](BenchmarkState& state)
+        {
+            state.begin();
+            state.operations = parallelCheck(serial, &mallocAllocator) + parallelCheck(checked, &mallocAllocator);
+            state.end();
+            state.threadCount = checked.workerCount;
+        });
+
+        runner.run("parallel", "check/scratch_spill", [&](BenchmarkState& state)
+        {
+            {
+                ParallelScratch scratch(tiny);
+                const uint32_t* fits = scratch.allocateArray<uint32_t>(4);
+                AIR_ASSERTM(fits != nullptr && scratch.fallbackCount == 0, "A small scratch allocation didn't come from the arena.");
+                const uint32_t* spills = scratch.allocateArray<uint32_t>(PARALLEL_CHECK_ELEMENTS);
+                AIR_ASSERTM(spills != nullptr && scratch.fallbackCount == 1, "A scratch allocation bigger than the arena didn't spill.");
+            }
+            AIR_ASSERTM(tiny.workerScratch(tiny.currentThread())->allocatedSize == 0, "Scratch arena wasn't rewound.");
+
+            state.begin();
+            state.operations = parallelCheck(tiny, &mallocAllocator);
+            state.end();
+            state.threadCount = tiny.workerCount;
+        });
+
+        tiny.shutdown();
+        checked.shutdown();
+        checkScheduler.WaitforAllAndShutdown();
+
+        enki::TaskScheduler scheduler;
+        scheduler.Initialize(maxThreads);
+        ParallelContext threaded;
+        threaded.init(&scheduler, &mallocAllocator, PARALLEL_SCRATCH_SIZE);
+
+        ParallelSortItem* items = (ParallelSortItem*)air_alloca(sizeof(ParallelSortItem) * PARALLEL_ELEMENTS, &mallocAllocator);
+        uint64_t* values = (uint64_t*)air_alloca(sizeof(uint64_t) * PARALLEL_ELEMENTS, &mallocAllocator);
+        const ArrayView<ParallelSortItem> itemView(items, PARALLEL_ELEMENTS);
+        const ArrayView<uint64_t> valueView(values, PARALLEL_ELEMENTS);
+
+        const auto randomItems = [&]()
+        {
+            BenchmarkRandom random;
+            random.init(0x50A7);
+            for (uint32_t i = 0; i < PARALLEL_ELEMENTS; ++i)
+            {
+                items[i] = { (uint32_t)random.next(), i };
+            }
+        };
+        const auto randomValues = [&]()
+        {
+            BenchmarkRandom random;
+            random.init(0x50A7);
+            for (uint32_t i = 0; i < PARALLEL_ELEMENTS; ++i)
+            {
+                values[i] = random.range(1000);
+            }
+        };
+
+        benchmarkAgainstSerial(runner, "radix_sort", serial, threaded, randomItems, [&](ParallelContext& context)
+        {
+            parallelRadixSort(context, itemView, PARALLEL_DEFAULT_GRAIN_SIZE, [](const ParallelSortItem& item) { return item.key; });
+        });
+        benchmarkAgainstSerial(runner, "merge_sort", serial, threaded, randomItems, [&](ParallelContext& context)
+        {
+            parallelSort(context, itemView, PARALLEL_DEFAULT_GRAIN_SIZE, parallelItemLess);
+        });
+        benchmarkAgainstSerial(runner, "prefix_sum", serial, threaded, randomValues, [&](ParallelContext& context)
+        {
+            benchmarkDoNotOptimise(parallelPrefixSum(context, valueView, valueView, PARALLEL_DEFAULT_GRAIN_SIZE));
+        });
+        benchmarkAgainstSerial(runner, "reduce", serial, threaded, randomValues, [&](ParallelContext& context)
+        {
+            benchmarkDoNotOptimise(parallelReduce(context, valueView, PARALLEL_DEFAULT_GRAIN_SIZE, (uint64_t)0,
+                                                  [](uint64_t result, uint64_t value) { return result + value * value; },
+                                                  [](uint64_t a, uint64_t b) { return a + b; }));
+        });
+        benchmarkAgainstSerial(runner, "for", serial, threaded, randomValues, [&](ParallelContext& context)
+        {
+            parallelFor(context, valueView, PARALLEL_DEFAULT_GRAIN_SIZE, [](uint64_t& value) { value = value * 0x9E3779B97F4A7C15ull + 1; });
+        });
+
+        air_free(values, &mallocAllocator);
+        air_free(items, &mallocAllocator);
+
+        threaded.shutdown();
+        scheduler.WaitforAllAndShutdown();
+        serial.shutdown();
+    }
+}
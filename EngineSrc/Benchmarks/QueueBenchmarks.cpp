@@ -0,0 +1,154 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/ConcurrentQueue.h"
+
+#include <mutex>
+#include <stdio.h>
+
+namespace Air
+{
+    static constexpr uint32_t QUEUE_CAPACITY = 1024;
+    static constexpr uint32_t QUEUE_ITEMS_PER_PRODUCER = 200000;
+
+    struct QueueShape
+    {
+        uint32_t producers;
+        uint32_t consumers;
+    };
+
+    //The ad hoc hand-off the concurrent queues replace. Pops from the back so the baseline doesn't pay for keeping
+    //order, which only flatters it.
+    struct MutexArrayQueue
+    {
+        void init(Allocator* allocator, uint32_t capacity)
+        {
+            items.init(allocator, capacity);
+            this->capacity = capacity;
+        }
+
+        void shutdown()
+        {
+            items.shutdown();
+        }
+
+        bool push(uint64_t value)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (items.size >= capacity)
+            {
+                return false;
+            }
+
+            items.push(value);
+            return true;
+        }
+
+        bool pop(uint64_t& value)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (items.size == 0)
+            {
+                return false;
+            }
+
+            value = items.back();
+            items.pop();
+            return true;
+        }
+
+        Array<uint64_t> items;
+        uint32_t capacity = 0;
+        std::mutex mutex;
+    };
+
+    //Every producer pushes its own run of values and every consumer pops a fixed share of them, so there is no shared
+    //counter in the loop besides the queue itself. The sum of what was popped is checked against what was pushed.
+    template<typename Queue>
+    static void benchmarkQueue(BenchmarkRunner& runner, const char* queueName, Queue& queue, QueueShape shape)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "%s/%up%uc", queueName, shape.producers, shape.consumers);
+        runner.run("queue", name, [&](BenchmarkState& state)
+        {
+            const uint64_t total = (uint64_t)shape.producers * QUEUE_ITEMS_PER_PRODUCER;
+            std::atomic<uint64_t> poppedSum{ 0 };
+
+            benchmarkParallel(state, shape.producers + shape.consumers, [&](uint32_t threadIndex)
+            {
+                if (threadIndex < shape.producers)
+                {
+                    const uint64_t first = (uint64_t)threadIndex * QUEUE_ITEMS_PER_PRODUCER + 1;
+                    for (uint64_t value = first; value < first + QUEUE_ITEMS_PER_PRODUCER; ++value)
+                    {
+                        while (queue.push(value) == false)
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                    return;
+                }
+
+                const uint32_t consumer = threadIndex - shape.producers;
+                uint64_t share = total / shape.consumers;
+                if (consumer == 0)
+                {
+                    share += total % shape.consumers;
+                }
+
+                uint64_t sum = 0;
+                uint64_t value = 0;
+                for (uint64_t i = 0; i < share; ++i)
+                {
+                    while (queue.pop(value) == false)
+                    {
+                        std::this_thread::yield();
+                    }
+                    sum += value;
+                }
+                poppedSum.fetch_add(sum, std::memory_order_relaxed);
+            });
+
+            AIR_ASSERTM(poppedSum.load() == total * (total + 1) / 2, "Queue %s lost or duplicated values.", queueName);
+            state.operations = total;
+        });
+    }
+
+    void benchmarkQueues(BenchmarkRunner& runner)
+    {
+        uint32_t maxThreads = std::thread::hardware_concurrency();
+        maxThreads = maxThreads == 0 ? 1 : (maxThreads > BENCHMARK_MAX_THREADS ? BENCHMARK_MAX_THREADS : maxThreads);
+
+        MallocAllocator mallocAllocator;
+
+        MPMCQueue<uint64_t> mpmc;
+        mpmc.init(&mallocAllocator, QUEUE_CAPACITY);
+        SPSCQueue<uint64_t> spsc;
+        spsc.init(&mallocAllocator, QUEUE_CAPACITY);
+        MutexArrayQueue mutexArray;
+        mutexArray.init(&mallocAllocator, QUEUE_CAPACITY);
+
+        const QueueShape single = { 1, 1 };
+        benchmarkQueue(runner, "spsc", spsc, single);
+        benchmarkQueue(runner, "mpmc", mpmc, single);
+        benchmarkQueue(runner, "mutex_array", mutexArray, single);
+
+        //Even splits, then many producers feeding one consumer like loaders feeding the main thread.
+        const QueueShape shapes[] = { { 2, 2 }, { 4, 4 }, { 8, 8 }, { 3, 1 }, { 7, 1 }, { 15, 1 } };
+        for (const QueueShape& shape : shapes)
+        {
+            //Oversubscribed runs only measure the scheduler.
+            if (shape.producers + shape.consumers > maxThreads)
+            {
+                continue;
+            }
+
+            benchmarkQueue(runner, "mpmc", mpmc, shape);
+            benchmarkQueue(runner, "mutex_array", mutexArray, shape);
+        }
+
+        mutexArray.shutdown();
+        spsc.shutdown();
+        mpmc.shutdown();
+    }
+}
@@ -0,0 +1,477 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/DataStructures.h"
+#include "Foundation/Log.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+#if defined(_MSC_VER)
+    #include <excpt.h>
+#endif
+
+namespace Air
+{
+    //The checks run on their own threads, so they race even on a machine with one core.
+    static constexpr uint32_t RESOURCE_POOL_CHECK_THREADS = 4;
+    //Small pages so the checks cross a lot of page boundaries and grow while other threads obtain.
+    static constexpr uint32_t RESOURCE_POOL_CHECK_PER_PAGE = 32;
+    static constexpr uint32_t RESOURCE_POOL_CHECK_MAX_RESOURCES = 8192;
+    static constexpr uint32_t RESOURCE_POOL_CHECK_HELD = 64;
+    static constexpr uint32_t RESOURCE_POOL_CHECK_OPERATIONS = 50000;
+    static constexpr uint32_t RESOURCE_POOL_CHECK_GROWTH = 1024;
+    //Every thread tries to release all of these, only one release of each may go through.
+    static constexpr uint32_t RESOURCE_POOL_CHECK_DOUBLE_RELEASES = 8;
+    static constexpr uint32_t RESOURCE_POOL_CHECK_SIZE = 256;
+
+    static constexpr uint32_t RESOURCE_POOL_HELD = 256;
+    static constexpr uint32_t RESOURCE_POOL_OPERATIONS = 200000;
+
+    struct PoolCheckResource
+    {
+        uint32_t poolIndex;
+        //Written on obtain and read back before release, a slot handed out twice has the wrong one.
+        uint32_t handle;
+    };
+
+    //Releasing a stale handle asserts, which breaks into the debugger. The checks want to see the release refused, so
+    //the break is swallowed around the call.
+    template<typename Function>
+    static void resourcePoolExpectAssert(Function function)
+    {
+#if defined(_MSC_VER)
+        __try
+        {
+            function();
+        }
+        __except (GetExceptionCode() == 0x80000003 ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+        {
+        }
+#else
+        void (*previous)(int) = signal(SIGTRAP, SIG_IGN);
+        function();
+        signal(SIGTRAP, previous);
+#endif
+    }
+
+    //Sorts the indices of handles and asserts none is handed out twice.
+    static void resourcePoolCheckUnique(uint32_t* handles, uint32_t count, const char* check)
+    {
+        std::sort(handles, handles + count, [](uint32_t a, uint32_t b) { return resourceHandleIndex(a) < resourceHandleIndex(b); });
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            AIR_ASSERTM(resourceHandleIndex(handles[i - 1]) != resourceHandleIndex(handles[i]), "%s handed slot %u out twice.", check, resourceHandleIndex(handles[i]));
+        }
+    }
+
+    //Threads obtain and release at random. Each index has an owner that is swapped in on obtain and out before release,
+    //so two threads holding the same slot at once shows up as the wrong owner.
+    static uint64_t resourcePoolCheckConcurrent(BenchmarkState& state, Allocator* allocator)
+    {
+        PagedResourcePoolTyped<PoolCheckResource> pool;
+        pool.init(allocator, RESOURCE_POOL_CHECK_PER_PAGE, RESOURCE_POOL_CHECK_MAX_RESOURCES);
+
+        std::atomic<uint32_t>* owners = (std::atomic<uint32_t>*)air_alloca(sizeof(std::atomic<uint32_t>) * RESOURCE_POOL_CHECK_MAX_RESOURCES, allocator);
+        for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_MAX_RESOURCES; ++i)
+        {
+            new (&owners[i]) std::atomic<uint32_t>(0);
+        }
+        std::atomic<uint32_t> duplicates{ 0 };
+        std::atomic<uint32_t> corrupt{ 0 };
+
+        benchmarkParallel(state, RESOURCE_POOL_CHECK_THREADS, [&](uint32_t threadIndex)
+        {
+            uint32_t held[RESOURCE_POOL_CHECK_HELD];
+            uint32_t heldCount = 0;
+            BenchmarkRandom random;
+            random.init(0x9001 + threadIndex);
+
+            const auto release = [&](uint32_t slot)
+            {
+                const uint32_t handle = held[slot];
+                const PoolCheckResource* resource = pool.get(handle);
+                if (resource == nullptr || resource->handle != handle)
+                {
+                    corrupt.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (owners[resourceHandleIndex(handle)].exchange(0, std::memory_order_relaxed) != threadIndex + 1)
+                {
+                    duplicates.fetch_add(1, std::memory_order_relaxed);
+                }
+                pool.releaseResource(handle);
+                held[slot] = held[--heldCount];
+            };
+
+            for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_OPERATIONS; ++i)
+            {
+                if (heldCount == 0 || (heldCount < RESOURCE_POOL_CHECK_HELD && random.range(2) == 0))
+                {
+                    const uint32_t handle = pool.obtainResource();
+                    if (handle == RESOURCE_HANDLE_INVALID)
+                    {
+                        corrupt.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    if (owners[resourceHandleIndex(handle)].exchange(threadIndex + 1, std::memory_order_relaxed) != 0)
+                    {
+                        duplicates.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    pool.get(handle)->handle = handle;
+                    held[heldCount++] = handle;
+                }
+                else
+                {
+                    release(random.range(heldCount));
+                }
+            }
+
+            while (heldCount)
+            {
+                release(heldCount - 1);
+            }
+        });
+
+        AIR_ASSERTM(duplicates.load() == 0, "%u paged pool slots were held by two threads at once.", duplicates.load());
+        AIR_ASSERTM(corrupt.load() == 0, "%u paged pool resources didn't hold the handle they were obtained with.", corrupt.load());
+        AIR_ASSERTM(pool.liveCount.load() == 0, "Paged pool has %u live resources after everything was released.", pool.liveCount.load());
+        uint32_t visited = 0;
+        pool.forEachLive([&visited](uint32_t /*handle*/) { ++visited; });
+        AIR_ASSERTM(visited == 0, "Paged pool forEachLive found %u resources after everything was released.", visited);
+
+        air_free(owners, allocator);
+        pool.shutdown();
+        return (uint64_t)RESOURCE_POOL_CHECK_THREADS * RESOURCE_POOL_CHECK_OPERATIONS;
+    }
+
+    //Every thread obtains without releasing, so the pool grows page after page while the other threads obtain.
+    static uint64_t resourcePoolCheckGrowth(BenchmarkState& state, Allocator* allocator)
+    {
+        static constexpr uint32_t TOTAL = RESOURCE_POOL_CHECK_THREADS * RESOURCE_POOL_CHECK_GROWTH;
+
+        PagedResourcePoolTyped<PoolCheckResource> pool;
+        pool.init(allocator, RESOURCE_POOL_CHECK_PER_PAGE);
+
+        uint32_t* handles = (uint32_t*)air_alloca(sizeof(uint32_t) * TOTAL, allocator);
+        PoolCheckResource** resources = (PoolCheckResource**)air_alloca(sizeof(PoolCheckResource*) * TOTAL, allocator);
+
+        benchmarkParallel(state, RESOURCE_POOL_CHECK_THREADS, [&](uint32_t threadIndex)
+        {
+            for (uint32_t i = threadIndex * RESOURCE_POOL_CHECK_GROWTH; i < (threadIndex + 1) * RESOURCE_POOL_CHECK_GROWTH; ++i)
+            {
+                handles[i] = pool.obtainResource();
+                resources[i] = pool.get(handles[i]);
+                if (resources[i])
+                {
+                    resources[i]->handle = handles[i];
+                }
+            }
+        });
+
+        //Pages never move, so the pointers taken while the pool was still growing are still the resources.
+        for (uint32_t i = 0; i < TOTAL; ++i)
+        {
+            AIR_ASSERTM(resources[i] != nullptr && pool.get(handles[i]) == resources[i] && resources[i]->handle == handles[i],
+                        "Paged pool resource %u moved or was overwritten while the pool grew.", i);
+        }
+
+        const PagedResourcePoolStats stats = pool.stats();
+        AIR_ASSERTM(stats.liveCount == TOTAL && stats.peakLiveCount == TOTAL, "Paged pool counts %u live, %u peak, not %u.", stats.liveCount, stats.peakLiveCount, TOTAL);
+        AIR_ASSERTM(stats.pageCount == TOTAL / RESOURCE_POOL_CHECK_PER_PAGE, "Paged pool added %u pages for %u resources.", stats.pageCount, TOTAL);
+
+        for (uint32_t i = 0; i < TOTAL; ++i)
+        {
+            pool.releaseResource(handles[i]);
+        }
+        AIR_ASSERTM(pool.liveCount.load() == 0, "Paged pool has %u live resources after everything was released.", pool.liveCount.load());
+
+        resourcePoolCheckUnique(handles, TOTAL, "Growing paged pool");
+
+        air_free(resources, allocator);
+        air_free(handles, allocator);
+        pool.shutdown();
+        return TOTAL;
+    }
+
+    //A release of a handle that was already released has to be refused and leave the free list alone, also when
+    //several threads release the same handle at once.
+    static uint64_t resourcePoolCheckStaleRelease(BenchmarkState& state, Allocator* allocator)
+    {
+        PagedResourcePoolTyped<PoolCheckResource> pool;
+        pool.init(allocator, RESOURCE_POOL_CHECK_PER_PAGE);
+
+        aprint("Checking stale releases, the asserts about stale handles below are expected.\n");
+        const uint32_t stale = pool.obtainResource();
+        pool.releaseResource(stale);
+        resourcePoolExpectAssert([&]() { pool.releaseResource(stale); });
+        AIR_ASSERTM(pool.liveCount.load() == 0 && pool.isValid(stale) == false && pool.get(stale) == nullptr, "Paged pool accepted a double release.");
+
+        //The slot comes straight back with a new generation, the old handle mustn't release it.
+        const uint32_t reused = pool.obtainResource();
+        AIR_ASSERTM(resourceHandleIndex(reused) == resourceHandleIndex(stale) && reused != stale, "Paged pool didn't reuse the released slot.");
+        resourcePoolExpectAssert([&]() { pool.releaseResource(stale); });
+        AIR_ASSERTM(pool.isValid(reused) && pool.liveCount.load() == 1, "A stale handle released the slot's new resource.");
+        pool.releaseResource(reused);
+
+        uint32_t handles[RESOURCE_POOL_CHECK_DOUBLE_RELEASES];
+        for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_DOUBLE_RELEASES; ++i)
+        {
+            handles[i] = pool.obtainResource();
+        }
+        resourcePoolExpectAssert([&]()
+        {
+            benchmarkParallel(state, RESOURCE_POOL_CHECK_THREADS, [&](uint32_t threadIndex)
+            {
+                for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_DOUBLE_RELEASES; ++i)
+                {
+                    pool.releaseResource(handles[(i + threadIndex) % RESOURCE_POOL_CHECK_DOUBLE_RELEASES]);
+                }
+            });
+        });
+        AIR_ASSERTM(pool.liveCount.load() == 0, "Racing releases of the same handles left %u live.", pool.liveCount.load());
+
+        //A slot pushed on the free list twice would be handed out twice now.
+        for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_DOUBLE_RELEASES; ++i)
+        {
+            handles[i] = pool.obtainResource();
+        }
+        resourcePoolCheckUnique(handles, RESOURCE_POOL_CHECK_DOUBLE_RELEASES, "Paged pool after racing releases");
+        for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_DOUBLE_RELEASES; ++i)
+        {
+            pool.releaseResource(handles[i]);
+        }
+
+        pool.shutdown();
+        return (uint64_t)RESOURCE_POOL_CHECK_THREADS * RESOURCE_POOL_CHECK_DOUBLE_RELEASES + 4;
+    }
+
+    static uint64_t resourcePoolCheckFixed(Allocator* allocator)
+    {
+        uint64_t checks = 0;
+
+        //Stale handles resolve to nothing, also once the slot is live again.
+        ResourcePool pool;
+        pool.init(allocator, RESOURCE_POOL_CHECK_SIZE, sizeof(uint32_t));
+        const uint32_t stale = pool.obtainResource();
+        pool.releaseResource(stale);
+        AIR_ASSERTM(pool.accessResource(stale) == nullptr && pool.isValid(stale) == false, "Released resource pool handle still resolves.");
+        const uint32_t reused = pool.obtainResource();
+        AIR_ASSERTM(resourceHandleIndex(reused) == resourceHandleIndex(stale) && pool.accessResource(stale) == nullptr && pool.accessResource(reused) != nullptr,
+                    "Stale resource pool handle resolves to the slot's new resource.");
+        pool.releaseResource(reused);
+        checks += 2;
+
+        //Handed out in slot order, forEachLive has to visit exactly the live ones in that order.
+        uint32_t handles[RESOURCE_POOL_CHECK_SIZE];
+        bool live[RESOURCE_POOL_CHECK_SIZE];
+        for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_SIZE; ++i)
+        {
+            handles[i] = pool.obtainResource();
+            *(uint32_t*)pool.accessResource(handles[i]) = i;
+            live[i] = true;
+        }
+        BenchmarkRandom random;
+        random.init(0x9002);
+        uint32_t liveCount = RESOURCE_POOL_CHECK_SIZE;
+        for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_SIZE; ++i)
+        {
+            if (random.range(2))
+            {
+                pool.releaseResource(handles[i]);
+                live[i] = false;
+                --liveCount;
+            }
+        }
+        uint32_t visited = 0;
+        uint32_t previous = UINT32_MAX;
+        pool.forEachLive([&](uint32_t handle)
+        {
+            const uint32_t index = resourceHandleIndex(handle);
+            AIR_ASSERTM(previous == UINT32_MAX || index > previous, "Resource pool forEachLive visited %u after %u.", index, previous);
+            AIR_ASSERTM(live[index] && handle == handles[index] && *(const uint32_t*)pool.accessResource(handle) == index,
+                        "Resource pool forEachLive visited slot %u, which isn't live.", index);
+            previous = index;
+            ++visited;
+        });
+        AIR_ASSERTM(visited == liveCount, "Resource pool forEachLive visited %u of %u live resources.", visited, liveCount);
+        checks += RESOURCE_POOL_CHECK_SIZE;
+
+        pool.freeAllResources();
+        for (uint32_t i = 0; i < RESOURCE_POOL_CHECK_SIZE; ++i)
+        {
+            AIR_ASSERTM(pool.isValid(handles[i]) == false, "Resource pool handle %x survived freeAllResources.", handles[i]);
+        }
+        pool.shutdown();
+        checks += RESOURCE_POOL_CHECK_SIZE;
+
+        //One slot recycled over and over. The generation only wraps after RESOURCE_HANDLE_GENERATION_MASK + 1 releases,
+        //until then the first handle must not resolve.
+        pool.init(allocator, 1, sizeof(uint32_t));
+        const uint32_t first = pool.obtainResource();
+        pool.releaseResource(first);
+        for (uint32_t i = 1; i <= RESOURCE_HANDLE_GENERATION_MASK; ++i)
+        {
+            const uint32_t handle = pool.obtainResource();
+            AIR_ASSERTM(handle != first && pool.isValid(first) == false, "Resource pool generation wrapped after %u releases.", i);
+            pool.releaseResource(handle);
+        }
+        const uint32_t wrapped = pool.obtainResource();
+        AIR_ASSERTM(wrapped == first, "Resource pool generation didn't wrap after %u releases.", RESOURCE_HANDLE_GENERATION_MASK + 1);
+        pool.releaseResource(wrapped);
+        pool.shutdown();
+        checks += RESOURCE_HANDLE_GENERATION_MASK + 1;
+
+        return checks;
+    }
+
+    static uint64_t resourcePoolCheckSoA(Allocator* allocator)
+    {
+        ResourcePoolSoA<float, uint64_t, uint8_t> pool;
+        pool.init(allocator, RESOURCE_POOL_CHECK_SIZE - 3);
+
+        AIR_ASSERTM(((uintptr_t)pool.data<0>() | (uintptr_t)pool.data<1>() | (uintptr_t)pool.data<2>()) % RESOURCE_POOL_SOA_ALIGNMENT == 0,
+                    "SoA pool component arrays aren't aligned to %u bytes.", (uint32_t)RESOURCE_POOL_SOA_ALIGNMENT);
+
+        uint32_t handles[RESOURCE_POOL_CHECK_SIZE];
+        const uint32_t count = RESOURCE_POOL_CHECK_SIZE - 3;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            handles[i] = pool.obtainResource();
+            *pool.get<0>(handles[i]) = (float)i;
+            *pool.get<1>(handles[i]) = i * 0x9E3779B97F4A7C15ull;
+            *pool.get<2>(handles[i]) = (uint8_t)i;
+        }
+        for (uint32_t i = 0; i < count; i += 3)
+        {
+            pool.releaseResource(handles[i]);
+            AIR_ASSERTM(pool.get<0>(handles[i]) == nullptr && pool.get<1>(handles[i]) == nullptr && pool.get<2>(handles[i]) == nullptr,
+                        "SoA pool get on a released handle doesn't return null.");
+        }
+
+        //Reusing a slot mustn't bring the old handle back to life.
+        const uint32_t reused = pool.obtainResource();
+        const uint32_t reusedIndex = resourceHandleIndex(reused);
+        AIR_ASSERTM(reusedIndex % 3 == 0 && pool.get<1>(handles[reusedIndex]) == nullptr && pool.get<1>(reused) != nullptr,
+                    "SoA pool stale handle resolves to the slot's new components.");
+        *pool.get<1>(reused) = reusedIndex * 0x9E3779B97F4A7C15ull;
+        handles[reusedIndex] = reused;
+
+        uint32_t visited = 0;
+        uint32_t previous = UINT32_MAX;
+        pool.forEachLive([&](uint32_t index)
+        {
+            AIR_ASSERTM(previous == UINT32_MAX || index > previous, "SoA pool forEachLive visited %u after %u.", index, previous);
+            AIR_ASSERTM((index % 3 != 0 || index == reusedIndex) && pool.handleFromIndex(index) == handles[index], "SoA pool forEachLive visited slot %u, which isn't live.", index);
+            AIR_ASSERTM(pool.data<1>()[index] == index * 0x9E3779B97F4A7C15ull, "SoA pool component of slot %u was overwritten.", index);
+            previous = index;
+            ++visited;
+        });
+        const uint32_t liveCount = count - (count + 2) / 3 + 1;
+        AIR_ASSERTM(visited == liveCount, "SoA pool forEachLive visited %u of %u live resources.", visited, liveCount);
+
+        pool.freeAllResources();
+        pool.shutdown();
+        return (uint64_t)count * 2;
+    }
+
+    void benchmarkResourcePools(BenchmarkRunner& runner)
+    {
+        MallocAllocator mallocAllocator;
+
+        uint32_t maxThreads = std::thread::hardware_concurrency();
+        maxThreads = maxThreads == 0 ? 1 : (maxThreads > BENCHMARK_MAX_THREADS ? BENCHMARK_MAX_THREADS : maxThreads);
+
+        runner.run("resource_pool", "check/paged_concurrent", [&](BenchmarkState& state)
+        {
+            state.operations = resourcePoolCheckConcurrent(state, &mallocAllocator);
+        });
+        runner.run("resource_pool", "check/paged_growth", [&](BenchmarkState& state)
+        {
+            state.operations = resourcePoolCheckGrowth(state, &mallocAllocator);
+        });
+        runner.run("resource_pool", "check/paged_stale_release", [&](BenchmarkState& state)
+        {
+            state.operations = resourcePoolCheckStaleRelease(state, &mallocAllocator);
+        });
+        runner.run("resource_pool", "check/pool", [&](BenchmarkState& state)
+        {
+            state.begin();
+            state.operations = resourcePoolCheckFixed(&mallocAllocator);
+            state.end();
+        });
+        //The single threaded heap ignores the alignment it is asked for, the pool has to align the arrays itself.
+        runner.run("resource_pool", "check/soa", [&](BenchmarkState& state)
+        {
+            HeapAllocator heap;
+            heap.init(1024 * 1024, false);
+            state.begin();
+            state.operations = resourcePoolCheckSoA(&heap);
+            state.end();
+            heap.shutdown();
+        });
+
+        runner.run("resource_pool", "obtain_release/pool", [&](BenchmarkState& state)
+        {
+            ResourcePool pool;
+            pool.init(&mallocAllocator, RESOURCE_POOL_HELD, sizeof(PoolCheckResource));
+            uint32_t held[RESOURCE_POOL_HELD];
+            for (uint32_t i = 0; i < RESOURCE_POOL_HELD; ++i)
+            {
+                held[i] = pool.obtainResource();
+            }
+
+            BenchmarkRandom random;
+            random.init(0x9003);
+            state.begin();
+            for (uint32_t i = 0; i < RESOURCE_POOL_OPERATIONS; ++i)
+            {
+                const uint32_t slot = random.range(RESOURCE_POOL_HELD);
+                pool.releaseResource(held[slot]);
+                held[slot] = pool.obtainResource();
+            }
+            state.end();
+
+            pool.freeAllResources();
+            pool.shutdown();
+            state.operations = RESOURCE_POOL_OPERATIONS;
+        });
+
+        for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+        {
+            char name[96];
+            snprintf(name, sizeof(name), "obtain_release/paged/%u", threadCount);
+            runner.run("resource_pool", name, [&](BenchmarkState& state)
+            {
+                PagedResourcePool pool;
+                pool.init(&mallocAllocator, sizeof(PoolCheckResource));
+
+                benchmarkParallel(state, threadCount, [&](uint32_t threadIndex)
+                {
+                    uint32_t held[RESOURCE_POOL_HELD];
+                    for (uint32_t i = 0; i < RESOURCE_POOL_HELD; ++i)
+                    {
+                        held[i] = pool.obtainResource();
+                    }
+
+                    BenchmarkRandom random;
+                    random.init(0x9004 + threadIndex);
+                    for (uint32_t i = 0; i < RESOURCE_POOL_OPERATIONS; ++i)
+                    {
+                        const uint32_t slot = random.range(RESOURCE_POOL_HELD);
+                        pool.releaseResource(held[slot]);
+                        held[slot] = pool.obtainResource();
+                    }
+
+                    for (uint32_t i = 0; i < RESOURCE_POOL_HELD; ++i)
+                    {
+                        pool.releaseResource(held[i]);
+                    }
+                });
+
+                pool.shutdown();
+                state.operations = (uint64_t)threadCount * RESOURCE_POOL_OPERATIONS;
+            });
+        }
+    }
+}
@@ -0,0 +1,262 @@
+#include "Benchmark.h"
+
+#include "Foundation/Assert.h"
+#include "Foundation/HashMap.h"
+#include "Foundation/String.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string_view>
+
+namespace Air
+{
+    static constexpr uint32_t STRING_CORPUS_COUNT = 4096;
+    static constexpr uint32_t STRING_CORPUS_PASSES = 64;
+    //Longest string the correctness check builds, past a few AVX2 blocks.
+    static constexpr uint32_t STRING_CHECK_LENGTH = 160;
+
+    enum StringCorpusKind : uint8_t
+    {
+        //Shader inputs, material parameters and node names, around 8 to 32 characters.
+        STRING_CORPUS_IDENTIFIERS = 0,
+        //Asset paths as the importer sees them, around 40 to 110 characters.
+        STRING_CORPUS_PATHS,
+        STRING_CORPUS_COUNT_KINDS
+    };
+
+    static const char* stringCorpusName(StringCorpusKind kind)
+    {
+        return kind == STRING_CORPUS_IDENTIFIERS ? "identifiers" : "paths";
+    }
+
+    //Every string twice, in two buffers, so equals compares the same text at different addresses.
+    struct StringCorpus
+    {
+        void init(Allocator* allocator, StringCorpusKind kind)
+        {
+            this->allocator = allocator;
+            data = (char*)air_alloca(STRING_CORPUS_COUNT * 256, allocator);
+            copies = (char*)air_alloca(STRING_CORPUS_COUNT * 256, allocator);
+            views = (StringView*)air_alloca(sizeof(StringView) * STRING_CORPUS_COUNT, allocator);
+            copyViews = (StringView*)air_alloca(sizeof(StringView) * STRING_CORPUS_COUNT, allocator);
+
+            static const char* parts[] = { "albedo", "normal", "roughness", "metallic", "emissive", "occlusion", "knight",
+                                           "castle", "terrain", "foliage", "character", "environment", "u_model", "Texture" };
+            const uint32_t partCount = sizeof(parts) / sizeof(parts[0]);
+
+            BenchmarkRandom random;
+            random.init(0x57A1 + kind);
+            char* next = data;
+            char* nextCopy = copies;
+            for (uint32_t i = 0; i < STRING_CORPUS_COUNT; ++i)
+            {
+                int length = 0;
+                if (kind == STRING_CORPUS_IDENTIFIERS)
+                {
+                    length = snprintf(next, 64, "%s%s_%u", parts[random.range(partCount)], parts[random.range(partCount)], random.range(1000));
+                }
+                else
+                {
+                    length = snprintf(next, 200, "assets/%s/%s/%s/textures/%s_%s_%04u.png", parts[random.range(partCount)], parts[random.range(partCount)],
+                                      parts[random.range(partCount)], parts[random.range(partCount)], parts[random.range(partCount)], random.range(10000));
+                }
+
+                memcpy(nextCopy, next, (size_t)length + 1);
+                views[i] = { next, (size_t)length };
+                copyViews[i] = { nextCopy, (size_t)length };
+                //Odd steps so the strings start at every alignment.
+                next += length + 1 + (i % 3);
+                nextCopy += length + 1 + (i % 5);
+            }
+        }
+
+        void shutdown()
+        {
+            air_free(copyViews, allocator);
+            air_free(views, allocator);
+            air_free(copies, allocator);
+            air_free(data, allocator);
+        }
+
+        char* data = nullptr;
+        char* copies = nullptr;
+        StringView* views = nullptr;
+        StringView* copyViews = nullptr;
+        Allocator* allocator = nullptr;
+    };
+
+    //StringView::equals before it had SIMD paths.
+    static bool stringEqualsByteLoop(const StringView& rhs, const StringView& lhs)
+    {
+        if (rhs.length != lhs.length)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < rhs.length; ++i)
+        {
+            if (rhs.text[i] != lhs.text[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    //Every length and start alignment up to STRING_CHECK_LENGTH against the C library, including a difference in
+    //every position for equals and a match in every position for find.
+    static uint64_t stringCheck(Allocator* allocator)
+    {
+        char* a = (char*)air_alloca(STRING_CHECK_LENGTH + 64, allocator);
+        char* b = (char*)air_alloca(STRING_CHECK_LENGTH + 64, allocator);
+        uint64_t checks = 0;
+
+        for (uint32_t alignment = 0; alignment < 32; alignment += 7)
+        {
+            for (uint32_t length = 0; length <= STRING_CHECK_LENGTH; ++length)
+            {
+                char* text = a + alignment;
+                char* other = b + (alignment * 3) % 32;
+                for (uint32_t i = 0; i < length; ++i)
+                {
+                    text[i] = (char)('a' + (i * 7) % 26);
+                }
+                text[length] = 0;
+                memcpy(other, text, (size_t)length + 1);
+
+                const StringView view = { text, length };
+                const StringView otherView = { other, length };
+                AIR_ASSERTM(stringLength(text) == length, "stringLength is wrong for length %u.", length);
+                AIR_ASSERTM(StringView::equals(view, otherView), "equals failed on equal strings of length %u.", length);
+
+                size_t hashedLength = 0;
+                AIR_ASSERTM(stringHashAndLength(text, &hashedLength, 0x5EED) == hashBytes(text, length, 0x5EED) && hashedLength == length,
+                            "stringHashAndLength disagrees with hashBytes for length %u.", length);
+                checks += 3;
+
+                for (uint32_t i = 0; i < length; ++i)
+                {
+                    other[i] = '#';
+                    AIR_ASSERTM(StringView::equals(view, otherView) == false, "equals missed a difference at %u of %u.", i, length);
+                    AIR_ASSERTM(StringView::find(otherView, '#') == i, "find missed the character at %u of %u.", i, length);
+                    other[i] = text[i];
+                    checks += 2;
+                }
+                AIR_ASSERTM(StringView::find(view, '#') == StringView::NOT_FOUND, "find found a character that isn't there.");
+                ++checks;
+
+                //Patterns taken from every position, and one that only differs in the middle.
+                const std::string_view reference(text, length);
+                for (uint32_t patternLength = 1; patternLength <= 9 && patternLength <= length; patternLength += 4)
+                {
+                    for (uint32_t start = 0; start + patternLength <= length; start += 5)
+                    {
+                        const StringView pattern = { text + start, patternLength };
+                        AIR_ASSERTM(StringView::find(view, pattern) == reference.find(std::string_view(pattern.text, patternLength)),
+                                    "Substring find of %u characters at %u disagrees.", patternLength, start);
+                        ++checks;
+                    }
+                }
+
+                char missing[] = "axxxa";
+                const StringView missingView = { missing, 5 };
+                AIR_ASSERTM(StringView::find(view, missingView) == StringView::NOT_FOUND, "Substring find matched only the ends.");
+                ++checks;
+            }
+        }
+
+        air_free(b, allocator);
+        air_free(a, allocator);
+        return checks;
+    }
+
+    template<typename Function>
+    static void benchmarkStringCorpus(BenchmarkRunner& runner, StringCorpusKind kind, const char* operation, const char* variant,
+                                      Function function)
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "%s/%s/%s", operation, stringCorpusName(kind), variant);
+        runner.run("string", name, [&](BenchmarkState& state)
+        {
+            uint64_t result = 0;
+            state.begin();
+            for (uint32_t pass = 0; pass < STRING_CORPUS_PASSES; ++pass)
+            {
+                for (uint32_t i = 0; i < STRING_CORPUS_COUNT; ++i)
+                {
+                    result += function(i);
+                }
+            }
+            state.end();
+            state.operations = (uint64_t)STRING_CORPUS_PASSES * STRING_CORPUS_COUNT;
+            benchmarkDoNotOptimise(result);
+        });
+    }
+
+    void benchmarkStrings(BenchmarkRunner& runner)
+    {
+        MallocAllocator mallocAllocator;
+
+        runner.run("string", "check", [&](BenchmarkState& state)
+        {
+            state.begin();
+            state.operations = stringCheck(&mallocAllocator);
+            state.end();
+        });
+
+        for (uint32_t k = 0; k < STRING_CORPUS_COUNT_KINDS; ++k)
+        {
+            const StringCorpusKind kind = (StringCorpusKind)k;
+            StringCorpus corpus;
+            corpus.init(&mallocAllocator, kind);
+            const StringView* views = corpus.views;
+            const StringView* copies = corpus.copyViews;
+
+            //Equal strings at different addresses, the case a hash map hit has to confirm.
+            benchmarkStringCorpus(runner, kind, "equals", "byte_loop", [&](uint32_t i) { return (uint64_t)stringEqualsByteLoop(views[i], copies[i]); });
+            benchmarkStringCorpus(runner, kind, "equals", "memcmp", [&](uint32_t i)
+            {
+                return (uint64_t)(views[i].length == copies[i].length && memcmp(views[i].text, copies[i].text, views[i].length) == 0);
+            });
+            benchmarkStringCorpus(runner, kind, "equals", "simd", [&](uint32_t i) { return (uint64_t)StringView::equals(views[i], copies[i]); });
+
+            benchmarkStringCorpus(runner, kind, "length", "strlen", [&](uint32_t i) { return (uint64_t)strlen(views[i].text); });
+            benchmarkStringCorpus(runner, kind, "length", "simd", [&](uint32_t i) { return (uint64_t)stringLength(views[i].text); });
+
+            //The last character, so the whole string is scanned.
+            benchmarkStringCorpus(runner, kind, "find_char", "memchr", [&](uint32_t i)
+            {
+                const char* found = (const char*)memchr(views[i].text, views[i].text[views[i].length - 1], views[i].length);
+                return (uint64_t)(found - views[i].text);
+            });
+            benchmarkStringCorpus(runner, kind, "find_char", "simd", [&](uint32_t i)
+            {
+                return (uint64_t)StringView::find(views[i], views[i].text[views[i].length - 1]);
+            });
+
+            //Looks for a part name the way the importer matches texture roles.
+            char patternText[] = "roughness";
+            const StringView pattern = { patternText, sizeof(patternText) - 1 };
+            benchmarkStringCorpus(runner, kind, "find_substring", "string_view", [&](uint32_t i)
+            {
+                return (uint64_t)std::string_view(views[i].text, views[i].length).find(std::string_view(pattern.text, pattern.length));
+            });
+            benchmarkStringCorpus(runner, kind, "find_substring", "simd", [&](uint32_t i) { return (uint64_t)StringView::find(views[i], pattern); });
+
+            //What StringArray::intern does. The SIMD length doesn't beat libc strlen here, so it isn't used.
+            benchmarkStringCorpus(runner, kind, "length_and_hash", "strlen_then_hash", [&](uint32_t i)
+            {
+                const size_t length = strlen(views[i].text);
+                return hashBytes(views[i].text, length, 0xF2EA4FFAD) + length;
+            });
+            benchmarkStringCorpus(runner, kind, "length_and_hash", "simd_length_then_hash", [&](uint32_t i)
+            {
+                const size_t length = stringLength(views[i].text);
+                return hashBytes(views[i].text, length, 0xF2EA4FFAD) + length;
+            });
+
+            corpus.shutdown();
+        }
+    }
+}
@@ -4,57 +4,73 @@
 #include "Memory.h"
 #include "Assert.h"
 
-namespace Air 
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Air
 {
-    //AlignedArray
-    template<typename T>
-    struct Array 
+    //Element management shared by Array and SmallArray. Non-trivial types are constructed, moved and destroyed
+    //properly, trivially copyable types keep the raw memory fast paths and can grow in place through
+    //Allocator::reallocate. Storage only has to say whether data came from the allocator, see ownsData.
+    template<typename T, typename Storage>
+    struct ArrayBase
     {
-        Array() = default;
-        ~Array() = default;
+        static constexpr bool TRIVIAL = std::is_trivially_copyable_v<T>;
 
-        void init(Allocator* alloc, uint32_t initalCapacity, uint32_t initialSize = 0)
+        void push(const T& element)
         {
-            data = nullptr;
-            size = initialSize;
-            capacity = 0;
-            allocator = alloc;
-
-            if (initalCapacity > 0)
+            if (size >= capacity)
             {
-                grow(initalCapacity);
+                //element may live in the buffer grow is about to free.
+                T copy(element);
+                grow(capacity + 1);
+                new (data + size++) T(std::move(copy));
+                return;
             }
+
+            new (data + size++) T(element);
         }
 
-        void shutdown()
+        void push(T&& element)
         {
-            if (capacity > 0)
+            if (size >= capacity)
             {
-                allocator->deallocate(data);
+                T moved(std::move(element));
+                grow(capacity + 1);
+                new (data + size++) T(std::move(moved));
+                return;
             }
 
-            data = nullptr;
-            size = 0;
-            capacity = 0;
+            new (data + size++) T(std::move(element));
         }
 
-        void push(const T& element)
+        template<typename... Arguments>
+        T& emplace_back(Arguments&&... arguments)
         {
             if (size >= capacity)
             {
+                //Same as push, the arguments may refer into the buffer grow is about to free.
+                T constructed(static_cast<Arguments&&>(arguments)...);
                 grow(capacity + 1);
+                return *new (data + size++) T(std::move(constructed));
             }
 
-            data[size++] = element;
+            return *new (data + size++) T(static_cast<Arguments&&>(arguments)...);
         }
 
-        //Grow the size and return T to be filled.
+        //Grow the size and return T to be filled. Trivial types are left uninitialised.
         T& push_use()
         {
             if (size >= capacity)
             {
                 grow(capacity + 1);
             }
+
+            if constexpr (TRIVIAL == false)
+            {
+                new (data + size) T();
+            }
             ++size;
 
             return back();
@@ -64,12 +80,18 @@ namespace Air
         {
             AIR_ASSERT(size > 0);
             --size;
+            destroyRange(size, size + 1);
         }
 
         void deleteSwap(uint32_t index)
         {
             AIR_ASSERT(size > 0 && index < size);
-            data[index] = data[--size];
+            --size;
+            if (index != size)
+            {
+                data[index] = std::move(data[size]);
+            }
+            destroyRange(size, size + 1);
         }
 
         T& operator[](uint32_t index)
@@ -86,6 +108,7 @@ namespace Air
 
         void clear()
         {
+            destroyRange(0, size);
             size = 0;
         }
 
@@ -95,6 +118,16 @@ namespace Air
             {
                 grow(newSize);
             }
+
+            if constexpr (TRIVIAL == false)
+            {
+                for (uint32_t i = size; i < newSize; ++i)
+                {
+                    new (data + i) T();
+                }
+            }
+            destroyRange(newSize, size);
+
             size = newSize;
         }
 
@@ -117,12 +150,42 @@ namespace Air
                 newCapacity = 4;
             }
 
-            T* newData = (T*)allocator->allocate(newCapacity * sizeof(T), alignof(T));
-            if (capacity)
+            //Memory the allocator didn't hand out can only be left behind.
+            const bool owned = static_cast<const Storage*>(this)->ownsData();
+
+            //Nothing moves, so this is fine for any type.
+            if (owned && allocator->resizeInPlace(data, capacity * sizeof(T), newCapacity * sizeof(T)))
             {
-                memoryCopy(newData, data, capacity * sizeof(T));
+                capacity = newCapacity;
+                return;
+            }
 
-                allocator->deallocate(data);
+            //On failure data and capacity are left as they were, the elements are still there.
+            T* newData = nullptr;
+            if (owned && TRIVIAL)
+            {
+                //Only the live elements have to survive the move.
+                newData = (T*)allocator->reallocate(data, size * sizeof(T), newCapacity * sizeof(T), alignof(T));
+                AIR_ASSERTM(newData != nullptr, "Array couldn't grow to %u elements.", newCapacity);
+                if (newData == nullptr)
+                {
+                    return;
+                }
+            }
+            else
+            {
+                newData = (T*)allocator->allocate(newCapacity * sizeof(T), alignof(T));
+                AIR_ASSERTM(newData != nullptr, "Array couldn't grow to %u elements.", newCapacity);
+                if (newData == nullptr)
+                {
+                    return;
+                }
+
+                relocate(newData);
+                if (owned)
+                {
+                    allocator->deallocate(data);
+                }
             }
 
             data = newData;
@@ -163,14 +226,97 @@ namespace Air
             return capacity * sizeof(T);
         }
 
+        //Moves the live elements to newData and destroys the originals.
+        void relocate(T* newData)
+        {
+            if constexpr (TRIVIAL)
+            {
+                if (size > 0)
+                {
+                    memoryCopy(newData, data, size * sizeof(T));
+                }
+            }
+            else
+            {
+                for (uint32_t i = 0; i < size; ++i)
+                {
+                    new (newData + i) T(std::move(data[i]));
+                    data[i].~T();
+                }
+            }
+        }
+
+        void destroyRange(uint32_t first, uint32_t last)
+        {
+            if constexpr (std::is_trivially_destructible_v<T> == false)
+            {
+                for (uint32_t i = first; i < last; ++i)
+                {
+                    data[i].~T();
+                }
+            }
+        }
+
+        //Destroys the elements and hands data back to the allocator if it came from there.
+        void release()
+        {
+            destroyRange(0, size);
+            if (static_cast<const Storage*>(this)->ownsData())
+            {
+                allocator->deallocate(data);
+            }
+            size = 0;
+        }
+
         T* data;
         uint32_t size;
         uint32_t capacity;
         Allocator* allocator;
     };
 
+    //Growable array over an Allocator.
     template<typename T>
-    struct ArrayView 
+    struct Array : public ArrayBase<T, Array<T>>
+    {
+        using Base = ArrayBase<T, Array<T>>;
+        using Base::data;
+        using Base::size;
+        using Base::capacity;
+        using Base::allocator;
+
+        Array() = default;
+        ~Array() = default;
+
+        void init(Allocator* alloc, uint32_t initalCapacity, uint32_t initialSize = 0)
+        {
+            data = nullptr;
+            size = 0;
+            capacity = 0;
+            allocator = alloc;
+
+            if (initalCapacity > 0)
+            {
+                this->grow(initalCapacity);
+            }
+
+            this->setSize(initialSize);
+        }
+
+        void shutdown()
+        {
+            this->release();
+            data = nullptr;
+            capacity = 0;
+        }
+
+        bool ownsData() const
+        {
+            return capacity > 0;
+        }
+    };
+
+    template<typename T>
+    struct ArrayView
     {
         ArrayView(T* d, uint32_t size) : data(d), size(size)
         {
@@ -197,6 +343,78 @@ namespace Air
         T* data;
         uint32_t size;
     };
+
+    //Array that keeps its first N elements inside the object and only goes to the allocator once it holds more.
+    //Same interface as Array. data points into the object itself, so it can't be copied or moved.
+    template<typename T, uint32_t N>
+    struct SmallArray : public ArrayBase<T, SmallArray<T, N>>
+    {
+        static_assert(N > 0, "Use Array when there is no inline storage.");
+
+        using Base = ArrayBase<T, SmallArray<T, N>>;
+        using Base::data;
+        using Base::size;
+        using Base::capacity;
+        using Base::allocator;
+
+        SmallArray() = default;
+        ~SmallArray() = default;
+
+        SmallArray(const SmallArray&) = delete;
+        SmallArray& operator=(const SmallArray&) = delete;
+
+        //alloc is only used once the array outgrows its inline storage.
+        void init(Allocator* alloc, uint32_t initalCapacity = 0, uint32_t initialSize = 0)
+        {
+            data = inlineData();
+            size = 0;
+            capacity = N;
+            allocator = alloc;
+
+            if (initalCapacity > N)
+            {
+                this->grow(initalCapacity);
+            }
+
+            this->setSize(initialSize);
+        }
+
+        void shutdown()
+        {
+            this->release();
+            data = inlineData();
+            capacity = N;
+        }
+
+        bool isInline() const
+        {
+            return data == (const T*)inlineStorage;
+        }
+
+        //The inline storage is never handed to the allocator, spilling out of it is always a move.
+        bool ownsData() const
+        {
+            return isInline() == false;
+        }
+
+        //No copy, the view points at the live elements wherever they are.
+        ArrayView<T> view()
+        {
+            return ArrayView<T>(data, size);
+        }
+
+        operator ArrayView<T>()
+        {
+            return view();
+        }
+
+        T* inlineData()
+        {
+            return (T*)inlineStorage;
+        }
+
+        alignas(T) uint8_t inlineStorage[N * sizeof(T)];
+    };
 }
 
 #endif // !ARRAY_HDR
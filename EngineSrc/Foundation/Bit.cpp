@@ -16,7 +16,16 @@ namespace Air
 #if defined(_MSC_VER)
         return _lzcnt_u32(x);
 #else
-        return __builtin_ctz(x);
+        return x ? __builtin_clz(x) : 32;
+#endif
+    }
+
+    uint32_t leadingZerosU64(uint64_t x)
+    {
+#if defined(_MSC_VER)
+        return static_cast<uint32_t>(_lzcnt_u64(x));
+#else
+        return x ? __builtin_clzll(x) : 64;
 #endif
     }
 
@@ -38,16 +47,16 @@ namespace Air
 #if defined(_MSC_VER)
         return _tzcnt_u32(x);
 #else
-        return __builtin_clz(x);
+        return x ? __builtin_ctz(x) : 32;
 #endif
     }
 
-    uint64_t trailingZerosU64(uint32_t x) 
+    uint64_t trailingZerosU64(uint64_t x) 
     {
 #if defined(_MSC_VER)
         return _tzcnt_u64(x);
 #else
-        return __builtin_ctzl(x);
+        return x ? __builtin_ctzll(x) : 64;
 #endif
     }
 
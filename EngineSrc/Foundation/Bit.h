@@ -13,11 +13,12 @@ namespace Air
     static uint32_t bitSlot8(uint32_t bit) { return bit / 8; }
 
     uint32_t leadingZerosU32(uint32_t x);
+    uint32_t leadingZerosU64(uint64_t x);
 #if defined(_MSC_VER)
     uint32_t loadZerosU32msvc(uint32_t x);
 #endif
     uint32_t trailingZerosU32(uint32_t x);
-    uint64_t trailingZerosU64(uint32_t x);
+    uint64_t trailingZerosU64(uint64_t x);
 
     uint32_t roundToPowerOf2(uint32_t value);
 
@@ -62,12 +63,12 @@ namespace Air
             //Example: _mask = 256
             //that's 8 zero then we bit shift by 3 making it 1 when we are in byte mode.
             //If we aren't in byte mode it's just 8.
-            return trailingZerosU32(_mask) >> Shift;
+            return countTrailing(_mask) >> Shift;
         }
 
         uint32_t highestBitSet() const 
         {
-            return leadingZerosU32(_mask) >> Shift;
+            return (sizeof(T) * 8 - 1 - countLeading(_mask)) >> Shift;
         }
 
         BitMask begin() const 
@@ -82,14 +83,40 @@ namespace Air
 
         uint32_t trailingZeros() const 
         {
-            return trailingZerosU32(_mask);
+            return countTrailing(_mask) >> Shift;
         }
 
+        //Only counts within the significant bits, the unused top of T doesn't count as zeros.
         uint32_t leadingZeros() const 
         {
-            return leadingZerosU32(_mask);
+            constexpr int extraBits = sizeof(T) * 8 - (SignificantBits << Shift);
+            return countLeading(static_cast<T>(_mask << extraBits)) >> Shift;
         }
     private:
+        static uint32_t countTrailing(T mask)
+        {
+            if constexpr (sizeof(T) == 8)
+            {
+                return static_cast<uint32_t>(trailingZerosU64(mask));
+            }
+            else
+            {
+                return trailingZerosU32(mask);
+            }
+        }
+
+        static uint32_t countLeading(T mask)
+        {
+            if constexpr (sizeof(T) == 8)
+            {
+                return leadingZerosU64(mask);
+            }
+            else
+            {
+                return leadingZerosU32(mask);
+            }
+        }
+
         friend bool operator==(const BitMask& a, const BitMask& b) 
         {
             return (a._mask == b._mask);
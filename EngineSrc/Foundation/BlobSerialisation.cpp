@@ -9,8 +9,9 @@ namespace Air
     void BlobSerialiser::writeCommon(Allocator* alloc, uint32_t serialiserVersion, size_t size) 
     {
         allocator = alloc;
-        //Allocate memory.
-        blobMemory = (char*)air_alloca(size + sizeof(BlobHeader), allocator);
+        //Allocate memory. Aligned for the widest member a root structure can have, blobs that are read in place
+        //use the start of the blob to align what is in it.
+        blobMemory = (char*)air_allocaa(size + sizeof(BlobHeader), allocator, alignof(uint64_t));
         AIR_ASSERT(blobMemory != nullptr);
 
         hasAllocatedMemory = 1;
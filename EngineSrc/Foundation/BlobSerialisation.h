@@ -20,7 +20,7 @@ namespace Air
             writeCommon(alloc, serialiserVersion, size);
 
             //Allocate root data. BlobHeader is already allocated in the writeCommon function.
-            allocate_static(sizeof(T) - sizeof(BlobHeader));
+            allocateStatic(sizeof(T) - sizeof(BlobHeader));
 
             //Manually managed blob serilisation.
             dataMemory = nullptr;
@@ -36,7 +36,7 @@ namespace Air
             writeCommon(alloc, serialiserVersion, size);
 
             //Allocate root data. BlobHeader is already allocated in the writeCommon function.
-            allocate_static(sizeof(T) - sizeof(BlobHeader));
+            allocateStatic(sizeof(T) - sizeof(BlobHeader));
 
             //Save root data memory offset calculation
             dataMemory = (char*)rootData;
@@ -0,0 +1,54 @@
+#include "ConcurrentHashMap.h"
+
+#include <thread>
+
+namespace Air
+{
+    static std::atomic<uint32_t> NEXT_READER_STRIPE{ 0 };
+
+    //Threads take stripes in turn, so up to SNAPSHOT_READER_STRIPES readers never share a counter.
+    static uint32_t readerStripe()
+    {
+        static thread_local const uint32_t stripe = NEXT_READER_STRIPE.fetch_add(1, std::memory_order_relaxed) % SNAPSHOT_READER_STRIPES;
+        return stripe;
+    }
+
+    uint32_t SnapshotReaders::enter()
+    {
+        const uint32_t stripe = readerStripe();
+        for (;;)
+        {
+            const uint64_t current = epoch.load(std::memory_order_seq_cst);
+            const uint32_t parity = (uint32_t)(current & 1);
+            stripes[stripe].active[parity].fetch_add(1, std::memory_order_seq_cst);
+
+            //If a writer moved the epoch on in between, it may already have looked at this counter and missed us.
+            if (epoch.load(std::memory_order_seq_cst) == current)
+            {
+                return stripe * 2 + parity;
+            }
+
+            stripes[stripe].active[parity].fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void SnapshotReaders::leave(uint32_t token)
+    {
+        stripes[token >> 1].active[token & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+    void SnapshotReaders::synchronise()
+    {
+        //Readers that enter from here on see the new epoch, and with it whatever was published before the call.
+        const uint64_t previous = epoch.fetch_add(1, std::memory_order_seq_cst);
+        const uint32_t parity = (uint32_t)(previous & 1);
+
+        for (uint32_t i = 0; i < SNAPSHOT_READER_STRIPES; ++i)
+        {
+            while (stripes[i].active[parity].load(std::memory_order_acquire) != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#ifndef CONCURRENT_HASH_MAP_HDR
+#define CONCURRENT_HASH_MAP_HDR
+
+#include "Platform.h"
+#include "Memory.h"
+#include "Assert.h"
+#include "HashMap.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace Air
+{
+    static constexpr uint32_t CONCURRENT_HASH_MAP_CACHE_LINE = 64;
+    //Readers are spread over this many counters so they don't all write to the same cache line.
+    static constexpr uint32_t SNAPSHOT_READER_STRIPES = 64;
+
+    //Tells a writer when every reader that could still be looking at an old table is done with it.
+    //Readers bump a counter for the current epoch on their own stripe, synchronise() moves the epoch on and waits
+    //for the old epoch's counters to drain. Readers never wait on writers.
+    struct SnapshotReaders
+    {
+        struct alignas(CONCURRENT_HASH_MAP_CACHE_LINE) Stripe
+        {
+            //One counter per epoch parity.
+            std::atomic<uint32_t> active[2] = { 0, 0 };
+        };
+
+        //Returns the token to hand to leave().
+        uint32_t enter();
+        void leave(uint32_t token);
+
+        //Only one thread may call this at a time. Anything published before the call is safe to free after it.
+        void synchronise();
+
+        Stripe stripes[SNAPSHOT_READER_STRIPES];
+        alignas(CONCURRENT_HASH_MAP_CACHE_LINE) std::atomic<uint64_t> epoch{ 0 };
+    };
+
+    //FlatHashMap for tables that are read from many threads and rarely change, like the service and resource
+    //loader registries. Reads are lock free and never block. Every write copies the table under a lock,
+    //publishes the copy with one pointer swap and frees the old table once no reader can be using it.
+    //A write costs a copy of the whole table, so batch changes into one update() when there are several.
+    template<typename K, typename V, typename Hasher = HashMapHasher>
+    struct SnapshotHashMap
+    {
+        using Table = FlatHashMap<K, V, Hasher>;
+
+        void init(Allocator* allocator, uint64_t initialCapacity);
+        //No other thread may be using the map.
+        void shutdown();
+
+        //Readers, safe from any thread at the same time as a writer.
+        bool find(const K& key, V& value);
+        //Returns the default value when the key isn't there.
+        V get(const K& key);
+        bool contains(const K& key);
+
+        //Writers, serialised by the write lock. They return once the old table is freed.
+        void insert(const K& key, const V& value);
+        uint32_t remove(const K& key);
+        void setDefaultValue(const V& value);
+
+        //function(Table&) makes any number of changes to a private copy of the table, published together.
+        //Readers probe published tables without any locking, so incremental resize can't be turned on for the copy.
+        //A resize the copy started while growing is finished before it is published.
+        template<typename Function>
+        void update(Function function);
+
+        //Caller holds writeMutex.
+        Table* copyTable(const Table* source);
+        void publish(Table* newTable);
+        void freeTable(Table* oldTable);
+
+        std::atomic<Table*> table{ nullptr };
+        Allocator* allocator = nullptr;
+
+        std::mutex writeMutex;
+        SnapshotReaders readers;
+    };
+
+    //SnapshotHashMap//////////////////////////////////////////////////////////
+    template<typename K, typename V, typename Hasher>
+    inline void SnapshotHashMap<K, V, Hasher>::init(Allocator* allocator, uint64_t initialCapacity)
+    {
+        this->allocator = allocator;
+
+        Table* newTable = (Table*)air_allocaa(sizeof(Table), allocator, alignof(Table));
+        new (newTable) Table();
+        newTable->init(allocator, initialCapacity);
+        table.store(newTable, std::memory_order_release);
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline void SnapshotHashMap<K, V, Hasher>::shutdown()
+    {
+        Table* current = table.exchange(nullptr, std::memory_order_acq_rel);
+        if (current)
+        {
+            freeTable(current);
+        }
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline bool SnapshotHashMap<K, V, Hasher>::find(const K& key, V& value)
+    {
+        const uint32_t token = readers.enter();
+        Table* current = table.load(std::memory_order_acquire);
+        const FlatHashMapIterator it = current->find(key);
+        if (it.isValid())
+        {
+            value = current->get(it);
+        }
+        readers.leave(token);
+
+        return it.isValid();
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline V SnapshotHashMap<K, V, Hasher>::get(const K& key)
+    {
+        const uint32_t token = readers.enter();
+        Table* current = table.load(std::memory_order_acquire);
+        V value = current->get(key);
+        readers.leave(token);
+
+        return value;
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline bool SnapshotHashMap<K, V, Hasher>::contains(const K& key)
+    {
+        const uint32_t token = readers.enter();
+        const bool found = table.load(std::memory_order_acquire)->find(key).isValid();
+        readers.leave(token);
+
+        return found;
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline void SnapshotHashMap<K, V, Hasher>::insert(const K& key, const V& value)
+    {
+        update([&](Table& newTable) { newTable.insert(key, value); });
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline uint32_t SnapshotHashMap<K, V, Hasher>::remove(const K& key)
+    {
+        uint32_t removed = 0;
+        update([&](Table& newTable) { removed = newTable.remove(key); });
+        return removed;
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline void SnapshotHashMap<K, V, Hasher>::setDefaultValue(const V& value)
+    {
+        update([&](Table& newTable) { newTable.setDefaultValue(value); });
+    }
+
+    template<typename K, typename V, typename Hasher>
+    template<typename Function>
+    inline void SnapshotHashMap<K, V, Hasher>::update(Function function)
+    {
+        std::lock_guard<std::mutex> guard(writeMutex);
+
+        Table* newTable = copyTable(table.load(std::memory_order_relaxed));
+        function(*newTable);
+        publish(newTable);
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline typename SnapshotHashMap<K, V, Hasher>::Table* SnapshotHashMap<K, V, Hasher>::copyTable(const Table* source)
+    {
+        Table* newTable = (Table*)air_allocaa(sizeof(Table), allocator, alignof(Table));
+        new (newTable) Table();
+        //Room for the entry most updates add without growing straight away.
+        newTable->init(allocator, source->size + 1);
+        newTable->setDefaultValue(source->defaultKeyValue.value);
+
+        Table* from = const_cast<Table*>(source);
+        for (FlatHashMapIterator it = from->iteratorBegin(); it.isValid(); from->iteratorAdvance(it))
+        {
+            const auto& keyValue = from->getStructure(it);
+            newTable->insert(keyValue.key, keyValue.value);
+        }
+
+        return newTable;
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline void SnapshotHashMap<K, V, Hasher>::publish(Table* newTable)
+    {
+        //Lookups on a table that is still resizing move entries across, which concurrent readers can't do safely.
+        newTable->finishResize();
+        AIR_ASSERTM(newTable->isResizing() == false && newTable->resizeGroupsPerOperation == 0,
+                    "Snapshot tables are read without locks, they can't use incremental resize.");
+
+        Table* oldTable = table.exchange(newTable, std::memory_order_seq_cst);
+        readers.synchronise();
+        freeTable(oldTable);
+    }
+
+    template<typename K, typename V, typename Hasher>
+    inline void SnapshotHashMap<K, V, Hasher>::freeTable(Table* oldTable)
+    {
+        oldTable->shutdown();
+        oldTable->~Table();
+        air_free(oldTable, allocator);
+    }
+}
+
+#endif // !CONCURRENT_HASH_MAP_HDR
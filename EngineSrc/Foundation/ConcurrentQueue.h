@@ -0,0 +1,315 @@
+#ifndef CONCURRENT_QUEUE_HDR
+#define CONCURRENT_QUEUE_HDR
+
+#include "Platform.h"
+#include "Memory.h"
+#include "Assert.h"
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Air
+{
+    static constexpr uint32_t CONCURRENT_QUEUE_CACHE_LINE = 64;
+
+    //Bounded multi producer multi consumer queue after Dmitry Vyukov's design. Every cell carries a sequence number
+    //that says whether it is ready for the producer or consumer at a given position, so push and pop each only need one
+    //compare exchange on their own counter and never touch the other side's cache line.
+    //Push returns false when the queue is full and pop returns false when it is empty, neither ever blocks.
+    template<typename T>
+    struct MPMCQueue
+    {
+        //capacity is rounded up to a power of 2.
+        void init(Allocator* allocator, uint32_t capacity);
+        //Destroys anything still in the queue. No other thread may be using it.
+        void shutdown();
+
+        bool push(const T& value)
+        {
+            return emplace(value);
+        }
+
+        bool push(T&& value)
+        {
+            return emplace(std::move(value));
+        }
+
+        template<typename... Arguments>
+        bool emplace(Arguments&&... arguments);
+
+        bool pop(T& value);
+
+        //Only a snapshot, other threads can change it straight away.
+        uint32_t sizeApprox() const;
+
+        struct Cell
+        {
+            std::atomic<uint64_t> sequence;
+            alignas(T) uint8_t storage[sizeof(T)];
+        };
+
+        Cell* cells = nullptr;
+        Allocator* allocator = nullptr;
+        uint32_t capacity = 0;
+        uint32_t mask = 0;
+
+        alignas(CONCURRENT_QUEUE_CACHE_LINE) std::atomic<uint64_t> enqueuePosition{ 0 };
+        alignas(CONCURRENT_QUEUE_CACHE_LINE) std::atomic<uint64_t> dequeuePosition{ 0 };
+        uint8_t padding[CONCURRENT_QUEUE_CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    };
+
+    //Bounded queue for exactly one producer thread and one consumer thread. Push and pop are wait free: each side owns
+    //its counter and keeps a cached copy of the other side's, so the shared cache line is only read when the cached
+    //copy says the queue looks full or empty.
+    template<typename T>
+    struct SPSCQueue
+    {
+        //capacity is rounded up to a power of 2.
+        void init(Allocator* allocator, uint32_t capacity);
+        //Destroys anything still in the queue. Neither thread may be using it.
+        void shutdown();
+
+        //Producer thread only.
+        bool push(const T& value)
+        {
+            return emplace(value);
+        }
+
+        bool push(T&& value)
+        {
+            return emplace(std::move(value));
+        }
+
+        template<typename... Arguments>
+        bool emplace(Arguments&&... arguments);
+
+        //Consumer thread only.
+        bool pop(T& value);
+
+        uint32_t sizeApprox() const;
+
+        T* slots = nullptr;
+        Allocator* allocator = nullptr;
+        uint32_t capacity = 0;
+        uint32_t mask = 0;
+
+        //Written by the producer.
+        alignas(CONCURRENT_QUEUE_CACHE_LINE) std::atomic<uint64_t> tail{ 0 };
+        uint64_t cachedHead = 0;
+        //Written by the consumer.
+        alignas(CONCURRENT_QUEUE_CACHE_LINE) std::atomic<uint64_t> head{ 0 };
+        uint64_t cachedTail = 0;
+        uint8_t padding[CONCURRENT_QUEUE_CACHE_LINE - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+    };
+
+    inline uint32_t concurrentQueueCapacity(uint32_t capacity)
+    {
+        AIR_ASSERTM(capacity > 0 && capacity <= (1u << 31), "Queue capacity %u is out of range.", capacity);
+        uint32_t rounded = 1;
+        while (rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+        return rounded;
+    }
+
+    //MPMCQueue////////////////////////////////////////////////////////////////
+    template<typename T>
+    inline void MPMCQueue<T>::init(Allocator* allocator, uint32_t capacity)
+    {
+        this->allocator = allocator;
+        this->capacity = concurrentQueueCapacity(capacity);
+        mask = this->capacity - 1;
+
+        cells = (Cell*)air_allocaa(sizeof(Cell) * this->capacity, allocator, alignof(Cell));
+        for (uint32_t i = 0; i < this->capacity; ++i)
+        {
+            new (&cells[i].sequence) std::atomic<uint64_t>(i);
+        }
+
+        enqueuePosition.store(0, std::memory_order_relaxed);
+        dequeuePosition.store(0, std::memory_order_relaxed);
+    }
+
+    template<typename T>
+    inline void MPMCQueue<T>::shutdown()
+    {
+        if (cells == nullptr)
+        {
+            return;
+        }
+
+        if constexpr (std::is_trivially_destructible_v<T> == false)
+        {
+            const uint64_t end = enqueuePosition.load(std::memory_order_acquire);
+            for (uint64_t position = dequeuePosition.load(std::memory_order_relaxed); position != end; ++position)
+            {
+                ((T*)cells[position & mask].storage)->~T();
+            }
+        }
+
+        air_free(cells, allocator);
+        cells = nullptr;
+        capacity = 0;
+    }
+
+    template<typename T>
+    template<typename... Arguments>
+    inline bool MPMCQueue<T>::emplace(Arguments&&... arguments)
+    {
+        uint64_t position = enqueuePosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[position & mask];
+            const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const int64_t difference = (int64_t)(sequence - position);
+            if (difference == 0)
+            {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    new (cell.storage) T(std::forward<Arguments>(arguments)...);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                //The cell still holds the value from a lap ago, the queue is full.
+                return false;
+            }
+            else
+            {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template<typename T>
+    inline bool MPMCQueue<T>::pop(T& value)
+    {
+        uint64_t position = dequeuePosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[position & mask];
+            const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const int64_t difference = (int64_t)(sequence - (position + 1));
+            if (difference == 0)
+            {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    T* element = (T*)cell.storage;
+                    value = std::move(*element);
+                    element->~T();
+                    //Hands the cell to the producer one lap ahead.
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template<typename T>
+    inline uint32_t MPMCQueue<T>::sizeApprox() const
+    {
+        const uint64_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+        const uint64_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? (uint32_t)(enqueued - dequeued) : 0;
+    }
+
+    //SPSCQueue////////////////////////////////////////////////////////////////
+    template<typename T>
+    inline void SPSCQueue<T>::init(Allocator* allocator, uint32_t capacity)
+    {
+        this->allocator = allocator;
+        this->capacity = concurrentQueueCapacity(capacity);
+        mask = this->capacity - 1;
+
+        slots = (T*)air_allocaa(sizeof(T) * this->capacity, allocator, alignof(T));
+
+        tail.store(0, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+        cachedHead = 0;
+        cachedTail = 0;
+    }
+
+    template<typename T>
+    inline void SPSCQueue<T>::shutdown()
+    {
+        if (slots == nullptr)
+        {
+            return;
+        }
+
+        if constexpr (std::is_trivially_destructible_v<T> == false)
+        {
+            const uint64_t end = tail.load(std::memory_order_acquire);
+            for (uint64_t position = head.load(std::memory_order_relaxed); position != end; ++position)
+            {
+                slots[position & mask].~T();
+            }
+        }
+
+        air_free(slots, allocator);
+        slots = nullptr;
+        capacity = 0;
+    }
+
+    template<typename T>
+    template<typename... Arguments>
+    inline bool SPSCQueue<T>::emplace(Arguments&&... arguments)
+    {
+        const uint64_t position = tail.load(std::memory_order_relaxed);
+        if (position - cachedHead == capacity)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position - cachedHead == capacity)
+            {
+                return false;
+            }
+        }
+
+        new (&slots[position & mask]) T(std::forward<Arguments>(arguments)...);
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename T>
+    inline bool SPSCQueue<T>::pop(T& value)
+    {
+        const uint64_t position = head.load(std::memory_order_relaxed);
+        if (position == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position == cachedTail)
+            {
+                return false;
+            }
+        }
+
+        T* element = &slots[position & mask];
+        value = std::move(*element);
+        element->~T();
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename T>
+    inline uint32_t SPSCQueue<T>::sizeApprox() const
+    {
+        const uint64_t written = tail.load(std::memory_order_relaxed);
+        const uint64_t read = head.load(std::memory_order_relaxed);
+        return written > read ? (uint32_t)(written - read) : 0;
+    }
+}
+
+#endif // !CONCURRENT_QUEUE_HDR
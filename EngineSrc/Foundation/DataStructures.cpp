@@ -1,22 +1,28 @@
 #include "DataStructures.h"
 
 #include <string.h>
+#include <new>
 
 namespace Air 
 {
     void ResourcePool::init(Allocator* alloc, uint32_t poolSize, uint32_t resourceSize) 
     {
+        AIR_ASSERTM(poolSize <= RESOURCE_POOL_MAX_SIZE, "Resource pools can hold at most %u resources.", RESOURCE_POOL_MAX_SIZE);
+
         this->allocator = alloc;
         this->poolSize = poolSize;
         this->resourceSize = resourceSize;
+        liveWordCount = (poolSize + 63) / 64;
 
-        //Lets groups these together in a sizes of resource + uint32_t
-        size_t allocationSize = poolSize * (resourceSize + sizeof(uint32_t));
-        memory = (uint8_t*)allocator->allocate(allocationSize, 1);
+        //Lets groups these together, resources then the live bits, free indices and generations.
+        const size_t resourcesSize = memoryAlign((size_t)poolSize * resourceSize, alignof(uint64_t));
+        const size_t allocationSize = resourcesSize + liveWordCount * sizeof(uint64_t) + poolSize * (sizeof(uint32_t) + sizeof(uint16_t));
+        memory = (uint8_t*)allocator->allocate(allocationSize, 16);
         memset(memory, 0, allocationSize);
 
-        //Allocate and add free indices
-        freeIndices = (uint32_t*)(memory + poolSize * resourceSize);
+        liveBits = (uint64_t*)(memory + resourcesSize);
+        freeIndices = (uint32_t*)(liveBits + liveWordCount);
+        generations = (uint16_t*)(freeIndices + poolSize);
         freeIndiceHead = 0;
 
         for (uint32_t i = 0; i < poolSize; ++i) 
@@ -27,42 +33,69 @@ namespace Air
         usedIndinces = 0;
     }
 
-    void ResourcePool::shutdown() const
+    void ResourcePool::shutdown()
     {
-        if (freeIndiceHead != 0) 
+        if (usedIndinces != 0) 
         {
             aprint("Resource pool has unfreed resources.\n");
 
-            for (uint32_t i = 0; i < freeIndiceHead; ++i) 
+            forEachLive([](uint32_t handle)
             {
-                aprint("\tResource %u\n", freeIndices[i]);
-            }
+                aprint("\tResource %u\n", resourceHandleIndex(handle));
+            });
+        }
+
+        if (memory)
+        {
+            allocator->deallocate(memory);
         }
+
+        memory = nullptr;
+        freeIndices = nullptr;
+        liveBits = nullptr;
+        generations = nullptr;
     }
 
     uint32_t ResourcePool::obtainResource() 
     {
-        //TODO: Try to add bits for checking if resources are alice and use bitmasking to figure that out.
         if (freeIndiceHead < poolSize) 
         {
             const uint32_t freeIndex = freeIndices[freeIndiceHead++];
+            liveBits[freeIndex / 64] |= uint64_t(1) << (freeIndex % 64);
             ++usedIndinces;
-            return freeIndex;
+            return resourceHandleMake(freeIndex, generations[freeIndex]);
         }
 
         AIR_ASSERTM(false, "No more resources");
-        return UINT32_MAX;
+        return RESOURCE_HANDLE_INVALID;
     }
 
-    void ResourcePool::releaseResource(uint32_t index) 
+    void ResourcePool::releaseResource(uint32_t handle) 
     {
-        //TODO: Try to add bits for checking if resources are alice and use bitmasking to figure that out.
+        if (isValid(handle) == false)
+        {
+            AIR_ASSERTM(false, "Releasing a stale or invalid resource handle %x.", handle);
+            return;
+        }
+
+        const uint32_t index = resourceHandleIndex(handle);
+        liveBits[index / 64] &= ~(uint64_t(1) << (index % 64));
+        generations[index] = (uint16_t)((generations[index] + 1) & RESOURCE_HANDLE_GENERATION_MASK);
+
         freeIndices[--freeIndiceHead] = index;
         --usedIndinces;
     }
 
     void ResourcePool::freeAllResources() 
     {
+        //Every outstanding handle has to go stale.
+        forEachLive([this](uint32_t handle)
+        {
+            const uint32_t index = resourceHandleIndex(handle);
+            generations[index] = (uint16_t)((generations[index] + 1) & RESOURCE_HANDLE_GENERATION_MASK);
+        });
+        memset(liveBits, 0, liveWordCount * sizeof(uint64_t));
+
         freeIndiceHead = 0;
         usedIndinces = 0;
 
@@ -72,23 +105,271 @@ namespace Air
         }
     }
 
-    void* ResourcePool::accessResource(uint32_t index) 
+    bool ResourcePool::isValid(uint32_t handle) const
+    {
+        const uint32_t index = resourceHandleIndex(handle);
+        //Released slots have their generation bumped, so a matching generation means the slot is still live.
+        return index < poolSize && generations[index] == resourceHandleGeneration(handle) && (liveBits[index / 64] & (uint64_t(1) << (index % 64)));
+    }
+
+    uint32_t ResourcePool::handleFromIndex(uint32_t index) const
     {
-        if (index != UINT32_MAX)
+        AIR_ASSERT(index < poolSize);
+        return resourceHandleMake(index, generations[index]);
+    }
+
+    void* ResourcePool::accessResource(uint32_t handle) 
+    {
+        if (isValid(handle))
         {
-            return &memory[index * resourceSize];
+            return &memory[(size_t)resourceHandleIndex(handle) * resourceSize];
         }
 
         return nullptr;
     }
 
-    const void* ResourcePool::accessResource(uint32_t index) const 
+    const void* ResourcePool::accessResource(uint32_t handle) const 
     {
-        if (index != UINT32_MAX)
+        if (isValid(handle))
         {
-            return &memory[index * resourceSize];
+            return &memory[(size_t)resourceHandleIndex(handle) * resourceSize];
         }
 
         return nullptr;
     }
+
+    static constexpr uint32_t PAGED_SLOT_LIVE = 1u << 31;
+
+    //Sits at the start of every page, one per resource.
+    struct PagedResourceSlot
+    {
+        //Generation in the low bits, PAGED_SLOT_LIVE while obtained.
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> nextFree;
+    };
+
+    static PagedResourceSlot* pagedSlot(const PagedResourcePool* pool, uint32_t index)
+    {
+        uint8_t* page = pool->pages[index >> pool->pageShift].load(std::memory_order_acquire);
+        return (PagedResourceSlot*)page + (index & (pool->resourcesPerPage - 1));
+    }
+
+    static uint64_t pagedFreeHead(uint64_t oldHead, uint32_t index)
+    {
+        return (((oldHead >> 32) + 1) << 32) | index;
+    }
+
+    void PagedResourcePool::init(Allocator* alloc, uint32_t resourceSize, uint32_t resourcesPerPage, uint32_t maxResources)
+    {
+        AIR_ASSERTM(resourcesPerPage && (resourcesPerPage & (resourcesPerPage - 1)) == 0, "Resources per page %u has to be a power of 2.", resourcesPerPage);
+
+        allocator = alloc;
+        this->resourceSize = resourceSize;
+        this->resourcesPerPage = resourcesPerPage;
+        this->maxResources = maxResources < RESOURCE_POOL_MAX_SIZE ? maxResources : RESOURCE_POOL_MAX_SIZE;
+
+        pageShift = 0;
+        while ((1u << pageShift) < resourcesPerPage)
+        {
+            ++pageShift;
+        }
+
+        maxPages = (this->maxResources + resourcesPerPage - 1) / resourcesPerPage;
+        resourcesOffset = (uint32_t)memoryAlign(resourcesPerPage * sizeof(PagedResourceSlot), 16);
+
+        pages = (std::atomic<uint8_t*>*)allocator->allocate(maxPages * sizeof(std::atomic<uint8_t*>), alignof(std::atomic<uint8_t*>));
+        for (uint32_t i = 0; i < maxPages; ++i)
+        {
+            new (&pages[i]) std::atomic<uint8_t*>(nullptr);
+        }
+
+        freeHead.store(UINT32_MAX, std::memory_order_relaxed);
+        liveCount.store(0, std::memory_order_relaxed);
+        peakLiveCount.store(0, std::memory_order_relaxed);
+        pageCount.store(0, std::memory_order_relaxed);
+    }
+
+    void PagedResourcePool::shutdown()
+    {
+        const uint32_t live = liveCount.load(std::memory_order_acquire);
+        if (live != 0)
+        {
+            aprint("Paged resource pool has %u unfreed resources.\n", live);
+
+            forEachLive([](uint32_t handle)
+            {
+                aprint("\tResource %u\n", resourceHandleIndex(handle));
+            });
+        }
+
+        const uint32_t pages = pageCount.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < pages; ++i)
+        {
+            allocator->deallocate(this->pages[i].load(std::memory_order_relaxed));
+        }
+
+        if (this->pages)
+        {
+            allocator->deallocate(this->pages);
+        }
+
+        this->pages = nullptr;
+        pageCount.store(0, std::memory_order_relaxed);
+        freeHead.store(UINT32_MAX, std::memory_order_relaxed);
+        liveCount.store(0, std::memory_order_relaxed);
+    }
+
+    bool PagedResourcePool::addPage()
+    {
+        std::lock_guard<std::mutex> lock(growMutex);
+
+        //Another thread may have added a page or released a slot while we waited.
+        if ((uint32_t)freeHead.load(std::memory_order_acquire) != UINT32_MAX)
+        {
+            return true;
+        }
+
+        const uint32_t page = pageCount.load(std::memory_order_relaxed);
+        if (page == maxPages)
+        {
+            return false;
+        }
+
+        uint8_t* memory = (uint8_t*)allocator->allocate(resourcesOffset + (size_t)resourcesPerPage * resourceSize, 16);
+        memset(memory + resourcesOffset, 0, (size_t)resourcesPerPage * resourceSize);
+
+        const uint32_t firstIndex = page * resourcesPerPage;
+        const uint32_t endIndex = firstIndex + resourcesPerPage < maxResources ? firstIndex + resourcesPerPage : maxResources;
+        PagedResourceSlot* slots = (PagedResourceSlot*)memory;
+        for (uint32_t i = 0; i < resourcesPerPage; ++i)
+        {
+            new (&slots[i]) PagedResourceSlot;
+            slots[i].state.store(0, std::memory_order_relaxed);
+            slots[i].nextFree.store(firstIndex + i + 1, std::memory_order_relaxed);
+        }
+
+        pages[page].store(memory, std::memory_order_release);
+        pageCount.store(page + 1, std::memory_order_release);
+
+        //The new slots go on the free list as one chain.
+        PagedResourceSlot* lastSlot = &slots[endIndex - firstIndex - 1];
+        uint64_t head = freeHead.load(std::memory_order_relaxed);
+        do
+        {
+            lastSlot->nextFree.store((uint32_t)head, std::memory_order_relaxed);
+        } while (freeHead.compare_exchange_weak(head, pagedFreeHead(head, firstIndex), std::memory_order_release, std::memory_order_relaxed) == false);
+
+        return true;
+    }
+
+    uint32_t PagedResourcePool::obtainResource()
+    {
+        uint64_t head = freeHead.load(std::memory_order_acquire);
+        for (;;)
+        {
+            const uint32_t index = (uint32_t)head;
+            if (index == UINT32_MAX)
+            {
+                if (addPage() == false)
+                {
+                    aprint("Paged resource pool is full at %u resources.\n", maxResources);
+                    return RESOURCE_HANDLE_INVALID;
+                }
+
+                head = freeHead.load(std::memory_order_acquire);
+                continue;
+            }
+
+            //The slot may be popped and reused under us, then this read is stale but the tag makes the exchange fail.
+            const uint32_t next = pagedSlot(this, index)->nextFree.load(std::memory_order_relaxed);
+            if (freeHead.compare_exchange_weak(head, pagedFreeHead(head, next), std::memory_order_acquire, std::memory_order_acquire))
+            {
+                PagedResourceSlot* slot = pagedSlot(this, index);
+                const uint32_t generation = slot->state.load(std::memory_order_relaxed) & RESOURCE_HANDLE_GENERATION_MASK;
+                slot->state.store(generation | PAGED_SLOT_LIVE, std::memory_order_release);
+
+                const uint32_t live = liveCount.fetch_add(1, std::memory_order_relaxed) + 1;
+                uint32_t peak = peakLiveCount.load(std::memory_order_relaxed);
+                while (live > peak && peakLiveCount.compare_exchange_weak(peak, live, std::memory_order_relaxed) == false)
+                {
+                }
+
+                return resourceHandleMake(index, generation);
+            }
+        }
+    }
+
+    void PagedResourcePool::releaseResource(uint32_t handle)
+    {
+        const uint32_t index = resourceHandleIndex(handle);
+        if (index >= maxResources || (index >> pageShift) >= pageCount.load(std::memory_order_acquire))
+        {
+            AIR_ASSERTM(false, "Releasing an invalid resource handle %x.", handle);
+            return;
+        }
+
+        //Bumping the generation with an exchange means two threads releasing the same handle can't both succeed.
+        PagedResourceSlot* slot = pagedSlot(this, index);
+        const uint32_t generation = resourceHandleGeneration(handle);
+        uint32_t expected = generation | PAGED_SLOT_LIVE;
+        if (slot->state.compare_exchange_strong(expected, (generation + 1) & RESOURCE_HANDLE_GENERATION_MASK, std::memory_order_acq_rel) == false)
+        {
+            AIR_ASSERTM(false, "Releasing a stale resource handle %x.", handle);
+            return;
+        }
+
+        liveCount.fetch_sub(1, std::memory_order_relaxed);
+
+        uint64_t head = freeHead.load(std::memory_order_relaxed);
+        do
+        {
+            slot->nextFree.store((uint32_t)head, std::memory_order_relaxed);
+        } while (freeHead.compare_exchange_weak(head, pagedFreeHead(head, index), std::memory_order_release, std::memory_order_relaxed) == false);
+    }
+
+    bool PagedResourcePool::isValid(uint32_t handle) const
+    {
+        const uint32_t index = resourceHandleIndex(handle);
+        if (index >= maxResources || (index >> pageShift) >= pageCount.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        return pagedSlot(this, index)->state.load(std::memory_order_acquire) == (resourceHandleGeneration(handle) | PAGED_SLOT_LIVE);
+    }
+
+    uint32_t PagedResourcePool::liveHandle(uint32_t index) const
+    {
+        const uint32_t state = pagedSlot(this, index)->state.load(std::memory_order_acquire);
+        return (state & PAGED_SLOT_LIVE) ? resourceHandleMake(index, state & RESOURCE_HANDLE_GENERATION_MASK) : RESOURCE_HANDLE_INVALID;
+    }
+
+    void* PagedResourcePool::accessResource(uint32_t handle)
+    {
+        if (isValid(handle))
+        {
+            const uint32_t index = resourceHandleIndex(handle);
+            uint8_t* page = pages[index >> pageShift].load(std::memory_order_acquire);
+            return page + resourcesOffset + (size_t)(index & (resourcesPerPage - 1)) * resourceSize;
+        }
+
+        return nullptr;
+    }
+
+    const void* PagedResourcePool::accessResource(uint32_t handle) const
+    {
+        return const_cast<PagedResourcePool*>(this)->accessResource(handle);
+    }
+
+    PagedResourcePoolStats PagedResourcePool::stats() const
+    {
+        PagedResourcePoolStats result;
+        result.pageCount = pageCount.load(std::memory_order_acquire);
+        const uint32_t pagedCapacity = result.pageCount * resourcesPerPage;
+        result.capacity = pagedCapacity < maxResources ? pagedCapacity : maxResources;
+        result.liveCount = liveCount.load(std::memory_order_relaxed);
+        result.peakLiveCount = peakLiveCount.load(std::memory_order_relaxed);
+        result.occupancy = result.capacity ? (float)result.liveCount / (float)result.capacity : 0.0f;
+        return result;
+    }
 }
\ No newline at end of file
@@ -3,29 +3,117 @@
 
 #include "Memory.h"
 #include "Assert.h"
+#include "Bit.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
 
 namespace Air 
 {
+    //Resource handles pack the slot index in the low bits and the slot generation in the high bits.
+    //The generation is bumped every time a slot is released so old handles to it stop resolving.
+    static constexpr uint32_t RESOURCE_HANDLE_INDEX_BITS = 20;
+    static constexpr uint32_t RESOURCE_HANDLE_INDEX_MASK = (1u << RESOURCE_HANDLE_INDEX_BITS) - 1;
+    static constexpr uint32_t RESOURCE_HANDLE_GENERATION_MASK = (1u << (32 - RESOURCE_HANDLE_INDEX_BITS)) - 1;
+    //Index RESOURCE_HANDLE_INDEX_MASK is never handed out so this can't collide with a real handle.
+    static constexpr uint32_t RESOURCE_HANDLE_INVALID = UINT32_MAX;
+    static constexpr uint32_t RESOURCE_POOL_MAX_SIZE = RESOURCE_HANDLE_INDEX_MASK;
+
+    static inline uint32_t resourceHandleMake(uint32_t index, uint32_t generation)
+    {
+        return ((generation & RESOURCE_HANDLE_GENERATION_MASK) << RESOURCE_HANDLE_INDEX_BITS) | index;
+    }
+
+    static inline uint32_t resourceHandleIndex(uint32_t handle)
+    {
+        return handle & RESOURCE_HANDLE_INDEX_MASK;
+    }
+
+    static inline uint32_t resourceHandleGeneration(uint32_t handle)
+    {
+        return handle >> RESOURCE_HANDLE_INDEX_BITS;
+    }
+
+    //Typed wrapper so a handle from one pool can't be passed to a pool of a different type.
+    template<typename T>
+    struct ResourceHandle
+    {
+        bool isValid() const
+        {
+            return value != RESOURCE_HANDLE_INVALID;
+        }
+
+        uint32_t index() const
+        {
+            return resourceHandleIndex(value);
+        }
+
+        bool operator==(const ResourceHandle& other) const
+        {
+            return value == other.value;
+        }
+
+        bool operator!=(const ResourceHandle& other) const
+        {
+            return value != other.value;
+        }
+
+        uint32_t value = RESOURCE_HANDLE_INVALID;
+    };
+
+    //Fixed size pool handing out generation checked handles. A handle whose slot was released
+    //(and maybe reused since) resolves to nullptr instead of aliasing the new resource.
+    //Generations are 12 bits, so a handle only aliases again after its slot has been recycled 4096 times.
     struct ResourcePool 
     {
         void init(Allocator* alloc, uint32_t poolSize, uint32_t resourceSize);
-        void shutdown() const;
+        void shutdown();
 
+        //Returns a handle to a free slot, RESOURCE_HANDLE_INVALID when the pool is full.
         uint32_t obtainResource();
         void releaseResource(uint32_t handle);
         void freeAllResources();
 
-        void* accessResource(uint32_t index);
-        const void* accessResource(uint32_t index) const;
+        //O(1), returns nullptr for stale or invalid handles.
+        void* accessResource(uint32_t handle);
+        const void* accessResource(uint32_t handle) const;
+
+        bool isValid(uint32_t handle) const;
+        //Handle to the live resource in slot index.
+        uint32_t handleFromIndex(uint32_t index) const;
+
+        //Calls function(handle) for every live resource in slot order, walking the live bitset a word at a time.
+        template<typename Function>
+        void forEachLive(Function function) const
+        {
+            for (uint32_t word = 0; word < liveWordCount; ++word)
+            {
+                uint64_t bits = liveBits[word];
+                while (bits)
+                {
+                    const uint32_t index = word * 64 + (uint32_t)trailingZerosU64(bits);
+                    bits &= bits - 1;
+                    function(resourceHandleMake(index, generations[index]));
+                }
+            }
+        }
 
         uint8_t* memory = nullptr;
         uint32_t* freeIndices = nullptr;
+        //One bit per slot, set while the slot is obtained.
+        uint64_t* liveBits = nullptr;
+        uint16_t* generations = nullptr;
         Allocator* allocator = nullptr;
 
         uint32_t freeIndiceHead = 0;
         uint32_t poolSize = 16;
         uint32_t resourceSize = 4;
         uint32_t usedIndinces = 0;
+        uint32_t liveWordCount = 0;
     };
 
     template<typename T>
@@ -38,28 +126,38 @@ namespace Air
 
         void shutdown()
         {
-            if (freeIndiceHead != 0)
+            if (usedIndinces != 0)
             {
                 aprint("Resource pool has unfreed resources.\n");
 
-                for (uint32_t i = 0; i < freeIndiceHead; ++i)
+                forEachLive([this](uint32_t handle)
                 {
-                    aprint("\tResource %u, %s\n", freeIndices[i], get(freeIndices[i])->name);
-                }
+                    aprint("\tResource %u, %s\n", resourceHandleIndex(handle), get(handle)->name);
+                });
+                //Already reported with names, don't list them again.
+                usedIndinces = 0;
             }
 
             ResourcePool::shutdown();
         }
 
+        //T has to have a uint32_t poolIndex, it is set to the resource's handle.
         T* obtain()
         {
-            uint32_t resourceIndex = ResourcePool::obtainResource();
-            if (resourceIndex != UINT32_MAX)
+            const uint32_t handle = ResourcePool::obtainResource();
+            if (handle != RESOURCE_HANDLE_INVALID)
             {
-                T* resource = get(resourceIndex);
-                resource->poolIndex = resourceIndex;
+                T* resource = get(handle);
+                resource->poolIndex = handle;
                 return resource;
             }
+
+            return nullptr;
+        }
+
+        ResourceHandle<T> obtainHandle()
+        {
+            return ResourceHandle<T>{ ResourcePool::obtainResource() };
         }
 
         void release(T* resource)
@@ -67,15 +165,285 @@ namespace Air
             ResourcePool::releaseResource(resource->poolIndex);
         }
 
-        T* get(uint32_t index)
+        void release(ResourceHandle<T> handle)
+        {
+            ResourcePool::releaseResource(handle.value);
+        }
+
+        T* get(uint32_t handle)
+        {
+            return (T*)ResourcePool::accessResource(handle);
+        }
+
+        const T* get(uint32_t handle) const
+        {
+            return (const T*)ResourcePool::accessResource(handle);
+        }
+
+        T* get(ResourceHandle<T> handle)
+        {
+            return (T*)ResourcePool::accessResource(handle.value);
+        }
+
+        const T* get(ResourceHandle<T> handle) const
+        {
+            return (const T*)ResourcePool::accessResource(handle.value);
+        }
+    };
+
+
+    struct PagedResourcePoolStats
+    {
+        uint32_t pageCount;
+        uint32_t capacity;
+        uint32_t liveCount;
+        uint32_t peakLiveCount;
+        //liveCount / capacity.
+        float occupancy;
+    };
+
+    //ResourcePool that grows a page at a time instead of asserting when it is full. Pages are never moved or freed
+    //before shutdown so resource pointers stay put. Obtain and release can be called from any thread: free slots sit
+    //on a lock-free stack whose head is tagged to avoid ABA, only adding a page takes a lock.
+    //Handles are the same packed index and generation as ResourcePool.
+    struct PagedResourcePool
+    {
+        //resourcesPerPage has to be a power of 2. The backing allocator is only called while adding or freeing pages.
+        void init(Allocator* alloc, uint32_t resourceSize, uint32_t resourcesPerPage = 256, uint32_t maxResources = RESOURCE_POOL_MAX_SIZE);
+        void shutdown();
+
+        //Returns RESOURCE_HANDLE_INVALID only once maxResources are live.
+        uint32_t obtainResource();
+        void releaseResource(uint32_t handle);
+
+        void* accessResource(uint32_t handle);
+        const void* accessResource(uint32_t handle) const;
+
+        bool isValid(uint32_t handle) const;
+
+        PagedResourcePoolStats stats() const;
+
+        //Calls function(handle) for every live resource. Not safe against concurrent obtains and releases.
+        template<typename Function>
+        void forEachLive(Function function) const
+        {
+            const uint32_t pages = pageCount.load(std::memory_order_acquire);
+            for (uint32_t index = 0; index < pages * resourcesPerPage; ++index)
+            {
+                const uint32_t handle = liveHandle(index);
+                if (handle != RESOURCE_HANDLE_INVALID)
+                {
+                    function(handle);
+                }
+            }
+        }
+
+        uint32_t liveHandle(uint32_t index) const;
+        bool addPage();
+
+        //Top 32 bits are a tag bumped on every change, the bottom 32 the first free index.
+        alignas(64) std::atomic<uint64_t> freeHead{ UINT32_MAX };
+        alignas(64) std::atomic<uint32_t> liveCount{ 0 };
+        std::atomic<uint32_t> peakLiveCount{ 0 };
+
+        alignas(64) std::atomic<uint32_t> pageCount{ 0 };
+        std::atomic<uint8_t*>* pages = nullptr;
+        std::mutex growMutex;
+
+        Allocator* allocator = nullptr;
+        uint32_t resourceSize = 0;
+        uint32_t resourcesPerPage = 0;
+        uint32_t pageShift = 0;
+        uint32_t maxPages = 0;
+        uint32_t maxResources = 0;
+        //Offset of the first resource inside a page, the slot states come first.
+        uint32_t resourcesOffset = 0;
+    };
+
+    template<typename T>
+    struct PagedResourcePoolTyped : public PagedResourcePool
+    {
+        void init(Allocator* alloc, uint32_t resourcesPerPage = 256, uint32_t maxResources = RESOURCE_POOL_MAX_SIZE)
+        {
+            PagedResourcePool::init(alloc, sizeof(T), resourcesPerPage, maxResources);
+        }
+
+        //T has to have a uint32_t poolIndex, it is set to the resource's handle.
+        T* obtain()
+        {
+            const uint32_t handle = PagedResourcePool::obtainResource();
+            if (handle != RESOURCE_HANDLE_INVALID)
+            {
+                T* resource = get(handle);
+                resource->poolIndex = handle;
+                return resource;
+            }
+
+            return nullptr;
+        }
+
+        ResourceHandle<T> obtainHandle()
+        {
+            return ResourceHandle<T>{ PagedResourcePool::obtainResource() };
+        }
+
+        void release(T* resource)
+        {
+            PagedResourcePool::releaseResource(resource->poolIndex);
+        }
+
+        void release(ResourceHandle<T> handle)
+        {
+            PagedResourcePool::releaseResource(handle.value);
+        }
+
+        T* get(uint32_t handle)
+        {
+            return (T*)PagedResourcePool::accessResource(handle);
+        }
+
+        const T* get(uint32_t handle) const
+        {
+            return (const T*)PagedResourcePool::accessResource(handle);
+        }
+
+        T* get(ResourceHandle<T> handle)
+        {
+            return (T*)PagedResourcePool::accessResource(handle.value);
+        }
+
+        const T* get(ResourceHandle<T> handle) const
+        {
+            return (const T*)PagedResourcePool::accessResource(handle.value);
+        }
+    };
+
+    //Component arrays start on a cache line and are padded to a multiple of this many elements,
+    //so SIMD loops over them need neither a peeled head nor a scalar tail.
+    static constexpr size_t RESOURCE_POOL_SOA_ALIGNMENT = 64;
+    static constexpr uint32_t RESOURCE_POOL_SOA_PADDING = 16;
+
+    //Structure of arrays version of ResourcePoolTyped. Every component type gets its own contiguous array
+    //and a handle indexes all of them, so a loop that only reads positions doesn't drag the rest through cache.
+    //Handles, generations and the live bitset work exactly like ResourcePool. Components aren't constructed,
+    //they start zeroed like ResourcePool memory.
+    template<typename... Components>
+    struct ResourcePoolSoA
+    {
+        static_assert(sizeof...(Components) > 0, "A SoA pool needs at least one component.");
+        static_assert((std::is_trivially_destructible_v<Components> && ...), "SoA pool components are never destructed.");
+        static_assert(((alignof(Components) <= RESOURCE_POOL_SOA_ALIGNMENT) && ...), "Component alignment is bigger than the array alignment.");
+
+        static constexpr uint32_t COMPONENT_COUNT = sizeof...(Components);
+
+        template<uint32_t Component>
+        using ComponentType = std::tuple_element_t<Component, std::tuple<Components...>>;
+
+        void init(Allocator* alloc, uint32_t poolSize)
+        {
+            allocator = alloc;
+            slots.init(alloc, poolSize, 0);
+            paddedSize = (uint32_t)memoryAlign(poolSize, RESOURCE_POOL_SOA_PADDING);
+
+            constexpr size_t componentSizes[] = { sizeof(Components)... };
+            size_t offsets[COMPONENT_COUNT];
+            size_t totalSize = 0;
+            for (uint32_t i = 0; i < COMPONENT_COUNT; ++i)
+            {
+                totalSize = memoryAlign(totalSize, RESOURCE_POOL_SOA_ALIGNMENT);
+                offsets[i] = totalSize;
+                totalSize += componentSizes[i] * paddedSize;
+            }
+
+            //Not every allocator honours the alignment (the single threaded heap doesn't), so ask for enough
+            //to align the arrays here. memory keeps the pointer the allocator gave back.
+            memory = (uint8_t*)allocator->allocate(totalSize + RESOURCE_POOL_SOA_ALIGNMENT - 1, RESOURCE_POOL_SOA_ALIGNMENT);
+            AIR_ASSERTM(memory != nullptr, "SoA pool couldn't allocate %llu bytes.", (unsigned long long)totalSize);
+            uint8_t* arrays = (uint8_t*)memoryAlign((size_t)memory, RESOURCE_POOL_SOA_ALIGNMENT);
+            memset(arrays, 0, totalSize);
+            for (uint32_t i = 0; i < COMPONENT_COUNT; ++i)
+            {
+                componentArrays[i] = arrays + offsets[i];
+            }
+        }
+
+        void shutdown()
         {
-            return (T*)ResourcePool::accessResource(index);
+            slots.shutdown();
+            if (memory)
+            {
+                allocator->deallocate(memory);
+            }
+            memory = nullptr;
         }
 
-        const T* get(uint32_t index) const
+        uint32_t obtainResource()
         {
-            return (const T*)ResourcePool::accessResource(index);
+            return slots.obtainResource();
         }
+
+        void releaseResource(uint32_t handle)
+        {
+            slots.releaseResource(handle);
+        }
+
+        void freeAllResources()
+        {
+            slots.freeAllResources();
+        }
+
+        bool isValid(uint32_t handle) const
+        {
+            return slots.isValid(handle);
+        }
+
+        //Component of a resource, nullptr for stale or invalid handles.
+        template<uint32_t Component>
+        ComponentType<Component>* get(uint32_t handle)
+        {
+            return slots.isValid(handle) ? data<Component>() + resourceHandleIndex(handle) : nullptr;
+        }
+
+        template<uint32_t Component>
+        const ComponentType<Component>* get(uint32_t handle) const
+        {
+            return slots.isValid(handle) ? data<Component>() + resourceHandleIndex(handle) : nullptr;
+        }
+
+        //Whole component array, indexed by slot. Has paddedSize elements.
+        template<uint32_t Component>
+        ComponentType<Component>* data()
+        {
+            return (ComponentType<Component>*)componentArrays[Component];
+        }
+
+        template<uint32_t Component>
+        const ComponentType<Component>* data() const
+        {
+            return (const ComponentType<Component>*)componentArrays[Component];
+        }
+
+        //Calls function(index) for every live slot in order, the index goes straight into data<Component>().
+        template<typename Function>
+        void forEachLive(Function function) const
+        {
+            slots.forEachLive([&function](uint32_t handle)
+            {
+                function(resourceHandleIndex(handle));
+            });
+        }
+
+        uint32_t handleFromIndex(uint32_t index) const
+        {
+            return slots.handleFromIndex(index);
+        }
+
+        //Handles, generations and the live bitset. Its resource size is 0, the data lives in the component arrays.
+        ResourcePool slots;
+        void* componentArrays[COMPONENT_COUNT] = {};
+        uint8_t* memory = nullptr;
+        Allocator* allocator = nullptr;
+        uint32_t paddedSize = 0;
     };
 }
 
@@ -2,42 +2,133 @@
 
 #include "Assert.h"
 
+#if AIR_HASH_MAP_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
 namespace Air
 {
-    ProbeSequence::ProbeSequence(uint64_t hash, uint64_t mask) : 
-        mask(mask), offset(hash & mask)
+#if AIR_HASH_MAP_X86
+    static void cpuid(uint32_t info[4], uint32_t leaf, uint32_t subLeaf)
+    {
+#if defined(_MSC_VER)
+        int registers[4];
+        __cpuidex(registers, (int)leaf, (int)subLeaf);
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            info[i] = (uint32_t)registers[i];
+        }
+#else
+        __cpuid_count(leaf, subLeaf, info[0], info[1], info[2], info[3]);
+#endif
+    }
+
+    //XCR0, which says which register state the OS saves on a context switch.
+    static uint64_t readExtendedControlRegister()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax = 0;
+        uint32_t edx = 0;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((uint64_t)edx << 32) | eax;
+#endif
+    }
+#endif
+
+    static HashMapCpuFeatures detectCpuFeatures()
+    {
+        HashMapCpuFeatures features;
+#if AIR_HASH_MAP_X86
+        uint32_t info[4];
+        cpuid(info, 0, 0);
+        const uint32_t highestLeaf = info[0];
+
+        cpuid(info, 1, 0);
+        features.sse2 = (info[3] & (1u << 26)) != 0;
+        features.ssse3 = (info[2] & (1u << 9)) != 0;
+
+        //AVX2 needs the CPU bit and the OS saving the YMM registers, which OSXSAVE and XCR0 tell us.
+        const bool osxsave = (info[2] & (1u << 27)) != 0;
+        if (highestLeaf >= 7 && osxsave && (readExtendedControlRegister() & 0x6) == 0x6)
+        {
+            cpuid(info, 7, 0);
+            features.avx2 = (info[1] & (1u << 5)) != 0;
+        }
+#endif
+        return features;
+    }
+
+    const HashMapCpuFeatures& hashMapCpuFeatures()
     {
+        static const HashMapCpuFeatures features = detectCpuFeatures();
+        return features;
     }
 
-    uint64_t ProbeSequence::getOffset() const 
+    HashMapGroupKind hashMapBestGroup()
+    {
+#if AIR_HASH_MAP_X86
+        if (hashMapCpuFeatures().avx2)
+        {
+            return HASH_MAP_GROUP_AVX2;
+        }
+        return HASH_MAP_GROUP_SSE2;
+#else
+        return HASH_MAP_GROUP_PORTABLE;
+#endif
+    }
+
+    const char* hashMapGroupName(HashMapGroupKind kind)
+    {
+        switch (kind)
+        {
+            case HASH_MAP_GROUP_PORTABLE: return "portable8";
+            case HASH_MAP_GROUP_SSE2: return "sse2_16";
+            case HASH_MAP_GROUP_AVX2: return "avx2_32";
+        }
+        return "unknown";
+    }
+
+    ProbeSequence::ProbeSequence(uint64_t hash, uint64_t mask, uint64_t width) :
+        mask(mask), offset(hash & mask), width(width)
+    {
+    }
+
+    uint64_t ProbeSequence::getOffset() const
     {
         return offset;
     }
 
-    uint64_t ProbeSequence::getOffset(uint64_t index) const 
+    uint64_t ProbeSequence::getOffset(uint64_t index) const
     {
         return (offset + index) & mask;
     }
 
     //This is based on a based-0 index.
-    uint64_t ProbeSequence::getIndex() const 
+    uint64_t ProbeSequence::getIndex() const
     {
         return index;
     }
 
-    void ProbeSequence::next() 
+    void ProbeSequence::next()
     {
-        index += WIDTH;
+        index += width;
         offset += index;
         offset &= mask;
     }
 
-    GroupSse2Impl::GroupSse2Impl(const int8_t* pos) 
+#if AIR_HASH_MAP_X86
+    GroupSse2Impl::GroupSse2Impl(const int8_t* pos)
     {
         control = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
     }
 
-    uint32_t GroupSse2Impl::countLeadingEmptyOrDeleted() const 
+    uint32_t GroupSse2Impl::countLeadingEmptyOrDeleted() const
     {
         auto special = _mm_set1_epi8(CONTROL_BITMASK_SENTINEL);
         return trailingZerosU32(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(special, control)) + 1));
@@ -48,19 +139,20 @@ namespace Air
         auto msbs = _mm_set1_epi8(static_cast<char>(-128));
         auto x126 = _mm_set1_epi8(126);
 
+#if defined(_MSC_VER) || defined(__SSSE3__)
         if (SSSE3_SUPPORT)
         {
             auto res = _mm_or_si128(_mm_shuffle_epi8(x126, control), msbs);
 
             _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), res);
+            return;
         }
-        else
-        {
-            auto zero = _mm_setzero_si128();
-            auto specialMask = _mm_cmpgt_epi8(zero, control);
-            auto res = _mm_or_si128(msbs, _mm_andnot_si128(specialMask, x126));
+#endif
+        auto zero = _mm_setzero_si128();
+        auto specialMask = _mm_cmpgt_epi8(zero, control);
+        auto res = _mm_or_si128(msbs, _mm_andnot_si128(specialMask, x126));
 
-            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), res);
-        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), res);
     }
-}
\ No newline at end of file
+#endif
+}
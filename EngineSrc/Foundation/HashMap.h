@@ -3,34 +3,56 @@
 
 #include "Memory.h"
 #include "Bit.h"
+#include "String.h"
+#include "Assert.h"
 
-#if defined(_MSC_VER)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AIR_HASH_MAP_X86 1
 #include <immintrin.h>
+#if defined(_MSC_VER)
 #include <intrin0.h>
 #endif
+#else
+#define AIR_HASH_MAP_X86 0
+#endif
 
-#include "wyhash.h"
-
+//GCC and Clang only let a function use AVX2 intrinsics when it is built for AVX2, MSVC allows them anywhere.
+//Without -mavx2 the AVX2 group functions can't be inlined into the map, so build for AVX2 to see its real speed.
 #if defined(_MSC_VER)
-    //  Windows
-#include <Windows.h>
-    static bool SSSE3_SUPPORT = IsProcessorFeaturePresent(PF_SSSE3_INSTRUCTIONS_AVAILABLE);
+#define AIR_TARGET_AVX2
 #else
-    //  GCC Intrinsics
-#include <cpuid.h>
-static void cpuid(int info[4], int InfoType)
-{
-    __cpuid_count(InfoType, 0, info[0], info[1], info[2], info[3]);
-}
+#define AIR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#include <string.h>
+#include <type_traits>
 
-int info[4];
-cpuid(info, 0);
-int nIds = info[0];
+#include "wyhash.h"
 
-cpuid(info, 0x80000000);
-unsigned nExIds = info[0];
+namespace Air
+{
+    struct HashMapCpuFeatures
+    {
+        bool sse2 = false;
+        bool ssse3 = false;
+        //Also checks the OS saves the YMM registers.
+        bool avx2 = false;
+    };
 
-static bool SSSE3_SUPPORT = (info[2] & ((int)1 << 9)) != 0;
+    //Runs CPUID the first time it is called and keeps the answer.
+    const HashMapCpuFeatures& hashMapCpuFeatures();
+}
+
+#if defined(_MSC_VER)
+    static const bool SSSE3_SUPPORT = Air::hashMapCpuFeatures().ssse3;
+#else
+    //GCC and Clang only let us use the SSSE3 intrinsics when the whole file is built for SSSE3,
+    //so there is nothing to detect at runtime.
+#if defined(__SSSE3__)
+    static constexpr bool SSSE3_SUPPORT = true;
+#else
+    static constexpr bool SSSE3_SUPPORT = false;
+#endif
 #endif
 
 namespace 
@@ -54,7 +76,8 @@ namespace
 
     uint64_t hashSeed(const int8_t* control) { return reinterpret_cast<uintptr_t>(control) >> 12; }
 
-    uint64_t hash1(uint64_t hash, const int8_t* control) { return (hash >> 7) ^ hashSeed(control); }
+    uint64_t hash1(uint64_t hash, uint64_t seed) { return (hash >> 7) ^ seed; }
+    uint64_t hash1(uint64_t hash, const int8_t* control) { return hash1(hash, hashSeed(control)); }
     int8_t hash2(uint64_t hash) { return hash & 0x7F; }
 
     bool capacityIsValid(size_t n) { return ((n + 1) & n) == 0 && n > 0; }
@@ -84,19 +107,42 @@ namespace
     //Give 'capacity' of the table, returns the size (i.e. number of full slots) at which we should grow the capacity.
     //if (Group::WIDTH == 8 && capacity == 7) { return 6; }
     //x - x / 8 does not work when x == 7
-    uint64_t capacityToGrowth(uint64_t capacity) { return capacity - capacity / 8; }
-    uint64_t capacityGrowthToLowerBound(uint64_t growth) { return growth + static_cast<uint64_t>((static_cast<int64_t>(growth) - 1) / 7); }
+    //A group as wide as the whole table always sees the empty bytes past the clones, a narrower one needs a real empty slot.
+    uint64_t capacityToGrowth(uint64_t capacity, uint64_t groupWidth)
+    {
+        if (groupWidth == 8 && capacity == 7)
+        {
+            return 6;
+        }
+        return capacity - capacity / 8;
+    }
 
+    uint64_t capacityGrowthToLowerBound(uint64_t growth, uint64_t groupWidth)
+    {
+        if (groupWidth == 8 && growth == 7)
+        {
+            return 8;
+        }
+        return growth + static_cast<uint64_t>((static_cast<int64_t>(growth) - 1) / 7);
+    }
+
+    //Big enough for the widest group to read from an empty map.
     int8_t* groupInitEmpty()
     {
-        alignas(16) static constexpr int8_t emptyGroup[] =
+        alignas(32) static constexpr int8_t emptyGroup[] =
         {
             CONTROL_BITMASK_SENTINEL,
             CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
             CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
             CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
             CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
-            CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY
+            CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
+            CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
+            CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
+            CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
+            CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
+            CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY, CONTROL_BITMASK_EMPTY,
+            CONTROL_BITMASK_EMPTY
         };
 
         return const_cast<int8_t*>(emptyGroup);
@@ -114,11 +160,22 @@ namespace
         return wyhash(value, strlen(value), seed, _wyp);
     }
 
-    uint64_t hashCalculate(const char*& value, size_t seed)
+    //Strings hash their characters, not the pointer, so the same text always finds the same entry.
+    uint64_t hashCalculate(const char* value, size_t seed = 0)
     {
         return wyhash(value, strlen(value), seed, _wyp);
     }
 
+    uint64_t hashCalculate(char* value, size_t seed = 0)
+    {
+        return wyhash(value, strlen(value), seed, _wyp);
+    }
+
+    uint64_t hashCalculate(const Air::StringView& value, size_t seed = 0)
+    {
+        return wyhash(value.text, value.length, seed, _wyp);
+    }
+
     uint64_t hashBytes(void* data, size_t lenght, size_t seed = 0)
     {
         return wyhash(data, lenght, seed, _wyp);
@@ -129,6 +186,17 @@ namespace
 
 namespace Air
 {
+    //A group is a window of control bytes that can be checked in one go. The map is templated on the group so the
+    //width can be picked at compile time, hashMapDispatchGroup picks between them at runtime.
+    //Every group has the same interface:
+    //  WIDTH
+    //  match(hash)                         slots whose control byte is hash, may have false positives for the portable group
+    //  matchEmpty()
+    //  matchEmptyOrDeleted()
+    //  countLeadingEmptyOrDeleted()        how many empty or deleted slots come before the first full or sentinel one
+    //  convertSpecialToEmptyAndFullToDelete(destination)
+
+#if AIR_HASH_MAP_X86
     struct GroupSse2Impl
     {
         static constexpr size_t WIDTH = 16;
@@ -144,14 +212,13 @@ namespace Air
         //Returns a bitmask representing the position of empty slots.
         BitMask<uint32_t, WIDTH> matchEmpty() const
         {
+#if defined(_MSC_VER) || defined(__SSSE3__)
             if (SSSE3_SUPPORT)
             {
                 return BitMask<uint32_t, WIDTH>(_mm_movemask_epi8(_mm_sign_epi8(control, control)));
             }
-            else
-            {
-                return match(static_cast<int8_t>(CONTROL_BITMASK_EMPTY));
-            }
+#endif
+            return match(static_cast<int8_t>(CONTROL_BITMASK_EMPTY));
         }
 
         BitMask<uint32_t, WIDTH> matchEmptyOrDeleted() const
@@ -167,14 +234,155 @@ namespace Air
         __m128i control;
     };
 
+    //Twice the SSE2 group, so a probe covers 32 slots before moving on. Only use it when hashMapCpuFeatures().avx2 is set.
+    struct GroupAvx2Impl
+    {
+        static constexpr size_t WIDTH = 32;
+
+        AIR_TARGET_AVX2 explicit GroupAvx2Impl(const int8_t* pos)
+        {
+            control = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        }
+
+        AIR_TARGET_AVX2 BitMask<uint32_t, WIDTH> match(int8_t hash) const
+        {
+            auto match = _mm256_set1_epi8(hash);
+            return BitMask<uint32_t, WIDTH>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(match, control))));
+        }
+
+        AIR_TARGET_AVX2 BitMask<uint32_t, WIDTH> matchEmpty() const
+        {
+            return BitMask<uint32_t, WIDTH>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_sign_epi8(control, control))));
+        }
+
+        AIR_TARGET_AVX2 BitMask<uint32_t, WIDTH> matchEmptyOrDeleted() const
+        {
+            auto special = _mm256_set1_epi8(CONTROL_BITMASK_SENTINEL);
+            return BitMask<uint32_t, WIDTH>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(special, control))));
+        }
+
+        AIR_TARGET_AVX2 uint32_t countLeadingEmptyOrDeleted() const
+        {
+            auto special = _mm256_set1_epi8(CONTROL_BITMASK_SENTINEL);
+            //All 32 set wraps to 0, which counts as 32.
+            return trailingZerosU32(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(special, control))) + 1);
+        }
+
+        AIR_TARGET_AVX2 void convertSpecialToEmptyAndFullToDelete(int8_t* destination) const
+        {
+            auto msbs = _mm256_set1_epi8(static_cast<char>(-128));
+            auto x126 = _mm256_set1_epi8(126);
+            auto res = _mm256_or_si256(_mm256_shuffle_epi8(x126, control), msbs);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), res);
+        }
+
+        __m256i control;
+    };
+#endif
+
+    //Plain 64 bit arithmetic over 8 control bytes, for targets without SSE2. The masks have one bit per byte at the top
+    //of the byte, so they are BitMask<uint64_t, 8, 3>.
+    struct GroupPortableImpl
+    {
+        static constexpr size_t WIDTH = 8;
+
+        explicit GroupPortableImpl(const int8_t* pos)
+        {
+            memcpy(&control, pos, sizeof(control));
+        }
+
+        //Can report a byte just above a real match as matching too, the key comparison weeds those out.
+        BitMask<uint64_t, WIDTH, 3> match(int8_t hash) const
+        {
+            constexpr uint64_t msbs = 0x8080808080808080ull;
+            constexpr uint64_t lsbs = 0x0101010101010101ull;
+            const uint64_t x = control ^ (lsbs * static_cast<uint8_t>(hash));
+            return BitMask<uint64_t, WIDTH, 3>((x - lsbs) & ~x & msbs);
+        }
+
+        BitMask<uint64_t, WIDTH, 3> matchEmpty() const
+        {
+            constexpr uint64_t msbs = 0x8080808080808080ull;
+            return BitMask<uint64_t, WIDTH, 3>((control & ~(control << 6)) & msbs);
+        }
+
+        BitMask<uint64_t, WIDTH, 3> matchEmptyOrDeleted() const
+        {
+            constexpr uint64_t msbs = 0x8080808080808080ull;
+            return BitMask<uint64_t, WIDTH, 3>((control & ~(control << 7)) & msbs);
+        }
+
+        uint32_t countLeadingEmptyOrDeleted() const
+        {
+            constexpr uint64_t gaps = 0x00FEFEFEFEFEFEFEull;
+            return static_cast<uint32_t>((trailingZerosU64(((~control & (control >> 7)) | gaps) + 1) + 7) >> 3);
+        }
+
+        void convertSpecialToEmptyAndFullToDelete(int8_t* destination) const
+        {
+            constexpr uint64_t msbs = 0x8080808080808080ull;
+            constexpr uint64_t lsbs = 0x0101010101010101ull;
+            const uint64_t x = control & msbs;
+            const uint64_t result = (~x + (x >> 7)) & ~lsbs;
+            memcpy(destination, &result, sizeof(result));
+        }
+
+        uint64_t control;
+    };
+
+    //Compile time default. SSE2 is in every x86-64 CPU, the wider AVX2 group has to be asked for.
+#if AIR_HASH_MAP_X86
+    using HashMapGroup = GroupSse2Impl;
+#else
+    using HashMapGroup = GroupPortableImpl;
+#endif
+
+    enum HashMapGroupKind : uint8_t
+    {
+        HASH_MAP_GROUP_PORTABLE = 0,
+        HASH_MAP_GROUP_SSE2,
+        HASH_MAP_GROUP_AVX2,
+    };
+
+    //Widest group the CPU running us supports.
+    HashMapGroupKind hashMapBestGroup();
+    const char* hashMapGroupName(HashMapGroupKind kind);
+
+    template<typename Group>
+    struct HashMapGroupTag
+    {
+        using Type = Group;
+    };
+
+    //Calls function(HashMapGroupTag<Group>{}) with the group type for kind, so a system can pick its map type once at
+    //startup from hashMapBestGroup(). Kinds this build or CPU can't do fall back to the next narrower group.
+    template<typename Function>
+    decltype(auto) hashMapDispatchGroup(HashMapGroupKind kind, Function function)
+    {
+#if AIR_HASH_MAP_X86
+        if (kind == HASH_MAP_GROUP_AVX2 && hashMapCpuFeatures().avx2)
+        {
+            return function(HashMapGroupTag<GroupAvx2Impl>{});
+        }
+        if (kind != HASH_MAP_GROUP_PORTABLE)
+        {
+            return function(HashMapGroupTag<GroupSse2Impl>{});
+        }
+#endif
+        return function(HashMapGroupTag<GroupPortableImpl>{});
+    }
+
+    template<typename Group>
     static void convertDeletedToEmptyAndFullToDeleted(int8_t* control, size_t capacity)
     {
-        for (int8_t* pos = control; pos != control + capacity + 1; pos += GroupSse2Impl::WIDTH)
+        //Tables smaller than a group still get one whole group converted, the bytes past the clones are all empty anyway.
+        for (int8_t* pos = control; pos < control + capacity; pos += Group::WIDTH)
         {
-            GroupSse2Impl{ pos }.convertSpecialToEmptyAndFullToDelete(pos);
+            Group{ pos }.convertSpecialToEmptyAndFullToDelete(pos);
         }
 
-        memoryCopy(control + capacity + 1, control, GroupSse2Impl::WIDTH);
+        //Only WIDTH - 1 bytes are cloned after the sentinel.
+        memoryCopy(control + capacity + 1, control, Group::WIDTH - 1);
         control[capacity] = CONTROL_BITMASK_SENTINEL;
     }
 
@@ -201,11 +409,10 @@ namespace Air
 
     struct ProbeSequence 
     {
-        //This might need to be selectable.
-        static const uint64_t WIDTH = 16;
         static const size_t ENGINE_HASH = 0x31D3A36013A;
 
-        ProbeSequence(uint64_t hash, uint64_t mask);
+        //width is the group width, every step moves one more group along than the step before.
+        ProbeSequence(uint64_t hash, uint64_t mask, uint64_t width);
 
         uint64_t getOffset() const;
         uint64_t getOffset(uint64_t index) const;
@@ -217,23 +424,210 @@ namespace Air
 
         uint64_t mask;
         uint64_t offset;
+        uint64_t width;
         uint64_t index = 0;
     };
 
+    //Default FlatHashMap hasher. Strings are hashed by their characters so const char* and StringView keys mix.
+    struct HashMapHasher
+    {
+        template<typename T>
+        static uint64_t hash(const T& value)
+        {
+            return hashCalculate(value);
+        }
+
+        static uint64_t hash(const char* value)
+        {
+            return hashCalculate(value);
+        }
+
+        static uint64_t hash(const StringView& value)
+        {
+            return hashCalculate(value);
+        }
+    };
+
+    //For keys that already are good 64 bit hashes, like hashed names, so they don't get hashed a second time.
+    struct HashMapIdentityHasher
+    {
+        static uint64_t hash(uint64_t value)
+        {
+            return value;
+        }
+    };
+
+    template<typename K, typename Q>
+    bool hashKeyEquals(const K& key, const Q& query)
+    {
+        return key == query;
+    }
+
+    inline bool hashKeyEquals(const char* key, const char* query)
+    {
+        return strcmp(key, query) == 0;
+    }
+
+    inline bool hashKeyEquals(const char* key, const StringView& query)
+    {
+        return strncmp(key, query.text, query.length) == 0 && key[query.length] == 0;
+    }
+
+    inline bool hashKeyEquals(const StringView& key, const StringView& query)
+    {
+        return StringView::equals(key, query);
+    }
+
+    inline bool hashKeyEquals(const StringView& key, const char* query)
+    {
+        return hashKeyEquals(query, key);
+    }
+
+    //Query types that hash and compare the same as the key type, so find doesn't need to build a K first.
+    //Anything else goes through find(const K&) so for example an int query can't hash differently to a uint64_t key.
+    template<typename K, typename Q>
+    struct HashMapHeterogeneous
+    {
+        static constexpr bool value = false;
+    };
+
+    template<>
+    struct HashMapHeterogeneous<const char*, StringView>
+    {
+        static constexpr bool value = true;
+    };
+
+    template<>
+    struct HashMapHeterogeneous<StringView, const char*>
+    {
+        static constexpr bool value = true;
+    };
+
+    template<>
+    struct HashMapHeterogeneous<StringView, char*>
+    {
+        static constexpr bool value = true;
+    };
+
+    //Value type of a FlatHashSet, nothing is stored for it.
+    struct HashSetNoValue
+    {
+    };
+
     template<typename K, typename V>
-    struct FlatHashMap
+    struct HashMapSlot
+    {
+        K key;
+        V value;
+    };
+
+    //A set's slot is just the key. value is static so the map code that reads and writes it still compiles,
+    //every slot shares the one empty value.
+    template<typename K>
+    struct HashMapSlot<K, HashSetNoValue>
+    {
+        K key;
+        inline static HashSetNoValue value;
+    };
+
+    static_assert(sizeof(HashMapSlot<uint64_t, HashSetNoValue>) == sizeof(uint64_t), "Set slots shouldn't pay for a value.");
+
+    //How many keys the batch functions hash and prefetch ahead of probing. Enough to cover a trip to memory
+    //without the prefetches pushing each other out of L1.
+    static constexpr uint32_t HASH_MAP_BATCH_SIZE = 16;
+
+    //Incremental compaction starts a cycle once more than 1 / this of the slots are tombstones.
+    static constexpr uint64_t HASH_MAP_COMPACTION_TOMBSTONE_FRACTION = 16;
+
+    inline void hashMapPrefetch(const void* address)
+    {
+#if AIR_HASH_MAP_X86
+        _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0);
+#else
+        __builtin_prefetch(address);
+#endif
+    }
+
+    //Looks a key up in a table laid out the way FlatHashMap lays it out, returns its slot index or ITERATOR_END.
+    //seed is hashSeed of the control bytes the table was built in, which stays the same when the table is copied.
+    template<typename Group, typename KeyValue, typename Equal>
+    inline uint64_t hashMapFindInTable(uint64_t hash, uint64_t seed, Equal equal, const int8_t* controlBytes, const KeyValue* slots, uint64_t capacity)
     {
-        struct KeyValue
+        ProbeSequence sequence(hash1(hash, seed), capacity, Group::WIDTH);
+        const int8_t hash2Result = hash2(hash);
+
+        while (true)
         {
-            K key;
-            V value;
-        };
+            const Group group{ controlBytes + sequence.getOffset() };
+            for (uint32_t i : group.match(hash2Result))
+            {
+                const uint64_t index = sequence.getOffset(i);
+                if (equal(slots[index].key))
+                {
+                    return index;
+                }
+            }
+
+            //An empty slot means the key would have been put here, probing further can't find it.
+            if (group.matchEmpty())
+            {
+                break;
+            }
+
+            sequence.next();
+            AIR_ASSERTM(sequence.getIndex() <= capacity, "Probed the whole hash map without finding an empty slot.");
+        }
+
+        return ITERATOR_END;
+    }
+
+    //How healthy a FlatHashMap is. Probe lengths count the groups a lookup of an entry has to look at past the first,
+    //so 0 means every entry sits in the group its hash points at.
+    struct FlatHashMapStats
+    {
+        uint64_t size = 0;
+        uint64_t capacity = 0;
+        uint64_t groupWidth = 0;
+        uint64_t tombstones = 0;
+
+        double loadFactor = 0.0;
+        //Deleted slots over capacity. They slow down misses like full slots do and only go away on a rehash.
+        double tombstoneRatio = 0.0;
+
+        double averageProbeLength = 0.0;
+        uint64_t maxProbeLength = 0;
+
+        //Rehashes that grew the table and ones that only squashed tombstones.
+        uint64_t growRehashCount = 0;
+        uint64_t inPlaceRehashCount = 0;
+        //Average probe length right after the last rehash, how far averageProbeLength has drifted from it shows how
+        //much the table has degraded since.
+        double averageProbeLengthAtRehash = 0.0;
+
+        //Most old table slots one operation has walked during an incremental resize, see setIncrementalResize.
+        uint64_t resizeLargestStep = 0;
+    };
+
+    template<typename K, typename V, typename Hasher = HashMapHasher, typename Group = HashMapGroup>
+    struct FlatHashMap
+    {
+        using KeyValue = HashMapSlot<K, V>;
 
         void init(Allocator* alloc, uint64_t initialCapacity)
         {
             allocator = alloc;
             size = capacity = growthLeft = 0;
-            defaultKeyValue = { (K)-1, (V)0 };
+            growRehashCount = inPlaceRehashCount = 0;
+            rehashProbeLength = rehashSize = 0;
+            tombstones = compactionCursor = 0;
+            compactionMarks = nullptr;
+            compactionSlotsPerInsert = 0;
+            compactionSweeping = false;
+            resizeControlBytes = nullptr;
+            resizeSlots = nullptr;
+            resizeCapacity = resizeCursor = resizeLargestStep = 0;
+            resizeGroupsPerOperation = 0;
+            defaultKeyValue = makeDefaultKeyValue();
 
             controlBytes = groupInitEmpty();
             slots = nullptr;
@@ -242,41 +636,134 @@ namespace Air
 
         void shutdown()
         {
-            air_free(controlBytes, allocator);
+            compactionReset();
+            resizeFreeOldTable();
+
+            //An empty map still points at the shared static group.
+            if (capacity)
+            {
+                air_free(controlBytes, allocator);
+            }
+
+            controlBytes = groupInitEmpty();
+            slots = nullptr;
+            size = capacity = growthLeft = 0;
         }
 
         FlatHashMapIterator find(const K& key)
         {
-            const uint64_t hash = hashCalculate(key);
-            ProbeSequence sequence = probe(hash);
+            return findByHash(Hasher::hash(key), [&](const K& slotKey) { return hashKeyEquals(slotKey, key); });
+        }
 
-            while (true)
+        //Looks up with something that isn't a K, like a StringView into a map of interned const char* keys.
+        template<typename Q>
+            requires HashMapHeterogeneous<K, Q>::value
+        FlatHashMapIterator find(const Q& query)
+        {
+            return findByHash(Hasher::hash(query), [&](const K& slotKey) { return hashKeyEquals(slotKey, query); });
+        }
+
+        //hash has to be what the map's Hasher gives for the key, equal(const K&) picks the entry out of the ones sharing it.
+        //Lets callers hash once and reuse it for several lookups or a find followed by an insert.
+        template<typename Equal>
+        FlatHashMapIterator findByHash(uint64_t hash, Equal equal)
+        {
+            if (resizeControlBytes)
+            {
+                return findByHashResizing(hash, equal);
+            }
+
+            return { findInTable(hash, equal, controlBytes, slots, capacity) };
+        }
+
+        //Returns the slot index in the given table or ITERATOR_END. Only differs from the current table while an
+        //incremental resize still has entries in the old one.
+        template<typename Equal>
+        uint64_t findInTable(uint64_t hash, Equal equal, const int8_t* tableControlBytes, const KeyValue* tableSlots, uint64_t tableCapacity)
+        {
+            return hashMapFindInTable<Group>(hash, hashSeed(tableControlBytes), equal, tableControlBytes, tableSlots, tableCapacity);
+        }
+
+        //Every lookup, insert and remove moves the next few old groups over first. An entry found in the old table
+        //is moved straight away, so the iterator handed back always points into the new one.
+        template<typename Equal>
+        FlatHashMapIterator findByHashResizing(uint64_t hash, Equal equal)
+        {
+            uint64_t walked = resizeStep((uint64_t)resizeGroupsPerOperation * Group::WIDTH);
+
+            uint64_t index = findInTable(hash, equal, controlBytes, slots, capacity);
+            if (index == ITERATOR_END && resizeControlBytes)
             {
-                const GroupSse2Impl group{ controlBytes + sequence.getOffset() };
-                const int8_t hash2Result = hash2(hash);
-                for (int i : group.match(hash2Result))
+                const uint64_t oldIndex = findInTable(hash, equal, resizeControlBytes, resizeSlots, resizeCapacity);
+                if (oldIndex != ITERATOR_END)
                 {
-                    const KeyValue& keyValue = *(slots + sequence.getOffset(i));
-                    if (keyValue.key == key)
-                    {
-                        return { sequence.getOffset(i) };
-                    }
+                    index = resizeMoveEntry(oldIndex, hash);
+                    ++walked;
                 }
+            }
 
-                if (group.matchEmpty())
+            resizeLargestStep = walked > resizeLargestStep ? walked : resizeLargestStep;
+            return { index };
+        }
+
+        void insert(const K& key, const V& value)
+        {
+            insertByHash(Hasher::hash(key), key, value);
+        }
+
+        //Same as calling find on each key, results[i] is the iterator for keys[i]. The keys are hashed a batch at a
+        //time and their first groups and slots prefetched before any probing, so the cache misses overlap instead
+        //of each lookup waiting for the last.
+        void findBatch(const K* keys, uint64_t count, FlatHashMapIterator* results)
+        {
+            uint64_t hashes[HASH_MAP_BATCH_SIZE];
+            for (uint64_t first = 0; first < count; first += HASH_MAP_BATCH_SIZE)
+            {
+                const uint64_t batch = count - first < HASH_MAP_BATCH_SIZE ? count - first : HASH_MAP_BATCH_SIZE;
+                prefetchBatch(keys + first, batch, hashes);
+
+                for (uint64_t i = 0; i < batch; ++i)
                 {
-                    break;
+                    const K& key = keys[first + i];
+                    results[first + i] = findByHash(hashes[i], [&](const K& slotKey) { return hashKeyEquals(slotKey, key); });
                 }
+            }
+        }
 
-                sequence.next();
+        //Same as calling insert on each pair in order, so a key repeated in the batch ends up with its last value.
+        //Reserves room for every key up front so nothing rehashes under the prefetched addresses.
+        void insertBatch(const K* keys, const V* values, uint64_t count)
+        {
+            reserve(size + count);
+
+            uint64_t hashes[HASH_MAP_BATCH_SIZE];
+            for (uint64_t first = 0; first < count; first += HASH_MAP_BATCH_SIZE)
+            {
+                const uint64_t batch = count - first < HASH_MAP_BATCH_SIZE ? count - first : HASH_MAP_BATCH_SIZE;
+                prefetchBatch(keys + first, batch, hashes);
+
+                for (uint64_t i = 0; i < batch; ++i)
+                {
+                    insertByHash(hashes[i], keys[first + i], values[first + i]);
+                }
             }
+        }
 
-            return { ITERATOR_END };
+        void prefetchBatch(const K* keys, uint64_t count, uint64_t* hashes)
+        {
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                hashes[i] = Hasher::hash(keys[i]);
+                const uint64_t offset = probe(hashes[i]).getOffset();
+                hashMapPrefetch(controlBytes + offset);
+                hashMapPrefetch(slots + offset);
+            }
         }
 
-        void insert(const K& key, const V& value)
+        //hash has to be what the map's Hasher gives for key.
+        void insertByHash(uint64_t hash, const K& key, const V& value)
         {
-            const FindResult findResult = findOrPrepareInsert(key);
+            const FindResult findResult = findOrPrepareInsertByHash(hash, [&](const K& slotKey) { return hashKeyEquals(slotKey, key); });
             if (findResult.freeIndex)
             {
                 //Emplace
@@ -338,9 +825,65 @@ namespace Air
             defaultKeyValue.value = value;
         }
 
+        //Walks every slot and rehashes every key, so it costs about as much as iterating the map. Fine to poll now
+        //and then from a long running session, not something for every frame. Finishes a running incremental resize
+        //first so the numbers cover every entry.
+        FlatHashMapStats getStats()
+        {
+            finishResize();
+
+            FlatHashMapStats stats;
+            stats.size = size;
+            stats.capacity = capacity;
+            stats.groupWidth = Group::WIDTH;
+            stats.growRehashCount = growRehashCount;
+            stats.inPlaceRehashCount = inPlaceRehashCount;
+            stats.averageProbeLengthAtRehash = rehashSize ? (double)rehashProbeLength / rehashSize : 0.0;
+            stats.resizeLargestStep = resizeLargestStep;
+
+            uint64_t totalProbeLength = 0;
+            for (uint64_t i = 0; i < capacity; ++i)
+            {
+                if (controlIsDeleted(controlBytes[i]))
+                {
+                    ++stats.tombstones;
+                }
+                else if (controlIsFull(controlBytes[i]))
+                {
+                    const uint64_t probeLength = probeLengthOf(Hasher::hash(slots[i].key), i);
+                    totalProbeLength += probeLength;
+                    stats.maxProbeLength = probeLength > stats.maxProbeLength ? probeLength : stats.maxProbeLength;
+                }
+            }
+
+            if (capacity)
+            {
+                stats.loadFactor = (double)size / capacity;
+                stats.tombstoneRatio = (double)stats.tombstones / capacity;
+            }
+            stats.averageProbeLength = size ? (double)totalProbeLength / size : 0.0;
+            return stats;
+        }
+
+        //How many groups past the first a lookup for hash walks before reaching the group holding index.
+        uint64_t probeLengthOf(uint64_t hash, uint64_t index)
+        {
+            ProbeSequence sequence = probe(hash);
+            uint64_t groups = 0;
+            while (((index - sequence.getOffset()) & capacity) >= Group::WIDTH)
+            {
+                sequence.next();
+                ++groups;
+            }
+            return groups;
+        }
+
         //Iterators
+        //Iterators only walk the current table, so a running incremental resize is finished first.
         FlatHashMapIterator iteratorBegin()
         {
+            finishResize();
+
             FlatHashMapIterator it{ 0 };
             iteratorSkipEmptyOrDeleted(it);
             return it;
@@ -354,6 +897,7 @@ namespace Air
 
         void clear()
         {
+            resizeFreeOldTable();
             size = 0;
             resetControl();
             resetGrowthLeft();
@@ -363,7 +907,12 @@ namespace Air
         {
             if (newSize > size + growthLeft)
             {
-                size_t m = capacityGrowthToLowerBound(newSize);
+                finishResize();
+            }
+
+            if (newSize > size + growthLeft)
+            {
+                size_t m = capacityGrowthToLowerBound(newSize, Group::WIDTH);
                 resize(capacityNormalise(m));
             }
         }
@@ -373,9 +922,20 @@ namespace Air
             --size;
 
             const uint64_t index = iterator.index;
-            const uint64_t indexBefore = (index - GroupSse2Impl::WIDTH) & capacity;
-            const auto emptyAfter = GroupSse2Impl(controlBytes + index).matchEmpty();
-            const auto emptyBefore = GroupSse2Impl(controlBytes + indexBefore).matchEmpty();
+            const bool wasNeverFull = canBeEmpty(index);
+
+            setControl(index, wasNeverFull ? CONTROL_BITMASK_EMPTY : CONTROL_BITMASK_DELETED);
+            growthLeft += wasNeverFull;
+            tombstones += wasNeverFull ? 0 : 1;
+        }
+
+        //Whether the non empty slot at index can be marked empty without cutting a probe sequence short. True when
+        //every group wide window over index has another empty slot, so no lookup can have walked through it.
+        bool canBeEmpty(uint64_t index)
+        {
+            const uint64_t indexBefore = (index - Group::WIDTH) & capacity;
+            const auto emptyAfter = Group(controlBytes + index).matchEmpty();
+            const auto emptyBefore = Group(controlBytes + indexBefore).matchEmpty();
 
             //We count how many consecutive non empty things we have to the right and to the left of 'it'.
             //If the sum is >= WIDTH then there is at least one probe window that might have seen a full group.
@@ -383,37 +943,173 @@ namespace Air
             const uint64_t leadingZeros = emptyBefore.leadingZeros();
             const uint64_t zeros = trailingZeros + leadingZeros;
             bool wasNeverFull = emptyBefore && emptyAfter;
-            wasNeverFull = wasNeverFull && (zeros < GroupSse2Impl::WIDTH);
+            return wasNeverFull && (zeros < Group::WIDTH);
+        }
 
-            setControl(index, wasNeverFull ? CONTROL_BITMASK_EMPTY : CONTROL_BITMASK_DELETED);
-            growthLeft += wasNeverFull;
+        //Each insert that adds an entry first does compactStep(slotsPerInsert), so tombstones are cleaned up a little
+        //at a time instead of all at once when the map runs out of growth. 0 turns it off. Only inserts do the work,
+        //so removing entries while iterating stays safe.
+        void setIncrementalCompaction(uint32_t slotsPerInsert)
+        {
+            compactionSlotsPerInsert = slotsPerInsert;
         }
 
-        FindResult findOrPrepareInsert(const K& key)
+        //A tombstone only has to stay if some entry's lookup walks through a group over it to reach a later group.
+        //Those entries are rare, so a compaction cycle runs in two passes over the table, slotCount slots per step:
+        //  mark:  moves displaced entries back into tombstones earlier on their probe sequence, then marks every slot
+        //         under a group the entry still has to walk through. Inserts made during the cycle mark theirs too.
+        //  sweep: every tombstone that isn't marked becomes empty.
+        //Moves entries, so like insert it invalidates iterators. A rehash or clear during the cycle ends it.
+        void compactStep(uint64_t slotCount)
         {
-            uint64_t hash = hashCalculate(key);
-            ProbeSequence sequence = probe(hash);
+            //Tombstones in the old table go away with it, the new one starts without any.
+            if (resizeControlBytes)
+            {
+                return;
+            }
 
-            while (true)
+            if (compactionMarks == nullptr)
+            {
+                //A few tombstones cost less than the passes to find them.
+                if (tombstones * HASH_MAP_COMPACTION_TOMBSTONE_FRACTION <= capacity)
+                {
+                    return;
+                }
+
+                const uint64_t words = (capacity + 63) / 64;
+                compactionMarks = (uint64_t*)air_allocaa(words * sizeof(uint64_t), allocator, alignof(uint64_t));
+                memset(compactionMarks, 0, words * sizeof(uint64_t));
+                compactionCursor = 0;
+                compactionSweeping = false;
+            }
+
+            for (uint64_t n = 0; n < slotCount; ++n)
             {
-                const GroupSse2Impl group{ controlBytes + sequence.getOffset() };
-                for (int i : group.match(hash2(hash)))
+                const uint64_t i = compactionCursor++;
+                if (compactionSweeping)
                 {
-                    const KeyValue& keyValue = *(slots + sequence.getOffset(i));
-                    if (keyValue.key == key)
+                    if (controlIsDeleted(controlBytes[i]) && (compactionMarks[i / 64] & (1ull << (i % 64))) == 0)
                     {
-                        return { sequence.getOffset(i), false };
+                        setControl(i, CONTROL_BITMASK_EMPTY);
+                        ++growthLeft;
+                        --tombstones;
                     }
+                }
+                else if (controlIsFull(controlBytes[i]))
+                {
+                    compactionMarkEntry(i);
+                }
 
-                    if (group.matchEmpty())
+                if (compactionCursor == capacity)
+                {
+                    compactionCursor = 0;
+                    if (compactionSweeping)
                     {
-                        break;
+                        compactionReset();
+                        return;
                     }
+                    compactionSweeping = true;
+                }
+            }
+        }
 
-                    sequence.next();
+        void compactionMarkEntry(uint64_t index)
+        {
+            const uint64_t hash = Hasher::hash(slots[index].key);
+            uint64_t probeLength = probeLengthOf(hash, index);
+            if (probeLength == 0)
+            {
+                return;
+            }
+
+            //Every group before the entry's has no empty slot or the lookup would have stopped there, so the first
+            //non full slot is either a tombstone earlier on or no better than where the entry is.
+            const FindInfo target = findFirstNonFull(hash);
+            if (target.probeLength / Group::WIDTH < probeLength && controlIsDeleted(controlBytes[target.offset]))
+            {
+                setControl(target.offset, hash2(hash));
+                memoryCopy(slots + target.offset, slots + index, sizeof(KeyValue));
+                setControl(index, CONTROL_BITMASK_DELETED);
+                index = target.offset;
+                probeLength = target.probeLength / Group::WIDTH;
+            }
+
+            compactionMarkProbe(hash, probeLength);
+        }
+
+        //Marks the slots under the first probeLength groups of hash's probe sequence.
+        void compactionMarkProbe(uint64_t hash, uint64_t probeLength)
+        {
+            ProbeSequence sequence = probe(hash);
+            for (uint64_t group = 0; group < probeLength; ++group)
+            {
+                for (uint64_t i = 0; i < Group::WIDTH; ++i)
+                {
+                    //The sentinel and the bytes cloned after it map back onto real slots or past the last one.
+                    const uint64_t slot = sequence.getOffset(i);
+                    if (slot < capacity)
+                    {
+                        compactionMarks[slot / 64] |= 1ull << (slot % 64);
+                    }
                 }
-                return { prepareInsert(hash), true };
+                sequence.next();
+            }
+        }
+
+        void compactionReset()
+        {
+            if (compactionMarks)
+            {
+                air_free(compactionMarks, allocator);
+                compactionMarks = nullptr;
+            }
+            compactionCursor = 0;
+            compactionSweeping = false;
+        }
+
+        //Rehashes in place to get rid of every tombstone. Keeps the same memory.
+        void compact()
+        {
+            finishResize();
+            if (tombstones)
+            {
+                dropDeletesWithoutResize();
+            }
+        }
+
+        //Moves the entries to the smallest table that holds them and gives the old memory back to the allocator.
+        //Also drops every tombstone.
+        void shrinkToFit()
+        {
+            finishResize();
+            const uint64_t newCapacity = capacityNormalise(capacityGrowthToLowerBound(size < 4 ? 4 : size, Group::WIDTH));
+            if (newCapacity < capacity)
+            {
+                resize(newCapacity);
+            }
+            else
+            {
+                compact();
+            }
+        }
+
+        FindResult findOrPrepareInsert(const K& key)
+        {
+            return findOrPrepareInsertByHash(Hasher::hash(key), [&](const K& slotKey) { return hashKeyEquals(slotKey, key); });
+        }
+
+        //Walks the whole probe sequence until a group with an empty slot before deciding the key isn't there,
+        //checking only the first group lets colliding keys be inserted twice.
+        template<typename Equal>
+        FindResult findOrPrepareInsertByHash(uint64_t hash, Equal equal)
+        {
+            const FlatHashMapIterator iterator = findByHash(hash, equal);
+            if (iterator.isValid())
+            {
+                return { iterator.index, false };
             }
+
+            return { prepareInsert(hash), true };
         }
 
         FindInfo findFirstNonFull(uint64_t hash)
@@ -422,7 +1118,7 @@ namespace Air
 
             while (true)
             {
-                const GroupSse2Impl group{ controlBytes + sequence.getOffset() };
+                const Group group{ controlBytes + sequence.getOffset() };
                 auto mask = group.matchEmptyOrDeleted();
 
                 if (mask)
@@ -438,6 +1134,11 @@ namespace Air
 
         uint64_t prepareInsert(uint64_t hash)
         {
+            if (compactionSlotsPerInsert && resizeControlBytes == nullptr)
+            {
+                compactStep(compactionSlotsPerInsert);
+            }
+
             FindInfo findInfo = findFirstNonFull(hash);
             if (growthLeft == 0 && !controlIsDeleted(controlBytes[findInfo.offset]))
             {
@@ -446,33 +1147,168 @@ namespace Air
             }
             ++size;
 
-            growthLeft -= controlIsEmpty(controlBytes[findInfo.offset]) ? 1 : 0;
+            //The tombstones this insert walked past now have to stay.
+            if (compactionMarks && findInfo.probeLength)
+            {
+                compactionMarkProbe(hash, findInfo.probeLength / Group::WIDTH);
+            }
+
+            if (controlIsEmpty(controlBytes[findInfo.offset]))
+            {
+                --growthLeft;
+            }
+            else
+            {
+                --tombstones;
+            }
             setControl(findInfo.offset, hash2(hash));
             return findInfo.offset;
         }
 
         ProbeSequence probe(uint64_t hash)
         {
-            return ProbeSequence(hash1(hash, controlBytes), capacity);
+            return ProbeSequence(hash1(hash, controlBytes), capacity, Group::WIDTH);
         }
 
         void rehashAndGrowIfNecessary()
         {
+            //Doubling leaves room for every old entry many times over before the new table fills, so this only
+            //happens when the old one was left alone for a long time.
+            if (resizeControlBytes)
+            {
+                finishResize();
+                if (growthLeft)
+                {
+                    return;
+                }
+            }
+
             if (capacity == 0)
             {
                 resize(1);
             }
-            else if (size <= capacityToGrowth(capacity) / 2)
+            else if (size <= capacityToGrowth(capacity, Group::WIDTH) / 2)
             {
                 //Squash delete without growing if there is enough capacity.
                 dropDeletesWithoutResize();
             }
+            else if (resizeGroupsPerOperation)
+            {
+                beginIncrementalResize(capacity * 2 + 1);
+            }
             else
             {
                 resize(capacity * 2 + 1);
             }
         }
 
+        //Growing moves every entry in one go, so the insert that triggers it takes as long as all the inserts since the
+        //last one together. With groupsPerOperation > 0 the map keeps the old table when it grows and every find,
+        //insert and remove moves groupsPerOperation of its groups across before doing its own work, looking in both
+        //tables until the old one is empty. 0 turns it off and finishes a resize that is still running.
+        //Lookups move entries too, so a map with this on can't be read from several threads at once.
+        void setIncrementalResize(uint32_t groupsPerOperation)
+        {
+            resizeGroupsPerOperation = groupsPerOperation;
+            if (groupsPerOperation == 0)
+            {
+                finishResize();
+            }
+        }
+
+        //Most old table slots a single operation walks while a resize is running, each moving at most one entry. The
+        //extra one is the entry a lookup pulls across when it finds it in the old table. The operation that starts a
+        //resize also allocates the new table and clears its control bytes. 0 when incremental resizing is off.
+        uint64_t resizeSlotsPerOperationBound() const
+        {
+            return resizeGroupsPerOperation ? (uint64_t)resizeGroupsPerOperation * Group::WIDTH + 1 : 0;
+        }
+
+        bool isResizing() const
+        {
+            return resizeControlBytes != nullptr;
+        }
+
+        //Moves whatever is left in the old table across now.
+        void finishResize()
+        {
+            if (resizeControlBytes)
+            {
+                resizeStep(resizeCapacity - resizeCursor);
+            }
+        }
+
+        //The new table's growth is worked out from the full size, so entries moved across don't count against it.
+        void beginIncrementalResize(uint64_t newCapacity)
+        {
+            resizeControlBytes = controlBytes;
+            resizeSlots = slots;
+            resizeCapacity = capacity;
+            resizeCursor = 0;
+
+            capacity = newCapacity;
+            initalisedSlots();
+
+            ++growRehashCount;
+            rehashProbeLength = rehashSize = 0;
+        }
+
+        //Walks up to slotCount old slots and returns how many it walked.
+        uint64_t resizeStep(uint64_t slotCount)
+        {
+            uint64_t walked = 0;
+            while (walked < slotCount && resizeControlBytes)
+            {
+                const uint64_t i = resizeCursor++;
+                ++walked;
+
+                if (controlIsFull(resizeControlBytes[i]))
+                {
+                    resizeMoveEntry(i, Hasher::hash(resizeSlots[i].key));
+                }
+
+                if (resizeCursor == resizeCapacity)
+                {
+                    resizeFreeOldTable();
+                }
+            }
+
+            return walked;
+        }
+
+        uint64_t resizeMoveEntry(uint64_t oldIndex, uint64_t hash)
+        {
+            const FindInfo target = findFirstNonFull(hash);
+            if (controlIsDeleted(controlBytes[target.offset]))
+            {
+                --tombstones;
+            }
+
+            setControl(target.offset, hash2(hash));
+            memoryCopy(slots + target.offset, resizeSlots + oldIndex, sizeof(KeyValue));
+
+            //Deleted rather than empty, lookups for keys further along the old probe sequence still have to walk past.
+            resizeControlBytes[oldIndex] = CONTROL_BITMASK_DELETED;
+            constexpr size_t clonedBytes = Group::WIDTH - 1;
+            resizeControlBytes[((oldIndex - clonedBytes) & resizeCapacity) + (clonedBytes & resizeCapacity)] = CONTROL_BITMASK_DELETED;
+
+            rehashProbeLength += target.probeLength / Group::WIDTH;
+            ++rehashSize;
+            return target.offset;
+        }
+
+        void resizeFreeOldTable()
+        {
+            if (resizeControlBytes)
+            {
+                air_free(resizeControlBytes, allocator);
+            }
+
+            resizeControlBytes = nullptr;
+            resizeSlots = nullptr;
+            resizeCapacity = resizeCursor = 0;
+        }
+
         void dropDeletesWithoutResize()
         {
             //This is the algorithm
@@ -492,6 +1328,8 @@ namespace Air
             //  mark target as full.
             //  repeat procedure for current with moved from element (target)
 
+            convertDeletedToEmptyAndFullToDeleted<Group>(controlBytes, capacity);
+
             alignas(KeyValue) unsigned char raw[sizeof(KeyValue)];
             size_t totalProbeLength = 0;
             KeyValue* slot = reinterpret_cast<KeyValue*>(&raw);
@@ -503,7 +1341,7 @@ namespace Air
                 }
 
                 const KeyValue* currentSlot = slots + i;
-                size_t hash = hashCalculate(currentSlot->key);
+                const uint64_t hash = Hasher::hash(currentSlot->key);
                 auto target = findFirstNonFull(hash);
                 size_t newi = target.offset;
                 totalProbeLength += target.probeLength;
@@ -512,7 +1350,7 @@ namespace Air
                 //If they do, we don't need to move the object as it falls already in the best probe we can.
                 const auto probeIndex = [&](size_t pos)
                     {
-                        return ((pos - probe(hash).getOffset()) & capacity) / GroupSse2Impl::WIDTH;
+                        return ((pos - probe(hash).getOffset()) & capacity) / Group::WIDTH;
                     };
 
                 //Element doesn't move.
@@ -542,19 +1380,31 @@ namespace Air
             }
 
             resetGrowthLeft();
+            tombstones = 0;
+            compactionReset();
+
+            ++inPlaceRehashCount;
+            rehashProbeLength = totalProbeLength / Group::WIDTH;
+            rehashSize = size;
+        }
+
+        //Control bytes come first, the slots start at the next KeyValue aligned offset after them.
+        uint64_t calculateSlotsOffset(uint64_t newCapacity)
+        {
+            return memoryAlign(newCapacity + Group::WIDTH, alignof(KeyValue));
         }
 
         uint64_t calculateSize(uint64_t newCapacity)
         {
-            return (newCapacity + GroupSse2Impl::WIDTH + newCapacity * (sizeof(KeyValue)));
+            return calculateSlotsOffset(newCapacity) + newCapacity * sizeof(KeyValue);
         }
 
         void initalisedSlots()
         {
-            char* newMemory = (char*)air_alloca(calculateSize(capacity), allocator);
+            char* newMemory = (char*)air_allocaa(calculateSize(capacity), allocator, alignof(KeyValue));
 
             controlBytes = reinterpret_cast<int8_t*>(newMemory);
-            slots = reinterpret_cast<KeyValue*>(newMemory + capacity + GroupSse2Impl::WIDTH);
+            slots = reinterpret_cast<KeyValue*>(newMemory + calculateSlotsOffset(capacity));
 
             resetControl();
             resetGrowthLeft();
@@ -576,7 +1426,7 @@ namespace Air
                 if (controlIsFull(oldControlBytes[i]))
                 {
                     const KeyValue* oldValue = oldSlots + i;
-                    uint64_t hash = hashCalculate(oldValue->key);
+                    const uint64_t hash = Hasher::hash(oldValue->key);
 
                     FindInfo findInfo = findFirstNonFull(hash);
 
@@ -592,7 +1442,12 @@ namespace Air
             if (oldCapacity)
             {
                 air_free(oldControlBytes, allocator);
+                ++growRehashCount;
             }
+
+            //FindInfo counts slots, every group past the first adds a whole group width.
+            rehashProbeLength = totalProbeLength / Group::WIDTH;
+            rehashSize = size;
         }
 
         void iteratorSkipEmptyOrDeleted(FlatHashMapIterator& iterator)
@@ -600,7 +1455,7 @@ namespace Air
             int8_t* control = controlBytes + iterator.index;
             while (controlIsEmptyOrDeleted(*control))
             {
-                uint32_t shift = GroupSse2Impl{ control }.countLeadingEmptyOrDeleted();
+                uint32_t shift = Group{ control }.countLeadingEmptyOrDeleted();
                 control += shift;
                 iterator.index += shift;
             }
@@ -614,19 +1469,21 @@ namespace Air
         void setControl(uint64_t i, int8_t h)
         {
             controlBytes[i] = h;
-            constexpr size_t clonedBytes = GroupSse2Impl::WIDTH - 1;
+            constexpr size_t clonedBytes = Group::WIDTH - 1;
             controlBytes[((i - clonedBytes) & capacity) + (clonedBytes & capacity)] = h;
         }
 
         void resetControl()
         {
-            memset(controlBytes, CONTROL_BITMASK_EMPTY, capacity + GroupSse2Impl::WIDTH);
+            memset(controlBytes, CONTROL_BITMASK_EMPTY, capacity + Group::WIDTH);
             controlBytes[capacity] = CONTROL_BITMASK_SENTINEL;
+            tombstones = 0;
+            compactionReset();
         }
 
         void resetGrowthLeft()
         {
-            growthLeft = capacityToGrowth(capacity) - size;
+            growthLeft = capacityToGrowth(capacity, Group::WIDTH) - size;
         }
 
         //To difficult to pull out of the header because of a struct with templated types.
@@ -645,6 +1502,16 @@ namespace Air
             return slots[it.index];
         }
 
+        static KeyValue makeDefaultKeyValue()
+        {
+            KeyValue keyValue{};
+            if constexpr (std::is_arithmetic_v<K> || std::is_pointer_v<K>)
+            {
+                keyValue.key = (K)-1;
+            }
+            return keyValue;
+        }
+
         int8_t* controlBytes = groupInitEmpty();
         KeyValue* slots = nullptr;
 
@@ -652,8 +1519,92 @@ namespace Air
         uint64_t capacity = 0;
         uint64_t growthLeft = 0;
 
+        //For getStats.
+        uint64_t growRehashCount = 0;
+        uint64_t inPlaceRehashCount = 0;
+        uint64_t rehashProbeLength = 0;
+        uint64_t rehashSize = 0;
+
+        uint64_t tombstones = 0;
+        //Only allocated while a compaction cycle is running, one bit per slot.
+        uint64_t* compactionMarks = nullptr;
+        uint64_t compactionCursor = 0;
+        uint32_t compactionSlotsPerInsert = 0;
+        bool compactionSweeping = false;
+
+        //The table being emptied while an incremental resize runs, resizeCursor is the next slot to move.
+        int8_t* resizeControlBytes = nullptr;
+        KeyValue* resizeSlots = nullptr;
+        uint64_t resizeCapacity = 0;
+        uint64_t resizeCursor = 0;
+        uint64_t resizeLargestStep = 0;
+        uint32_t resizeGroupsPerOperation = 0;
+
         Allocator* allocator = nullptr;
-        KeyValue defaultKeyValue = { (K) - 1, 0 };
+        KeyValue defaultKeyValue = makeDefaultKeyValue();
+    };
+
+    //FlatHashMap that only stores keys. Slots are sizeof(K), with no room spent on a value.
+    template<typename K, typename Hasher = HashMapHasher, typename Group = HashMapGroup>
+    struct FlatHashSet : public FlatHashMap<K, HashSetNoValue, Hasher, Group>
+    {
+        using Map = FlatHashMap<K, HashSetNoValue, Hasher, Group>;
+
+        //Returns true if key wasn't in the set yet.
+        bool insert(const K& key)
+        {
+            return insertByHash(Hasher::hash(key), key);
+        }
+
+        //hash has to be what the set's Hasher gives for key.
+        bool insertByHash(uint64_t hash, const K& key)
+        {
+            const FindResult findResult = Map::findOrPrepareInsertByHash(hash, [&](const K& slotKey) { return hashKeyEquals(slotKey, key); });
+            if (findResult.freeIndex)
+            {
+                Map::slots[findResult.index].key = key;
+            }
+            return findResult.freeIndex;
+        }
+
+        bool contains(const K& key)
+        {
+            return Map::find(key).isValid();
+        }
+
+        template<typename Q>
+            requires HashMapHeterogeneous<K, Q>::value
+        bool contains(const Q& query)
+        {
+            return Map::find(query).isValid();
+        }
+
+        //Inserts every key, returns how many weren't in the set yet. Reserves and prefetches like
+        //FlatHashMap::insertBatch.
+        uint64_t insertBatch(const K* keys, uint64_t count)
+        {
+            Map::reserve(Map::size + count);
+
+            uint64_t inserted = 0;
+            uint64_t hashes[HASH_MAP_BATCH_SIZE];
+            for (uint64_t first = 0; first < count; first += HASH_MAP_BATCH_SIZE)
+            {
+                const uint64_t batch = count - first < HASH_MAP_BATCH_SIZE ? count - first : HASH_MAP_BATCH_SIZE;
+                Map::prefetchBatch(keys + first, batch, hashes);
+
+                for (uint64_t i = 0; i < batch; ++i)
+                {
+                    inserted += insertByHash(hashes[i], keys[first + i]);
+                }
+            }
+
+            return inserted;
+        }
+
+        const K& getKey(const FlatHashMapIterator& it)
+        {
+            return Map::slots[it.index].key;
+        }
     };
 
 }//AIR
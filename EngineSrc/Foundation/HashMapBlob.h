@@ -0,0 +1,262 @@
+#ifndef HASH_MAP_BLOB_HDR
+#define HASH_MAP_BLOB_HDR
+
+#include "Platform.h"
+#include "Memory.h"
+#include "Assert.h"
+#include "Log.h"
+#include "HashMap.h"
+#include "Blob.h"
+#include "BlobSerialisation.h"
+#include "RelativeDataStructures.h"
+
+#include <type_traits>
+
+namespace Air
+{
+    //Bump when FlatHashMapBlob or the way FlatHashMap places entries changes, old blobs then fail to open.
+    static constexpr uint32_t FLAT_HASH_MAP_BLOB_VERSION = 2;
+
+    //Where entries sit depends on the group width they were probed with. Blobs are always laid out for the portable
+    //group, every build has it, so a blob written by an SSE2 or AVX2 map opens anywhere.
+    using FlatHashMapBlobGroup = GroupPortableImpl;
+
+    //Whether a key or value still means the same thing after being copied byte for byte into a file and loaded
+    //somewhere else. Opt in, only numbers and enums are by default, anything holding a pointer (const char*,
+    //StringView) or a runtime handle must never be. Plain structs of numbers can be added with a specialisation.
+    template<typename T>
+    struct HashMapBlobSafe
+    {
+        static constexpr bool value = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+    };
+
+    template<>
+    struct HashMapBlobSafe<HashSetNoValue>
+    {
+        static constexpr bool value = true;
+    };
+
+    //A FlatHashMap's control bytes and slots written out as they are, so the table can be queried straight from a
+    //read or mapped file instead of inserting every entry again. Everything in it is relative to the blob, so it can
+    //be loaded anywhere. The slots are copied byte for byte, see HashMapBlobSafe, and the blob only opens on a
+    //machine with the same byte order as the one that wrote it.
+    template<typename K, typename V>
+    struct FlatHashMapBlob : public Blob
+    {
+        static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>, "Blob entries are copied byte for byte.");
+        static_assert(HashMapBlobSafe<K>::value && HashMapBlobSafe<V>::value, "Key or value may hold a pointer, specialise HashMapBlobSafe if it doesn't.");
+
+        //Checked when opening so a blob is never read as a different layout.
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t slotSize;
+        uint32_t groupWidth;
+
+        uint64_t size;
+        uint64_t capacity;
+        //Where the writing map's entries sit depends on the address of its control bytes, see hashSeed.
+        uint64_t seed;
+
+        HashMapSlot<K, V> defaultKeyValue;
+
+        RelativeArray<int8_t> controlBytes;
+        RelativeArray<HashMapSlot<K, V>> slots;
+    };
+
+    //Writes map into a new blob owned by serialiser, serialiser.allocatedOffset bytes from serialiser.blobMemory.
+    //Free it with serialiser.shutdown() once it has been saved. A map using FlatHashMapBlobGroup is copied as it is,
+    //tombstones included, so shrinkToFit it first to get the smallest blob. Any other map is inserted again into a
+    //temporary portable map from allocator, which costs about as much as building the map did.
+    template<typename K, typename V, typename Hasher, typename Group>
+    inline FlatHashMapBlob<K, V>* flatHashMapWriteBlob(BlobSerialiser& serialiser, Allocator* allocator, FlatHashMap<K, V, Hasher, Group>& map)
+    {
+        using KeyValue = HashMapSlot<K, V>;
+        using Root = FlatHashMapBlob<K, V>;
+
+        map.finishResize();
+
+        if constexpr (std::is_same_v<Group, FlatHashMapBlobGroup> == false)
+        {
+            FlatHashMap<K, V, Hasher, FlatHashMapBlobGroup> portable;
+            portable.init(allocator, map.size);
+            portable.defaultKeyValue = map.defaultKeyValue;
+            for (FlatHashMapIterator it = map.iteratorBegin(); it.isValid(); map.iteratorAdvance(it))
+            {
+                const KeyValue& keyValue = map.getStructure(it);
+                portable.insert(keyValue.key, keyValue.value);
+            }
+
+            Root* root = flatHashMapWriteBlob(serialiser, allocator, portable);
+            portable.shutdown();
+            return root;
+        }
+
+        const uint64_t controlSize = map.capacity + Group::WIDTH;
+        //The slots are aligned from the start of the blob, so whatever loads it has to keep the start KeyValue aligned.
+        const uint64_t slotsOffset = memoryAlign(sizeof(Root) + controlSize, alignof(KeyValue));
+        const uint64_t blobSize = slotsOffset + map.capacity * sizeof(KeyValue);
+        AIR_ASSERTM(blobSize < INT32_MAX, "Hash map of %llu bytes is too big for the relative offsets of a blob.", (unsigned long long)blobSize);
+
+        Root* root = serialiser.writeAndPrepare<Root>(allocator, FLAT_HASH_MAP_BLOB_VERSION, blobSize - sizeof(BlobHeader));
+        root->header.mappable = 1;
+        root->keySize = sizeof(K);
+        root->valueSize = sizeof(V);
+        root->slotSize = sizeof(KeyValue);
+        root->groupWidth = Group::WIDTH;
+        root->size = map.size;
+        root->capacity = map.capacity;
+        root->seed = hashSeed(map.controlBytes);
+        memoryCopy(&root->defaultKeyValue, &map.defaultKeyValue, sizeof(KeyValue));
+
+        serialiser.allocateAndSet(root->controlBytes, (uint32_t)controlSize, map.controlBytes);
+        serialiser.allocateStatic(slotsOffset - serialiser.allocatedOffset);
+        serialiser.allocateAndSet(root->slots, (uint32_t)map.capacity, map.slots);
+
+        //Slots that don't hold an entry are whatever the allocator left there, keep that out of the file.
+        KeyValue* slots = root->slots.get();
+        for (uint64_t i = 0; i < map.capacity; ++i)
+        {
+            if (controlIsFull(map.controlBytes[i]) == false)
+            {
+                memset(slots + i, 0, sizeof(KeyValue));
+            }
+        }
+
+        return root;
+    }
+
+    //Read only FlatHashMap over a blob from flatHashMapWriteBlob. Opening it only checks the header, lookups probe
+    //the written table in place with the portable group. Hasher has to match the map that was written.
+    template<typename K, typename V, typename Hasher = HashMapHasher>
+    struct FlatHashMapView
+    {
+        using KeyValue = HashMapSlot<K, V>;
+        using Root = FlatHashMapBlob<K, V>;
+        using Group = FlatHashMapBlobGroup;
+
+        //memory has to stay valid for as long as the view is used. Returns false and leaves the view empty if the
+        //blob was written with a different layout or runs past memorySize.
+        bool init(const char* memory, size_t memorySize)
+        {
+            shutdown();
+
+            const Root* root = (const Root*)memory;
+            if (memorySize < sizeof(Root))
+            {
+                aprint("Hash map blob of %llu bytes is too small to hold its header.\n", (unsigned long long)memorySize);
+                return false;
+            }
+
+            if (root->header.version != FLAT_HASH_MAP_BLOB_VERSION || root->header.mappable == 0)
+            {
+                aprint("Hash map blob version %u isn't the supported version %u.\n", root->header.version, FLAT_HASH_MAP_BLOB_VERSION);
+                return false;
+            }
+
+            if (root->keySize != sizeof(K) || root->valueSize != sizeof(V) || root->slotSize != sizeof(KeyValue) || root->groupWidth != Group::WIDTH)
+            {
+                aprint("Hash map blob was written for %u byte keys, %u byte values and %u wide groups, not %u, %u and %u.\n", root->keySize, root->valueSize,
+                       root->groupWidth, (uint32_t)sizeof(K), (uint32_t)sizeof(V), (uint32_t)Group::WIDTH);
+                return false;
+            }
+
+            const int8_t* blobControlBytes = root->controlBytes.get();
+            const KeyValue* blobSlots = root->slots.get();
+            const char* end = memory + memorySize;
+            const bool fits = capacityIsValid(root->capacity) &&
+                              root->controlBytes.size == root->capacity + Group::WIDTH && root->slots.size == root->capacity &&
+                              (const char*)blobControlBytes >= memory && (const char*)(blobControlBytes + root->controlBytes.size) <= end &&
+                              (const char*)blobSlots >= memory && (const char*)(blobSlots + root->slots.size) <= end;
+            if (fits == false || blobControlBytes[root->capacity] != CONTROL_BITMASK_SENTINEL)
+            {
+                aprint("Hash map blob is truncated or corrupt.\n");
+                return false;
+            }
+            AIR_ASSERTM(((uintptr_t)blobSlots % alignof(KeyValue)) == 0, "Hash map blob has to be loaded at a %u byte aligned address.", (uint32_t)alignof(KeyValue));
+
+            controlBytes = blobControlBytes;
+            slots = blobSlots;
+            defaultKeyValue = &root->defaultKeyValue;
+            size = root->size;
+            capacity = root->capacity;
+            seed = root->seed;
+            return true;
+        }
+
+        //The memory belongs to whoever loaded it.
+        void shutdown()
+        {
+            controlBytes = nullptr;
+            slots = nullptr;
+            defaultKeyValue = nullptr;
+            size = capacity = seed = 0;
+        }
+
+        FlatHashMapIterator find(const K& key) const
+        {
+            return findByHash(Hasher::hash(key), [&](const K& slotKey) { return hashKeyEquals(slotKey, key); });
+        }
+
+        template<typename Equal>
+        FlatHashMapIterator findByHash(uint64_t hash, Equal equal) const
+        {
+            if (capacity == 0)
+            {
+                return { ITERATOR_END };
+            }
+
+            return { hashMapFindInTable<Group>(hash, seed, equal, controlBytes, slots, capacity) };
+        }
+
+        const V& get(const K& key) const
+        {
+            return get(find(key));
+        }
+
+        const V& get(const FlatHashMapIterator& it) const
+        {
+            return it.index != ITERATOR_END ? slots[it.index].value : defaultKeyValue->value;
+        }
+
+        const KeyValue& getStructure(const FlatHashMapIterator& it) const
+        {
+            return slots[it.index];
+        }
+
+        //Iterators
+        FlatHashMapIterator iteratorBegin() const
+        {
+            FlatHashMapIterator it{ 0 };
+            iteratorSkipEmptyOrDeleted(it);
+            return it;
+        }
+
+        void iteratorAdvance(FlatHashMapIterator& iterator) const
+        {
+            iterator.index++;
+            iteratorSkipEmptyOrDeleted(iterator);
+        }
+
+        void iteratorSkipEmptyOrDeleted(FlatHashMapIterator& iterator) const
+        {
+            while (iterator.index < capacity && controlIsFull(controlBytes[iterator.index]) == false)
+            {
+                ++iterator.index;
+            }
+            if (iterator.index >= capacity)
+            {
+                iterator.index = ITERATOR_END;
+            }
+        }
+
+        const int8_t* controlBytes = nullptr;
+        const KeyValue* slots = nullptr;
+        const KeyValue* defaultKeyValue = nullptr;
+
+        uint64_t size = 0;
+        uint64_t capacity = 0;
+        uint64_t seed = 0;
+    };
+}
+
+#endif // !HASH_MAP_BLOB_HDR
@@ -1,11 +1,22 @@
 #include "Memory.h"
 #include "MemoryUtils.h"
+#include "MemoryTracker.h"
 #include "Assert.h"
 
 #include <vender/tlsf.h>
 
 #include <stdlib.h>
 #include <memory.h>
+#include <atomic>
+
+#if defined(_MSC_VER)
+    #define WIN32_LEAN_AND_MEAN
+    #include <Windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
 
 #if defined AIR_IMGUI
     #include <vender/imgui/imgui.h>
@@ -37,6 +48,117 @@ namespace Air
     static void exitWalker(void* ptr, size_t size, int used, void* user);
     static void imguiWalker(void* ptr, size_t size, int used, void* user);
 
+    //Size classes served by the per-thread caches of a multi-threaded HeapAllocator.
+    //Anything bigger, or with a stricter alignment, goes straight to the locked TLSF pool.
+    static constexpr size_t HEAP_CACHE_SIZE_CLASSES[] = { 16, 32, 64, 128, 256, 512, 1024 };
+    static constexpr uint32_t HEAP_CACHE_CLASS_COUNT = ArraySize(HEAP_CACHE_SIZE_CLASSES);
+    static constexpr size_t HEAP_CACHE_CHUNK_SIZE = air_kilo(64);
+    static constexpr size_t HEAP_BLOCK_ALIGNMENT = 16;
+    static constexpr uint32_t HEAP_BLOCK_UNCACHED = UINT32_MAX;
+
+    //Sits right in front of every block handed out by a multi-threaded HeapAllocator.
+    struct HeapBlockHeader
+    {
+        uint32_t threadIndex;
+        uint32_t sizeClass;
+        //Distance from the user pointer back to the TLSF block, only used by uncached blocks.
+        uint64_t offset;
+    };
+
+    static_assert(sizeof(HeapBlockHeader) == HEAP_BLOCK_ALIGNMENT, "Block header has to keep user memory aligned.");
+
+    //Free blocks reuse their user memory as the intrusive list link.
+    struct HeapCacheNode
+    {
+        HeapCacheNode* next;
+    };
+
+    //Chunks are carved into blocks of a single size class and only go back to TLSF on shutdown.
+    struct HeapCacheChunk
+    {
+        HeapCacheChunk* next;
+        uint64_t padding;
+    };
+
+    struct alignas(64) HeapThreadCache
+    {
+        HeapCacheNode* freeLists[HEAP_CACHE_CLASS_COUNT] = {};
+        HeapCacheChunk* chunks = nullptr;
+        //Only the owning thread touches this. Remote frees are counted when they are drained.
+        int64_t liveBlocks = 0;
+
+        //Blocks freed by other threads. Pushed lock free and drained by the owner when its free list runs dry.
+        alignas(64) std::atomic<HeapCacheNode*> remoteFrees[HEAP_CACHE_CLASS_COUNT] = {};
+    };
+
+    static uint32_t heapSizeClass(size_t size)
+    {
+        for (uint32_t i = 0; i < HEAP_CACHE_CLASS_COUNT; ++i)
+        {
+            if (size <= HEAP_CACHE_SIZE_CLASSES[i])
+            {
+                return i;
+            }
+        }
+
+        return HEAP_BLOCK_UNCACHED;
+    }
+
+    //Indices given back by exited threads. Everything kept per index (heap cache free lists and remote frees, pool
+    //magazines, linear thread blocks) stays valid, so the next thread to take an index just carries on with it and
+    //drains what other threads freed to it in the meantime. The mutex orders the old owner's last use before the new
+    //owner's first.
+    static std::mutex threadIndexMutex;
+    static uint32_t freeThreadIndices[MEMORY_MAX_THREADS];
+    static uint32_t freeThreadIndexCount = 0;
+    static uint32_t nextThreadIndex = 0;
+    static bool threadIndexOverflowReported = false;
+
+    struct MemoryThreadIndex
+    {
+        MemoryThreadIndex()
+        {
+            std::lock_guard<std::mutex> lock(threadIndexMutex);
+            if (freeThreadIndexCount > 0)
+            {
+                index = freeThreadIndices[--freeThreadIndexCount];
+            }
+            else if (nextThreadIndex < MEMORY_MAX_THREADS)
+            {
+                index = nextThreadIndex++;
+            }
+            else
+            {
+                index = MEMORY_MAX_THREADS;
+                if (threadIndexOverflowReported == false)
+                {
+                    threadIndexOverflowReported = true;
+                    aprint("More than %u threads are using allocators at once, the rest go through the shared locked paths.\n", MEMORY_MAX_THREADS);
+                }
+            }
+        }
+
+        ~MemoryThreadIndex()
+        {
+            if (index < MEMORY_MAX_THREADS)
+            {
+                std::lock_guard<std::mutex> lock(threadIndexMutex);
+                freeThreadIndices[freeThreadIndexCount++] = index;
+            }
+
+            //Later thread_local destructors on this thread may still free, that has to go the shared way now.
+            index = MEMORY_MAX_THREADS;
+        }
+
+        uint32_t index;
+    };
+
+    uint32_t memoryThreadIndex()
+    {
+        thread_local MemoryThreadIndex threadIndex;
+        return threadIndex.index;
+    }
+
     MemoryService* MemoryService::instance()
     {
         return &MEMORY_SERVICE;
@@ -45,14 +167,36 @@ namespace Air
     void MemoryService::init(void* configuration)
     {
         aprint("Memory Service Init.\n");
-        MemoryServiceConfiguration* memoryConfiguration = static_cast<MemoryServiceConfiguration*>(configuration);
-        systemAllocator.init(memoryConfiguration ? memoryConfiguration->maximumDynamicSize : SIZE);
+
+        MemoryServiceConfiguration defaultConfiguration;
+        defaultConfiguration.maximumDynamicSize = SIZE;
+        const MemoryServiceConfiguration* memoryConfiguration = configuration ? static_cast<MemoryServiceConfiguration*>(configuration) : &defaultConfiguration;
+
+        systemAllocator.init(memoryConfiguration->maximumDynamicSize, memoryConfiguration->multiThreadedHeap,
+                             memoryConfiguration->dynamicReserveSize, memoryConfiguration->backing);
+
+        if (memoryConfiguration->trackAllocations)
+        {
+            tracker.init(memoryConfiguration->maximumTrackedAllocations);
+            systemAllocator.tracker = &tracker;
+        }
+
+        scratchAllocator.init(memoryConfiguration->scratchSize, memoryConfiguration->backing);
+        frameAllocator.init(memoryConfiguration->frameAllocatorSize, memoryConfiguration->framesInFlight, memoryConfiguration->backing);
     }
 
     void MemoryService::shutdown()
     {
+        frameAllocator.shutdown();
+        scratchAllocator.shutdown();
         systemAllocator.shutdown();
 
+        if (systemAllocator.tracker)
+        {
+            systemAllocator.tracker = nullptr;
+            tracker.shutdown();
+        }
+
         aprint("Memory Service Shutdown.\n");
     }
 
@@ -94,6 +238,7 @@ namespace Air
         if (ImGui::Begin("Memory Service"))
         {
             systemAllocator.debugUI();
+            frameAllocator.debugUI();
         }
         ImGui::End();
     }
@@ -106,154 +251,1007 @@ namespace Air
         //linear.init(1024);
     }
 
-    void HeapAllocator::init(size_t size)
+    size_t memoryPageSize()
+    {
+#if defined(_MSC_VER)
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        return systemInfo.dwPageSize;
+#else
+        return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    size_t memoryHugePageSize()
+    {
+#if defined(_MSC_VER)
+        const size_t largePageSize = GetLargePageMinimum();
+        return largePageSize ? largePageSize : air_mega(2);
+#else
+        return air_mega(2);
+#endif
+    }
+
+#if !defined(_MSC_VER)
+    //Binds a range to a NUMA node through the raw syscall so we don't need libnuma.
+    static void memoryBindNode(void* address, size_t size, int32_t numaNode)
+    {
+#if defined(SYS_mbind)
+        static constexpr int MEMORY_MPOL_BIND = 2;
+        if (numaNode < 0 || numaNode >= 64)
+        {
+            return;
+        }
+
+        const unsigned long nodeMask = 1ul << numaNode;
+        if (syscall(SYS_mbind, address, size, MEMORY_MPOL_BIND, &nodeMask, sizeof(nodeMask) * 8 + 1, 0) != 0)
+        {
+            aprint("Failed to bind %llu bytes to NUMA node %d.\n", size, numaNode);
+        }
+#else
+        (void)address; (void)size; (void)numaNode;
+#endif
+    }
+#endif
+
+    void* memoryReserve(size_t size, MemoryBacking* backing)
+    {
+#if defined(_MSC_VER)
+        if (backing == nullptr)
+        {
+            return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+        }
+
+        //Large pages have to be committed the moment they are reserved, so a reservation only gets normal pages.
+        backing->type = MEMORY_BACKING_PAGES;
+        if (backing->numaNode >= 0)
+        {
+            return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE, PAGE_NOACCESS, (DWORD)backing->numaNode);
+        }
+        return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+        //MAP_HUGETLB takes its pages out of the pool when it maps, not when they are touched, so a reservation of a few
+        //GB would hold on to all of them while only a granule is committed. Like Windows, reservations get transparent
+        //huge pages instead.
+        if (backing && backing->type == MEMORY_BACKING_EXPLICIT_HUGE_PAGES)
+        {
+            backing->type = MEMORY_BACKING_TRANSPARENT_HUGE_PAGES;
+        }
+
+        void* address = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (address == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        if (backing)
+        {
+            if (backing->type == MEMORY_BACKING_TRANSPARENT_HUGE_PAGES)
+            {
+#if defined(MADV_HUGEPAGE)
+                madvise(address, size, MADV_HUGEPAGE);
+#else
+                backing->type = MEMORY_BACKING_PAGES;
+#endif
+            }
+            else if (backing->type == MEMORY_BACKING_MALLOC)
+            {
+                backing->type = MEMORY_BACKING_PAGES;
+            }
+
+            memoryBindNode(address, size, backing->numaNode);
+        }
+
+        return address;
+#endif
+    }
+
+    bool memoryCommit(void* address, size_t size)
+    {
+#if defined(_MSC_VER)
+        return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+        return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+    }
+
+    void memoryDecommit(void* address, size_t size)
+    {
+#if defined(_MSC_VER)
+        VirtualFree(address, size, MEM_DECOMMIT);
+#else
+        madvise(address, size, MADV_DONTNEED);
+        mprotect(address, size, PROT_NONE);
+#endif
+    }
+
+    void memoryRelease(void* address, size_t size)
+    {
+#if defined(_MSC_VER)
+        VirtualFree(address, 0, MEM_RELEASE);
+#else
+        munmap(address, size);
+#endif
+    }
+
+    //Huge page backed blocks are rounded to whole huge pages so the kernel can actually use them.
+    static size_t memoryBackingSize(size_t size, const MemoryBacking& backing)
+    {
+        const bool hugePages = backing.type == MEMORY_BACKING_TRANSPARENT_HUGE_PAGES || backing.type == MEMORY_BACKING_EXPLICIT_HUGE_PAGES;
+        return memoryAlign(size, hugePages ? memoryHugePageSize() : memoryPageSize());
+    }
+
+    void* memoryBackingAllocate(size_t size, MemoryBacking& backing)
+    {
+        if (backing.type == MEMORY_BACKING_MALLOC && backing.numaNode < 0)
+        {
+            return malloc(size);
+        }
+
+        //Whatever backing falls back to from here on, this is the size that gets mapped.
+        const size_t backingSize = memoryBackingSize(size, backing);
+        backing.mappedSize = backingSize;
+#if defined(_MSC_VER)
+        if (backing.type == MEMORY_BACKING_EXPLICIT_HUGE_PAGES)
+        {
+            //Needs the SeLockMemoryPrivilege, without it this fails and we take normal pages.
+            const DWORD flags = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+            void* address = backing.numaNode >= 0 ? VirtualAllocExNuma(GetCurrentProcess(), nullptr, backingSize, flags, PAGE_READWRITE, (DWORD)backing.numaNode)
+                                                  : VirtualAlloc(nullptr, backingSize, flags, PAGE_READWRITE);
+            if (address)
+            {
+                return address;
+            }
+
+            aprint("No large pages for %llu bytes, falling back to normal pages.\n", size);
+        }
+#elif defined(MAP_HUGETLB)
+        if (backing.type == MEMORY_BACKING_EXPLICIT_HUGE_PAGES)
+        {
+            //The whole block is used straight away, so no MAP_NORESERVE. The huge pages are set aside now rather than
+            //failing with SIGBUS on first touch.
+            void* address = mmap(nullptr, backingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (address != MAP_FAILED)
+            {
+                memoryBindNode(address, backingSize, backing.numaNode);
+                return address;
+            }
+
+            aprint("No explicit huge pages for %llu bytes, falling back to transparent huge pages.\n", size);
+        }
+#endif
+
+        void* address = memoryReserve(backingSize, &backing);
+        if (address && memoryCommit(address, backingSize))
+        {
+            return address;
+        }
+
+        if (address)
+        {
+            memoryRelease(address, backingSize);
+        }
+
+        aprint("Failed to map %llu bytes, falling back to malloc.\n", size);
+        backing.type = MEMORY_BACKING_MALLOC;
+        backing.numaNode = -1;
+        return malloc(size);
+    }
+
+    void memoryBackingFree(void* memory, size_t size, const MemoryBacking& backing)
+    {
+        if (backing.type == MEMORY_BACKING_MALLOC)
+        {
+            free(memory);
+            return;
+        }
+
+        AIR_ASSERTM(backing.mappedSize >= size, "Backing of %llu bytes wasn't mapped by memoryBackingAllocate.", size);
+        memoryRelease(memory, backing.mappedSize);
+    }
+
+    static void usedBlockWalker(void* /*ptr*/, size_t /*size*/, int used, void* user)
+    {
+        *(uint32_t*)user += used ? 1 : 0;
+    }
+
+    //All pool allocations go through here so running out of memory grows the heap instead of failing.
+    static void* heapPoolAllocate(HeapAllocator* heap, size_t size, size_t alignment)
+    {
+        void* allocatedMemory = alignment == 1 ? tlsf_malloc(heap->TLSFHandle, size) : tlsf_memalign(heap->TLSFHandle, alignment, size);
+        if (allocatedMemory == nullptr && heap->grow(size + alignment))
+        {
+            allocatedMemory = alignment == 1 ? tlsf_malloc(heap->TLSFHandle, size) : tlsf_memalign(heap->TLSFHandle, alignment, size);
+        }
+
+        return allocatedMemory;
+    }
+
+    void HeapAllocator::init(size_t size, bool multiThreaded, size_t reserveSize, const MemoryBacking& backing)
+    {
+        this->backing = backing;
+        //Granules are decommitted one at a time so they have to cover whole huge pages.
+        const bool hugePages = backing.type == MEMORY_BACKING_TRANSPARENT_HUGE_PAGES || backing.type == MEMORY_BACKING_EXPLICIT_HUGE_PAGES;
+        const size_t pageSize = hugePages ? memoryHugePageSize() : memoryPageSize();
+        granuleSize = memoryAlign(size, pageSize);
+
+        const size_t granuleCount = reserveSize > granuleSize ? (reserveSize + granuleSize - 1) / granuleSize : 1;
+        reservedSize = (granuleCount < HEAP_MAX_GRANULES ? granuleCount : HEAP_MAX_GRANULES) * granuleSize;
+
+        memory = memoryReserve(reservedSize, &this->backing);
+        AIR_ASSERTM(memory != nullptr, "Failed to reserve %llu bytes of address space for the heap.", reservedSize);
+        memoryCommit(memory, granuleSize);
+
+        maxSize = granuleSize;
+        allocatedSize = 0;
+        this->multiThreaded = multiThreaded;
+
+        //The first pool also holds the TLSF control structure so it is never released.
+        TLSFHandle = tlsf_create_with_pool(memory, granuleSize);
+        pools[0].tlsfPool = tlsf_get_pool(TLSFHandle);
+        pools[0].firstGranule = 0;
+        pools[0].granuleCount = 1;
+        granuleUsed[0] = 1;
+
+        if (multiThreaded)
+        {
+            threadCaches = new HeapThreadCache[MEMORY_MAX_THREADS];
+        }
+
+        aprint("HeapAllocator of size %llu created%s, %llu reserved.\n", granuleSize, multiThreaded ? " (multi-threaded)" : "", reservedSize);
+    }
+
+    bool HeapAllocator::grow(size_t size)
+    {
+        const size_t requiredSize = size + tlsf_pool_overhead() + tlsf_alloc_overhead();
+        const uint32_t granuleCount = (uint32_t)((requiredSize + granuleSize - 1) / granuleSize);
+        const uint32_t totalGranules = (uint32_t)(reservedSize / granuleSize);
+
+        uint32_t poolIndex = 0;
+        while (poolIndex < HEAP_MAX_POOLS && pools[poolIndex].tlsfPool)
+        {
+            ++poolIndex;
+        }
+
+        //First fit so holes left behind by released pools get reused.
+        uint32_t runStart = 0;
+        uint32_t runLength = 0;
+        for (uint32_t i = 0; i < totalGranules && runLength < granuleCount; ++i)
+        {
+            if (granuleUsed[i])
+            {
+                runStart = i + 1;
+                runLength = 0;
+            }
+            else
+            {
+                ++runLength;
+            }
+        }
+
+        if (poolIndex == HEAP_MAX_POOLS || runLength < granuleCount)
+        {
+            aprint("HeapAllocator can't grow by %llu bytes, the reservation of %llu bytes is used up.\n", size, reservedSize);
+            return false;
+        }
+
+        uint8_t* address = (uint8_t*)memory + runStart * granuleSize;
+        const size_t poolSize = granuleCount * granuleSize;
+        if (memoryCommit(address, poolSize) == false)
+        {
+            return false;
+        }
+
+        HeapPool& pool = pools[poolIndex];
+        pool.tlsfPool = tlsf_add_pool(TLSFHandle, address, poolSize);
+        pool.firstGranule = runStart;
+        pool.granuleCount = granuleCount;
+        memset(granuleUsed + runStart, 1, granuleCount);
+
+        maxSize += poolSize;
+        return true;
+    }
+
+    uint32_t HeapAllocator::releaseEmptyPools()
+    {
+        std::unique_lock<std::mutex> lock(poolMutex, std::defer_lock);
+        if (multiThreaded)
+        {
+            lock.lock();
+        }
+
+        uint32_t releasedPools = 0;
+        for (uint32_t i = 1; i < HEAP_MAX_POOLS; ++i)
+        {
+            HeapPool& pool = pools[i];
+            if (pool.tlsfPool == nullptr)
+            {
+                continue;
+            }
+
+            uint32_t usedBlocks = 0;
+            tlsf_walk_pool(pool.tlsfPool, usedBlockWalker, &usedBlocks);
+            if (usedBlocks)
+            {
+                continue;
+            }
+
+            const size_t poolSize = pool.granuleCount * granuleSize;
+            tlsf_remove_pool(TLSFHandle, pool.tlsfPool);
+            memoryDecommit((uint8_t*)memory + pool.firstGranule * granuleSize, poolSize);
+            memset(granuleUsed + pool.firstGranule, 0, pool.granuleCount);
+
+            maxSize -= poolSize;
+            pool = HeapPool{};
+            ++releasedPools;
+        }
+
+        return releasedPools;
+    }
+
+    static void heapDrainRemoteFrees(HeapThreadCache& cache, uint32_t sizeClass)
+    {
+        HeapCacheNode* node = cache.remoteFrees[sizeClass].exchange(nullptr, std::memory_order_acquire);
+        while (node)
+        {
+            HeapCacheNode* next = node->next;
+            node->next = cache.freeLists[sizeClass];
+            cache.freeLists[sizeClass] = node;
+            --cache.liveBlocks;
+
+            node = next;
+        }
+    }
+
+    //Hands every cache chunk back to TLSF. Returns how many cached blocks were never freed.
+    static int64_t heapReleaseThreadCaches(HeapAllocator* heap)
+    {
+        int64_t leakedBlocks = 0;
+        for (uint32_t i = 0; i < MEMORY_MAX_THREADS; ++i)
+        {
+            HeapThreadCache& cache = heap->threadCaches[i];
+            for (uint32_t sizeClass = 0; sizeClass < HEAP_CACHE_CLASS_COUNT; ++sizeClass)
+            {
+                heapDrainRemoteFrees(cache, sizeClass);
+            }
+
+            leakedBlocks += cache.liveBlocks;
+
+            HeapCacheChunk* chunk = cache.chunks;
+            while (chunk)
+            {
+                HeapCacheChunk* next = chunk->next;
+                heap->allocatedSize -= tlsf_block_size(chunk);
+                tlsf_free(heap->TLSFHandle, chunk);
+
+                chunk = next;
+            }
+        }
+
+        return leakedBlocks;
+    }
+
+    void HeapAllocator::shutdown()
+    {
+        if (tracker)
+        {
+            tracker->dump();
+        }
+
+        if (multiThreaded)
+        {
+            const int64_t leakedBlocks = heapReleaseThreadCaches(this);
+            if (leakedBlocks)
+            {
+                aprint("HeapAllocator Shutdown.\n=========\nFAILURE! %lld cached blocks are still allocated.\n=========\n", leakedBlocks);
+            }
+            AIR_ASSERTM(leakedBlocks == 0, "Cached blocks are still present.");
+
+            delete[] threadCaches;
+            threadCaches = nullptr;
+        }
+
+        MemoryStatistics stats{ 0, maxSize };
+        for (uint32_t i = 0; i < HEAP_MAX_POOLS; ++i)
+        {
+            if (pools[i].tlsfPool)
+            {
+                tlsf_walk_pool(pools[i].tlsfPool, exitWalker, (void*)&stats);
+            }
+        }
+
+        if (stats.allocatedBytes)
+        {
+            aprint("HeapAllocator Shutdown.\n=========\nFAILURE! Allocated memory detected. Allocated %llu, total %llu\n=========\n", stats.allocatedBytes, stats.totalBytes);
+        }
+        else
+        {
+            aprint("HeapAllocator Shutdown - all memory freed.\n");
+        }
+
+        AIR_ASSERTM(stats.allocatedBytes == 0, "Allocated bytes are still present.");
+
+        tlsf_destroy(TLSFHandle);
+
+        memoryRelease(memory, reservedSize);
+        memory = nullptr;
+        for (uint32_t i = 0; i < HEAP_MAX_POOLS; ++i)
+        {
+            pools[i] = HeapPool{};
+        }
+        memset(granuleUsed, 0, sizeof(granuleUsed));
+    }
+
+#if defined AIR_IMGUI
+    void HeapAllocator::debugUI()
+    {
+        ImGui::Separator();
+        ImGui::Text("Heap Allocator");
+        ImGui::Separator();
+        MemoryStatistics stats{ 0, maxSize };
+        for (uint32_t i = 0; i < HEAP_MAX_POOLS; ++i)
+        {
+            if (pools[i].tlsfPool)
+            {
+                tlsf_walk_pool(pools[i].tlsfPool, imguiWalker, (void*)&stats);
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Text("\tAllocation count %d", stats.allocationCount);
+        ImGui::Text("\tAllocated %llu K, free %llu Mb", stats.allocatedBytes / (1024 * 1024),
+            maxSize - stats.allocatedBytes / (1024 * 1024),
+            maxSize / (1024 * 1024));
+    }
+#endif //AIR_IMGUI
+
+#if defined (AIR_MEMORY_STACK)
+    class AirStackWalker : public StackWalker
+    {
+    public:
+        AirStackWalker() : StackWalker()
+        {
+        }
+
+    protected:
+        virtual void OnOuput(LPCSTR szText)
+        {
+            aprint("\nStackL \n%s\n", szText);
+            StackWalker::OnOutput(szText);
+        }
+    };
+
+    static void* heapAllocateMultiThreaded(HeapAllocator* heap, size_t size, size_t alignment);
+
+    static void* heapAllocate(HeapAllocator* heap, size_t size, size_t alignment)
+    {
+        if (heap->multiThreaded)
+        {
+            return heapAllocateMultiThreaded(heap, size, alignment);
+        }
+
+        void* memory = heapPoolAllocate(heap, size, 1);
+        aprint("Memory: %p, size %llu \n", memory, size);
+        return memory;
+    }
+#else
+    static void* heapAllocateMultiThreaded(HeapAllocator* heap, size_t size, size_t alignment);
+
+    static void* heapAllocate(HeapAllocator* heap, size_t size, size_t alignment)
+    {
+        if (heap->multiThreaded)
+        {
+            return heapAllocateMultiThreaded(heap, size, alignment);
+        }
+
+#if defined(HEAP_ALLOCATOR_STATS)
+        void* allocatedMemory = heapPoolAllocate(heap, size, alignment);
+        if (allocatedMemory)
+        {
+            heap->allocatedSize += tlsf_block_size(allocatedMemory);
+        }
+
+        return allocatedMemory;
+#else
+        return heapPoolAllocate(heap, size, 1);
+#endif
+    }
+#endif //AIR_MEMORY_STACK
+
+    void* HeapAllocator::allocate(size_t size, size_t alignment)
+    {
+        return allocate(size, alignment, nullptr, 0);
+    }
+
+    void* HeapAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
+    {
+        void* allocatedMemory = heapAllocate(this, size, alignment);
+        if (tracker && allocatedMemory)
+        {
+            tracker->recordAllocation(allocatedMemory, size, file, line);
+        }
+
+        return allocatedMemory;
+    }
+
+    //Big or over-aligned blocks come straight from the pool, with the header placed in front of the aligned pointer.
+    static void* heapAllocateUncached(HeapAllocator* heap, size_t size, size_t alignment)
+    {
+        const size_t blockAlignment = alignment > HEAP_BLOCK_ALIGNMENT ? alignment : HEAP_BLOCK_ALIGNMENT;
+
+        std::lock_guard<std::mutex> lock(heap->poolMutex);
+        uint8_t* block = (uint8_t*)heapPoolAllocate(heap, size + blockAlignment, blockAlignment);
+        if (block == nullptr)
+        {
+            AIR_MEM_ASSERT(false, "Heap out of memory.");
+            return nullptr;
+        }
+        heap->allocatedSize += tlsf_block_size(block);
+
+        uint8_t* pointer = block + blockAlignment;
+        HeapBlockHeader* header = (HeapBlockHeader*)pointer - 1;
+        header->threadIndex = HEAP_BLOCK_UNCACHED;
+        header->sizeClass = HEAP_BLOCK_UNCACHED;
+        header->offset = blockAlignment;
+
+        return pointer;
+    }
+
+    //Takes a chunk from the shared pool and carves it into blocks of one size class for this thread.
+    static bool heapRefillCache(HeapAllocator* heap, HeapThreadCache& cache, uint32_t threadIndex, uint32_t sizeClass)
+    {
+        uint8_t* chunkMemory = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(heap->poolMutex);
+            chunkMemory = (uint8_t*)heapPoolAllocate(heap, HEAP_CACHE_CHUNK_SIZE, HEAP_BLOCK_ALIGNMENT);
+            if (chunkMemory)
+            {
+                heap->allocatedSize += tlsf_block_size(chunkMemory);
+            }
+        }
+
+        if (chunkMemory == nullptr)
+        {
+            AIR_MEM_ASSERT(false, "Heap out of memory.");
+            return false;
+        }
+
+        HeapCacheChunk* chunk = (HeapCacheChunk*)chunkMemory;
+        chunk->next = cache.chunks;
+        cache.chunks = chunk;
+
+        const size_t stride = sizeof(HeapBlockHeader) + HEAP_CACHE_SIZE_CLASSES[sizeClass];
+        for (size_t offset = sizeof(HeapCacheChunk); offset + stride <= HEAP_CACHE_CHUNK_SIZE; offset += stride)
+        {
+            HeapBlockHeader* header = (HeapBlockHeader*)(chunkMemory + offset);
+            header->threadIndex = threadIndex;
+            header->sizeClass = sizeClass;
+            header->offset = 0;
+
+            HeapCacheNode* node = (HeapCacheNode*)(header + 1);
+            node->next = cache.freeLists[sizeClass];
+            cache.freeLists[sizeClass] = node;
+        }
+
+        return true;
+    }
+
+    void* heapAllocateMultiThreaded(HeapAllocator* heap, size_t size, size_t alignment)
+    {
+        const uint32_t threadIndex = memoryThreadIndex();
+        const uint32_t sizeClass = alignment <= HEAP_BLOCK_ALIGNMENT ? heapSizeClass(size) : HEAP_BLOCK_UNCACHED;
+        if (sizeClass == HEAP_BLOCK_UNCACHED || threadIndex >= MEMORY_MAX_THREADS)
+        {
+            return heapAllocateUncached(heap, size, alignment);
+        }
+
+        HeapThreadCache& cache = heap->threadCaches[threadIndex];
+        if (cache.freeLists[sizeClass] == nullptr)
+        {
+            heapDrainRemoteFrees(cache, sizeClass);
+        }
+
+        if (cache.freeLists[sizeClass] == nullptr && heapRefillCache(heap, cache, threadIndex, sizeClass) == false)
+        {
+            return nullptr;
+        }
+
+        HeapCacheNode* node = cache.freeLists[sizeClass];
+        cache.freeLists[sizeClass] = node->next;
+        ++cache.liveBlocks;
+
+        return node;
+    }
+
+    static void heapDeallocateMultiThreaded(HeapAllocator* heap, void* pointer)
+    {
+        HeapBlockHeader* header = (HeapBlockHeader*)pointer - 1;
+        if (header->threadIndex == HEAP_BLOCK_UNCACHED)
+        {
+            void* block = (uint8_t*)pointer - header->offset;
+
+            std::lock_guard<std::mutex> lock(heap->poolMutex);
+            heap->allocatedSize -= tlsf_block_size(block);
+            tlsf_free(heap->TLSFHandle, block);
+            return;
+        }
+
+        HeapThreadCache& owner = heap->threadCaches[header->threadIndex];
+        HeapCacheNode* node = (HeapCacheNode*)pointer;
+        if (header->threadIndex == memoryThreadIndex())
+        {
+            node->next = owner.freeLists[header->sizeClass];
+            owner.freeLists[header->sizeClass] = node;
+            --owner.liveBlocks;
+            return;
+        }
+
+        //Freed from another thread, hand it back to the owning cache without taking any lock.
+        std::atomic<HeapCacheNode*>& remoteFrees = owner.remoteFrees[header->sizeClass];
+        HeapCacheNode* head = remoteFrees.load(std::memory_order_relaxed);
+        do
+        {
+            node->next = head;
+        } while (remoteFrees.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed) == false);
+    }
+
+    void* Allocator::reallocate(void* pointer, size_t oldSize, size_t newSize, size_t alignment)
+    {
+        void* newPointer = allocate(newSize, alignment);
+        if (pointer && newPointer)
+        {
+            memcpy(newPointer, pointer, oldSize < newSize ? oldSize : newSize);
+        }
+
+        if (pointer && (newPointer || newSize == 0))
+        {
+            deallocate(pointer);
+        }
+
+        return newPointer;
+    }
+
+    void* HeapAllocator::reallocate(void* pointer, size_t oldSize, size_t newSize, size_t alignment)
+    {
+        //tlsf_realloc frees the block for a size of 0 and returns null, which would look like a full pool below.
+        if (pointer && newSize == 0)
+        {
+            deallocate(pointer);
+            return nullptr;
+        }
+
+        //Cache blocks carry a header and tracked blocks are keyed by address, both go the long way round.
+        //tlsf_realloc only guarantees its own alignment when it has to move the block.
+        if (pointer == nullptr || multiThreaded || tracker || alignment > tlsf_align_size())
+        {
+            return Allocator::reallocate(pointer, oldSize, newSize, alignment);
+        }
+
+        const size_t oldBlockSize = tlsf_block_size(pointer);
+        void* newPointer = tlsf_realloc(TLSFHandle, pointer, newSize);
+        if (newPointer == nullptr)
+        {
+            //newSize isn't 0, so the pool is full. The old block is untouched and allocate() knows how to grow the heap.
+            return Allocator::reallocate(pointer, oldSize, newSize, alignment);
+        }
+
+#if defined(HEAP_ALLOCATOR_STATS)
+        allocatedSize = allocatedSize - oldBlockSize + tlsf_block_size(newPointer);
+#endif
+        return newPointer;
+    }
+
+    bool HeapAllocator::resizeInPlace(void* pointer, size_t /*oldSize*/, size_t newSize)
+    {
+        if (pointer == nullptr || tracker)
+        {
+            return false;
+        }
+
+        //TLSF rounds blocks up, so there is sometimes room left at the end of the block.
+        if (multiThreaded)
+        {
+            const HeapBlockHeader* header = (const HeapBlockHeader*)pointer - 1;
+            if (header->sizeClass != HEAP_BLOCK_UNCACHED)
+            {
+                return newSize <= HEAP_CACHE_SIZE_CLASSES[header->sizeClass];
+            }
+
+            std::lock_guard<std::mutex> lock(poolMutex);
+            return newSize + header->offset <= tlsf_block_size((uint8_t*)pointer - header->offset);
+        }
+
+        return newSize <= tlsf_block_size(pointer);
+    }
+
+    void HeapAllocator::deallocate(void* pointer)
+    {
+        //Like tlsf_free, freeing null does nothing. The multi threaded path would read a header in front of it.
+        if (pointer == nullptr)
+        {
+            return;
+        }
+
+        if (tracker)
+        {
+            tracker->recordDeallocation(pointer);
+        }
+
+        if (multiThreaded)
+        {
+            heapDeallocateMultiThreaded(this, pointer);
+            return;
+        }
+
+#if defined (HEAP_ALLOCATOR_STATS)
+        size_t actualSize = tlsf_block_size(pointer);
+        allocatedSize -= actualSize;
+
+        tlsf_free(TLSFHandle, pointer);
+#else
+        tlsf_free(TLSFHandle, pointer);
+#endif
+    }
+
+    void LinearAllocator::init(size_t size, const MemoryBacking& backing)
+    {
+        this->backing = backing;
+        memory = (uint8_t*)memoryBackingAllocate(size, this->backing);
+        totalSize = size;
+        allocatedSize = 0;
+    }
+
+    void LinearAllocator::shutdown()
+    {
+        clear();
+        memoryBackingFree(memory, totalSize, backing);
+    }
+
+    void* LinearAllocator::allocate(size_t size, size_t alignment)
+    {
+        AIR_ASSERT(size > 0);
+
+        const size_t newStart = memoryAlign(allocatedSize, alignment);
+        AIR_ASSERT(newStart < totalSize);
+        const size_t newAllocatedSize = newStart + size;
+        if (newAllocatedSize > totalSize)
+        {
+            AIR_MEM_ASSERT(false, "Overflow");
+            return nullptr;
+        }
+
+        allocatedSize = newAllocatedSize;
+        return memory + newStart;
+    }
+
+    void* LinearAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
+    {
+        return allocate(size, alignment);
+    }
+
+    void LinearAllocator::deallocate(void* /*pointer*/)
+    {
+        //This allocator does not allocate on a per pointer bases.
+    }
+
+    bool LinearAllocator::resizeInPlace(void* pointer, size_t oldSize, size_t newSize)
+    {
+        if (pointer == nullptr)
+        {
+            return false;
+        }
+
+        const size_t offset = (uint8_t*)pointer - memory;
+        if (offset + oldSize != allocatedSize || offset + newSize > totalSize)
+        {
+            return false;
+        }
+
+        allocatedSize = offset + newSize;
+        return true;
+    }
+
+    size_t LinearAllocator::getMarker()
+    {
+        return allocatedSize;
+    }
+
+    void LinearAllocator::freeMarker(size_t marker)
+    {
+        if (marker < allocatedSize)
+        {
+            allocatedSize = marker;
+        }
+    }
+
+    void LinearAllocator::clear() 
     {
-        memory = malloc(size);
-        maxSize = size;
         allocatedSize = 0;
-
-        TLSFHandle = tlsf_create_with_pool(memory, size);
-        aprint("HeapAllocator of size %llu created.\n", size);
     }
 
-    void HeapAllocator::shutdown()
+    struct alignas(64) ConcurrentLinearBlock
     {
-        MemoryStatistics stats{ 0, maxSize };
-        pool_t pool = tlsf_get_pool(TLSFHandle);
-        tlsf_walk_pool(pool, exitWalker, (void*)&stats);
+        uint8_t* cursor = nullptr;
+        uint8_t* end = nullptr;
+        uint64_t generation = 0;
+    };
 
-        if (stats.allocatedBytes)
-        {
-            aprint("HeapAllocator Shutdown.\n=========\nFAILURE! Allocated memory detected. Allocated %llu, total %llu\n=========\n", stats.allocatedBytes, stats.totalBytes);
-        }
-        else
-        {
-            aprint("HeapAllocator Shutdown - all memory freed.\n");
-        }
+    void ConcurrentLinearAllocator::init(size_t size, size_t threadBlockSize)
+    {
+        memory = (uint8_t*)malloc(size);
+        totalSize = size;
+        allocatedSize.store(0, std::memory_order_relaxed);
 
-        AIR_ASSERTM(stats.allocatedBytes == 0, "Allocated bytes are still present.");
+        this->threadBlockSize = threadBlockSize;
+        threadBlocks = threadBlockSize ? new ConcurrentLinearBlock[MEMORY_MAX_THREADS] : nullptr;
+    }
 
-        tlsf_destroy(TLSFHandle);
+    void ConcurrentLinearAllocator::shutdown()
+    {
+        clear();
+
+        delete[] threadBlocks;
+        threadBlocks = nullptr;
 
         free(memory);
+        memory = nullptr;
     }
 
-#if defined AIR_IMGUI
-    void HeapAllocator::debugUI()
+    //Reserves the worst case padding along with the size so the fetch-add is the only shared write.
+    static uint8_t* concurrentLinearBump(ConcurrentLinearAllocator* allocator, size_t size, size_t alignment)
     {
-        ImGui::Separator();
-        ImGui::Text("Heap Allocator");
-        ImGui::Separator();
-        MemoryStatistics stats{ 0, maxSize };
-        pool_t pool = tlsf_get_pool(TLSFHandle);
-        tlsf_walk_pool(pool, imguiWalker, (void*)&stats);
+        const size_t offset = allocator->allocatedSize.fetch_add(size + alignment - 1, std::memory_order_relaxed);
+        if (offset >= allocator->totalSize)
+        {
+            AIR_MEM_ASSERT(false, "Overflow");
+            return nullptr;
+        }
 
-        ImGui::Separator();
-        ImGui::Text("\tAllocation count %d", stats.allocationCount);
-        ImGui::Text("\tAllocated %llu K, free %llu Mb", stats.allocatedBytes / (1024 * 1024),
-            maxSize - stats.allocatedBytes / (1024 * 1024),
-            maxSize / (1024 * 1024));
+        uint8_t* start = (uint8_t*)memoryAlign((size_t)(allocator->memory + offset), alignment);
+        if (start + size > allocator->memory + allocator->totalSize)
+        {
+            AIR_MEM_ASSERT(false, "Overflow");
+            return nullptr;
+        }
+
+        return start;
     }
-#endif //AIR_IMGUI
 
-#if defined (AIR_MEMORY_STACK)
-    class AirStackWalker : public StackWalker
+    void* ConcurrentLinearAllocator::allocate(size_t size, size_t alignment)
     {
-    public:
-        AirStackWalker() : StackWalker()
+        AIR_ASSERT(size > 0);
+
+        //Big allocations would waste most of a thread block, so they always go to the shared offset.
+        const uint32_t threadIndex = memoryThreadIndex();
+        if (threadBlocks == nullptr || threadIndex >= MEMORY_MAX_THREADS || size + alignment > threadBlockSize / 2)
         {
+            return concurrentLinearBump(this, size, alignment);
         }
 
-    protected:
-        virtual void OnOuput(LPCSTR szText)
+        ConcurrentLinearBlock& block = threadBlocks[threadIndex];
+        const uint64_t currentGeneration = generation.load(std::memory_order_relaxed);
+        if (block.generation != currentGeneration)
         {
-            aprint("\nStackL \n%s\n", szText);
-            StackWalker::OnOutput(szText);
+            block.cursor = nullptr;
+            block.end = nullptr;
+            block.generation = currentGeneration;
         }
-    };
 
-    void* HeapAllocator::allocate(size_t size, size_t alignment)
-    {
-        void* memory = tlsf_malloc(TLSFHandle, size);
-        aprint("Memory: %p, size %llu \n", memory, size);
-        return memory;
-    }
-#else
-    void* HeapAllocator::allocate(size_t size, size_t alignment)
-    {
-#if defined(HEAP_ALLOCATOR_STATS)
-        void* allocatedMemory = alignment == 1 ? tlsf_malloc(TLSFHandle, size) : tlsf_memalign(TLSFHandle, alignment, size);
-        size_t actualSize = tlsf_block_size(allocatedMemory);
-        allocatedSize += actualSize;
+        uint8_t* start = (uint8_t*)memoryAlign((size_t)block.cursor, alignment);
+        if (block.cursor == nullptr || start + size > block.end)
+        {
+            uint8_t* newBlock = concurrentLinearBump(this, threadBlockSize, 64);
+            if (newBlock == nullptr)
+            {
+                return nullptr;
+            }
+
+            block.cursor = newBlock;
+            block.end = newBlock + threadBlockSize;
+            start = (uint8_t*)memoryAlign((size_t)block.cursor, alignment);
+        }
 
-        return allocatedMemory;
-#else
-        return tlsf_malloc(TLSFHandle, size);
-#endif
+        block.cursor = start + size;
+        return start;
     }
-#endif //AIR_MEMORY_STACK
 
-    void* HeapAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
+    void* ConcurrentLinearAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
     {
         return allocate(size, alignment);
     }
 
-    void HeapAllocator::deallocate(void* pointer)
+    void ConcurrentLinearAllocator::deallocate(void* /*pointer*/)
     {
-#if defined (HEAP_ALLOCATOR_STATS)
-        size_t actualSize = tlsf_block_size(pointer);
-        allocatedSize -= actualSize;
+        //This allocator does not allocate on a per pointer bases.
+    }
 
-        tlsf_free(TLSFHandle, pointer);
-#else
-        tlsf_free(TLSFHandle, pointer);
-#endif
+    void ConcurrentLinearAllocator::clear()
+    {
+        allocatedSize.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_relaxed);
     }
 
-    void LinearAllocator::init(size_t size)
+    void FrameAllocator::init(size_t sizePerFrame, uint32_t frameCount, const MemoryBacking& backing)
     {
-        memory = (uint8_t*)malloc(size);
-        totalSize = size;
-        allocatedSize = 0;
+        AIR_ASSERTM(frameCount > 0 && frameCount <= FRAME_ALLOCATOR_MAX_FRAMES, "Frame allocator supports 1 to %u frames in flight.", FRAME_ALLOCATOR_MAX_FRAMES);
+
+        this->frameCount = frameCount;
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            arenas[i].init(sizePerFrame, backing);
+            arenaFrames[i] = UINT64_MAX;
+        }
+
+        currentArena = 0;
+        currentFrame = 0;
+        arenaFrames[0] = 0;
+        peakHighWaterMark = 0;
     }
 
-    void LinearAllocator::shutdown()
+    void FrameAllocator::shutdown()
     {
-        clear();
-        free(memory);
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            arenas[i].shutdown();
+        }
+
+        frameCount = 0;
     }
 
-    void* LinearAllocator::allocate(size_t size, size_t alignment)
+    void FrameAllocator::beginFrame(uint64_t frameIndex)
     {
-        AIR_ASSERT(size > 0);
+        AIR_ASSERTM(frameIndex >= currentFrame, "Frame index went backwards, %llu after %llu.", frameIndex, currentFrame);
 
-        const size_t newStart = memoryAlign(allocatedSize, alignment);
-        AIR_ASSERT(newStart < totalSize);
-        const size_t newAllocatedSize = newStart + size;
-        if (newAllocatedSize > totalSize)
+        currentFrame = frameIndex;
+        currentArena = (uint32_t)(frameIndex % frameCount);
+
+        //The arena last held frameIndex - frameCount, which has finished by now. Linear arenas only grow
+        //during a frame so its size is that frame's high-water mark.
+        LinearAllocator& arena = arenas[currentArena];
+        if (arena.allocatedSize > peakHighWaterMark)
         {
-            AIR_MEM_ASSERT(false, "Overflow");
-            return nullptr;
+            peakHighWaterMark = arena.allocatedSize;
         }
 
-        allocatedSize = newAllocatedSize;
-        return memory + newStart;
+        arena.clear();
+        arenaFrames[currentArena] = frameIndex;
     }
 
-    void* LinearAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
+    void* FrameAllocator::allocate(size_t size, size_t alignment)
+    {
+        return arenas[currentArena].allocate(size, alignment);
+    }
+
+    void* FrameAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
     {
         return allocate(size, alignment);
     }
 
-    void LinearAllocator::deallocate(void* /*pointer*/)
+    void FrameAllocator::deallocate(void* /*pointer*/)
     {
-        //This allocator does not allocate on a per pointer bases.
+        //Everything allocated in a frame is released together when its arena comes round again.
     }
 
-    void LinearAllocator::clear() 
+    size_t FrameAllocator::highWaterMark(uint64_t frameIndex) const
     {
-        allocatedSize = 0;
+        const uint32_t arena = (uint32_t)(frameIndex % frameCount);
+        return arenaFrames[arena] == frameIndex ? arenas[arena].allocatedSize : 0;
+    }
+
+#if defined AIR_IMGUI
+    void FrameAllocator::debugUI()
+    {
+        ImGui::Separator();
+        ImGui::Text("Frame Allocator");
+        ImGui::Separator();
+
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            ImGui::Text("\tFrame %llu: %llu Kb of %llu Kb", arenaFrames[i], arenas[i].allocatedSize / 1024, arenas[i].totalSize / 1024);
+        }
+        ImGui::Text("\tPeak frame %llu Kb", peakHighWaterMark / 1024);
     }
+#endif //AIR_IMGUI
 
     void memoryCopy(void* destination, void* source, size_t size) 
     {
@@ -281,16 +1279,17 @@ namespace Air
         free(pointer);
     }
 
-    void StackAllocator::init(size_t size, size_t alignment) 
+    void StackAllocator::init(size_t size, size_t alignment, const MemoryBacking& backing) 
     {
-        memory = (uint8_t*)malloc(size);
+        this->backing = backing;
+        memory = (uint8_t*)memoryBackingAllocate(size, this->backing);
         allocatedSize = 0;
         totalSize = size;
     }
 
     void StackAllocator::shutdown() 
     {
-        free(memory);
+        memoryBackingFree(memory, totalSize, backing);
     }
 
     void* StackAllocator::allocate(size_t size, size_t alignment) 
@@ -326,6 +1325,23 @@ namespace Air
         allocatedSize = sizeAtPointer;
     }
 
+    bool StackAllocator::resizeInPlace(void* pointer, size_t oldSize, size_t newSize)
+    {
+        if (pointer == nullptr)
+        {
+            return false;
+        }
+
+        const size_t offset = (uint8_t*)pointer - memory;
+        if (offset + oldSize != allocatedSize || offset + newSize > totalSize)
+        {
+            return false;
+        }
+
+        allocatedSize = offset + newSize;
+        return true;
+    }
+
     size_t StackAllocator::getMarker() 
     {
         return allocatedSize;
@@ -333,8 +1349,7 @@ namespace Air
 
     void StackAllocator::freeMarker(size_t marker) 
     {
-        const size_t difference = marker - allocatedSize;
-        if (difference > 0) 
+        if (marker < allocatedSize) 
         {
             allocatedSize = marker;
         }
@@ -442,7 +1457,7 @@ namespace Air
 
     void DoubleStackAllocator::freeTopMarker(size_t marker) 
     {
-        if (marker > top && marker < totalSize) 
+        if (marker > top && marker <= totalSize) 
         {
             top = marker;
         }
@@ -466,4 +1481,313 @@ namespace Air
         bottom = 0;
     }
 
+    ScopedArenaMarker::ScopedArenaMarker(LinearAllocator* arena)
+        : arena(arena), marker(arena->getMarker()), depth(++arena->markerDepth), kind(ARENA_MARKER_LINEAR)
+    {
+    }
+
+    ScopedArenaMarker::ScopedArenaMarker(StackAllocator* arena)
+        : arena(arena), marker(arena->getMarker()), depth(++arena->markerDepth), kind(ARENA_MARKER_STACK)
+    {
+    }
+
+    ScopedArenaMarker::ScopedArenaMarker(DoubleStackAllocator* arena, bool top)
+        : arena(arena)
+    {
+        if (top)
+        {
+            marker = arena->getTopMarker();
+            depth = ++arena->topMarkerDepth;
+            kind = ARENA_MARKER_DOUBLE_STACK_TOP;
+        }
+        else
+        {
+            marker = arena->getBottomMarker();
+            depth = ++arena->bottomMarkerDepth;
+            kind = ARENA_MARKER_DOUBLE_STACK_BOTTOM;
+        }
+    }
+
+    ScopedArenaMarker::~ScopedArenaMarker()
+    {
+        uint32_t* arenaDepth = nullptr;
+        switch (kind)
+        {
+            case ARENA_MARKER_LINEAR:
+            {
+                LinearAllocator* linear = static_cast<LinearAllocator*>(arena);
+                linear->freeMarker(marker);
+                arenaDepth = &linear->markerDepth;
+                break;
+            }
+            case ARENA_MARKER_STACK:
+            {
+                StackAllocator* stack = static_cast<StackAllocator*>(arena);
+                stack->freeMarker(marker);
+                arenaDepth = &stack->markerDepth;
+                break;
+            }
+            case ARENA_MARKER_DOUBLE_STACK_TOP:
+            {
+                DoubleStackAllocator* doubleStack = static_cast<DoubleStackAllocator*>(arena);
+                doubleStack->freeTopMarker(marker);
+                arenaDepth = &doubleStack->topMarkerDepth;
+                break;
+            }
+            case ARENA_MARKER_DOUBLE_STACK_BOTTOM:
+            {
+                DoubleStackAllocator* doubleStack = static_cast<DoubleStackAllocator*>(arena);
+                doubleStack->freeBottomMarker(marker);
+                arenaDepth = &doubleStack->bottomMarkerDepth;
+                break;
+            }
+        }
+
+#if defined(AIR_DEBUG)
+        //An inner scope that outlives its parent would have its memory rewound from under it.
+        AIR_ASSERTM(*arenaDepth == depth, "Scoped arena marker released out of order, depth %u while the arena is at depth %u.", depth, *arenaDepth);
+#endif
+        --*arenaDepth;
+    }
+
+    void* ScopedArenaMarker::allocate(size_t size, size_t alignment)
+    {
+        switch (kind)
+        {
+            case ARENA_MARKER_DOUBLE_STACK_TOP:
+                return static_cast<DoubleStackAllocator*>(arena)->allocateTop(size, alignment);
+            case ARENA_MARKER_DOUBLE_STACK_BOTTOM:
+                return static_cast<DoubleStackAllocator*>(arena)->allocateBottom(size, alignment);
+            default:
+                return arena->allocate(size, alignment);
+        }
+    }
+
+    static constexpr uint32_t POOL_MAGAZINE_SIZE = 32;
+
+    //Lives at the start of every slab, slabs are aligned to their size so elements can find it by masking.
+    struct PoolSlab
+    {
+        PoolAllocator* owner;
+        PoolSlab* next;
+    };
+
+    struct alignas(64) PoolMagazine
+    {
+        uint32_t count = 0;
+        void* elements[POOL_MAGAZINE_SIZE];
+    };
+
+    void PoolAllocator::init(Allocator* backingAllocator, size_t elementSize, size_t elementAlignment, size_t slabSize, bool threadLocalMagazines)
+    {
+        AIR_ASSERTM((slabSize & (slabSize - 1)) == 0, "Slab size %llu has to be a power of 2.", slabSize);
+
+        //Free elements store the next pointer in place, so they can't be smaller than a pointer.
+        this->backingAllocator = backingAllocator;
+        this->elementAlignment = elementAlignment < sizeof(void*) ? sizeof(void*) : elementAlignment;
+        this->elementSize = memoryAlign(elementSize < sizeof(void*) ? sizeof(void*) : elementSize, this->elementAlignment);
+        this->slabSize = slabSize;
+
+        const size_t firstElement = memoryAlign(sizeof(PoolSlab), this->elementAlignment);
+        AIR_ASSERTM(firstElement + this->elementSize <= slabSize, "Slab of %llu bytes can't fit a single %llu byte element.", slabSize, this->elementSize);
+        elementsPerSlab = (uint32_t)((slabSize - firstElement) / this->elementSize);
+
+        slabs = nullptr;
+        freeList = nullptr;
+        slabCursor = nullptr;
+        slabEnd = nullptr;
+        slabCount = 0;
+
+        magazines = threadLocalMagazines ? new PoolMagazine[MEMORY_MAX_THREADS] : nullptr;
+    }
+
+    void PoolAllocator::shutdown()
+    {
+        PoolSlab* slab = slabs;
+        while (slab)
+        {
+            PoolSlab* next = slab->next;
+            backingAllocator->deallocate(slab);
+            slab = next;
+        }
+
+        delete[] magazines;
+        magazines = nullptr;
+
+        slabs = nullptr;
+        freeList = nullptr;
+        slabCursor = nullptr;
+        slabEnd = nullptr;
+        slabCount = 0;
+    }
+
+    //Pops the shared free list, or carves a fresh element out of the newest slab. Takes a new slab when both are empty.
+    static void* poolAllocateShared(PoolAllocator* pool)
+    {
+        if (pool->freeList)
+        {
+            void* element = pool->freeList;
+            pool->freeList = *(void**)element;
+            return element;
+        }
+
+        if (pool->slabCursor == pool->slabEnd)
+        {
+            PoolSlab* slab = (PoolSlab*)pool->backingAllocator->allocate(pool->slabSize, pool->slabSize);
+            if (slab == nullptr)
+            {
+                AIR_MEM_ASSERT(false, "Pool backing allocator out of memory.");
+                return nullptr;
+            }
+            AIR_ASSERTM(((uintptr_t)slab & (pool->slabSize - 1)) == 0, "Backing allocator ignored the slab alignment of %llu.", pool->slabSize);
+
+            slab->owner = pool;
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            ++pool->slabCount;
+
+            pool->slabCursor = (uint8_t*)slab + memoryAlign(sizeof(PoolSlab), pool->elementAlignment);
+            pool->slabEnd = pool->slabCursor + pool->elementsPerSlab * pool->elementSize;
+        }
+
+        void* element = pool->slabCursor;
+        pool->slabCursor += pool->elementSize;
+        return element;
+    }
+
+    static void poolDeallocateShared(PoolAllocator* pool, void* pointer)
+    {
+        *(void**)pointer = pool->freeList;
+        pool->freeList = pointer;
+    }
+
+    void* PoolAllocator::allocate(size_t size, size_t alignment)
+    {
+        AIR_ASSERTM(size <= elementSize && alignment <= elementAlignment, "Pool of %llu byte elements can't serve %llu bytes aligned to %llu.", elementSize, size, alignment);
+
+        if (magazines == nullptr)
+        {
+            return poolAllocateShared(this);
+        }
+
+        const uint32_t threadIndex = memoryThreadIndex();
+        if (threadIndex >= MEMORY_MAX_THREADS)
+        {
+            std::lock_guard<std::mutex> lock(freeListMutex);
+            return poolAllocateShared(this);
+        }
+
+        PoolMagazine& magazine = magazines[threadIndex];
+        if (magazine.count == 0)
+        {
+            //Refill half a magazine so a thread bouncing around empty doesn't take the lock on every call.
+            std::lock_guard<std::mutex> lock(freeListMutex);
+            while (magazine.count < POOL_MAGAZINE_SIZE / 2)
+            {
+                void* element = poolAllocateShared(this);
+                if (element == nullptr)
+                {
+                    break;
+                }
+                magazine.elements[magazine.count++] = element;
+            }
+
+            if (magazine.count == 0)
+            {
+                return nullptr;
+            }
+        }
+
+        return magazine.elements[--magazine.count];
+    }
+
+    void* PoolAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
+    {
+        return allocate(size, alignment);
+    }
+
+    void PoolAllocator::deallocate(void* pointer)
+    {
+        if (magazines == nullptr)
+        {
+            poolDeallocateShared(this, pointer);
+            return;
+        }
+
+        const uint32_t threadIndex = memoryThreadIndex();
+        if (threadIndex >= MEMORY_MAX_THREADS)
+        {
+            std::lock_guard<std::mutex> lock(freeListMutex);
+            poolDeallocateShared(this, pointer);
+            return;
+        }
+
+        PoolMagazine& magazine = magazines[threadIndex];
+        if (magazine.count == POOL_MAGAZINE_SIZE)
+        {
+            std::lock_guard<std::mutex> lock(freeListMutex);
+            while (magazine.count > POOL_MAGAZINE_SIZE / 2)
+            {
+                poolDeallocateShared(this, magazine.elements[--magazine.count]);
+            }
+        }
+
+        magazine.elements[magazine.count++] = pointer;
+    }
+
+    PoolAllocator* PoolAllocator::owner(void* pointer, size_t slabSize)
+    {
+        PoolSlab* slab = (PoolSlab*)((uintptr_t)pointer & ~(uintptr_t)(slabSize - 1));
+        return slab->owner;
+    }
+
+    void SlabAllocator::init(Allocator* backingAllocator, size_t slabSize, bool threadLocalMagazines)
+    {
+        this->slabSize = slabSize;
+
+        //Size classes from 64 bytes up get their own cache lines.
+        for (uint32_t i = 0; i < SLAB_SIZE_CLASS_COUNT; ++i)
+        {
+            const size_t alignment = SLAB_SIZE_CLASSES[i] < 64 ? SLAB_SIZE_CLASSES[i] : 64;
+            pools[i].init(backingAllocator, SLAB_SIZE_CLASSES[i], alignment, slabSize, threadLocalMagazines);
+        }
+    }
+
+    void SlabAllocator::shutdown()
+    {
+        for (uint32_t i = 0; i < SLAB_SIZE_CLASS_COUNT; ++i)
+        {
+            pools[i].shutdown();
+        }
+    }
+
+    void* SlabAllocator::allocate(size_t size, size_t alignment)
+    {
+        for (uint32_t i = 0; i < SLAB_SIZE_CLASS_COUNT; ++i)
+        {
+            if (size <= SLAB_SIZE_CLASSES[i] && alignment <= pools[i].elementAlignment)
+            {
+                return pools[i].allocate(size, alignment);
+            }
+        }
+
+        AIR_ASSERTM(false, "SlabAllocator can't serve %llu bytes aligned to %llu.", size, alignment);
+        return nullptr;
+    }
+
+    void* SlabAllocator::allocate(size_t size, size_t alignment, const char* file, int32_t line)
+    {
+        return allocate(size, alignment);
+    }
+
+    void SlabAllocator::deallocate(void* pointer)
+    {
+        //owner would read the slab header at address 0.
+        if (pointer == nullptr)
+        {
+            return;
+        }
+
+        PoolAllocator::owner(pointer, slabSize)->deallocate(pointer);
+    }
 }
\ No newline at end of file
@@ -3,6 +3,11 @@
 
 #include "Platform.h"
 #include "Service.h"
+#include "MemoryTracker.h"
+#include "MemoryUtils.h"
+
+#include <mutex>
+#include <atomic>
 
 #define AIR_IMGUI
 
@@ -12,6 +17,14 @@ namespace Air
     //Calculate memory alignment size.
     size_t memoryAlign(size_t size, size_t alignment);
 
+    //Upper bound on the threads that get their own per-thread allocator state.
+    //Threads past this limit still work, they just go through the shared locked paths.
+    static constexpr uint32_t MEMORY_MAX_THREADS = 64;
+
+    //Returns a small index for the calling thread, stable for its lifetime. Indices of exited threads are reused, so
+    //the limit is on threads alive at once. MEMORY_MAX_THREADS or above means the thread has no per-thread state.
+    uint32_t memoryThreadIndex();
+
     struct MemoryStatistics 
     {
         size_t allocatedBytes;
@@ -36,15 +49,46 @@ namespace Air
         virtual void* allocate(size_t size, size_t alignment, const char* file, int32_t line) = 0;
 
         virtual void deallocate(void * pointer) = 0;
+
+        //Resizes an allocation, moving it when it has to. The first oldSize bytes are kept bitwise, so only use it
+        //for trivially copyable data. The default allocates, copies and frees.
+        virtual void* reallocate(void* pointer, size_t oldSize, size_t newSize, size_t alignment);
+        //Resizes an allocation only if it can stay where it is. Safe for any data, nothing is copied.
+        virtual bool resizeInPlace(void* /*pointer*/, size_t /*oldSize*/, size_t /*newSize*/)
+        {
+            return false;
+        }
     };
 
+    struct HeapThreadCache;
+
+    static constexpr uint32_t HEAP_MAX_POOLS = 64;
+    static constexpr uint32_t HEAP_MAX_GRANULES = 256;
+
+    //A TLSF pool living in a run of granules of the heap reservation.
+    struct HeapPool
+    {
+        void* tlsfPool = nullptr;
+        uint32_t firstGranule = 0;
+        uint32_t granuleCount = 0;
+    };
+
+    //TLSF backed heap. In multi-threaded mode every thread gets a cache of small size-class blocks
+    //in front of the shared TLSF pool, so only cache refills and big allocations take the pool lock.
+    //The heap reserves reserveSize bytes of address space up front and commits it in steps of size bytes,
+    //adding a TLSF pool each time it runs out. A reserveSize of 0 keeps it at a fixed size.
     struct HeapAllocator : public Allocator
     {
         virtual ~HeapAllocator() override = default;
 
-        void init(size_t size);
+        void init(size_t size, bool multiThreaded = false, size_t reserveSize = 0, const MemoryBacking& backing = MemoryBacking{});
         void shutdown();
 
+        //Commits enough granules to fit an allocation of size bytes and adds them as a new pool.
+        bool grow(size_t size);
+        //Removes grown pools that have nothing allocated and decommits their memory. Returns the number released.
+        uint32_t releaseEmptyPools();
+
 #if defined AIR_IMGUI
         void debugUI();
 #endif //AIR_IMGUI
@@ -54,17 +98,36 @@ namespace Air
 
         void deallocate(void* pointer);
 
+        void* reallocate(void* pointer, size_t oldSize, size_t newSize, size_t alignment) override;
+        bool resizeInPlace(void* pointer, size_t oldSize, size_t newSize) override;
+
         void* TLSFHandle  = nullptr;
+        //Start of the address space reservation.
         void* memory = nullptr;
+        //Bytes taken from the TLSF pools. In multi-threaded mode cache chunks count as allocated.
         size_t allocatedSize = 0;
+        //Bytes currently committed across all pools.
         size_t maxSize = 0;
+        size_t reservedSize = 0;
+        size_t granuleSize = 0;
+        MemoryBacking backing;
+
+        HeapPool pools[HEAP_MAX_POOLS];
+        uint8_t granuleUsed[HEAP_MAX_GRANULES] = {};
+
+        HeapThreadCache* threadCaches = nullptr;
+        std::mutex poolMutex;
+        bool multiThreaded = false;
+
+        //Optional. When set every allocation is recorded with its call site and a summary is dumped on shutdown.
+        MemoryTracker* tracker = nullptr;
     };
 
     struct StackAllocator : public Allocator
     {
         virtual ~StackAllocator() override = default;
 
-        void init(size_t size, size_t alignment);
+        void init(size_t size, size_t alignment, const MemoryBacking& backing = MemoryBacking{});
         void shutdown();
 
         void* allocate(size_t size, size_t alignment) override;
@@ -72,7 +135,11 @@ namespace Air
 
         void deallocate(void* pointer) override;
 
+        //Only the most recent allocation can be resized.
+        bool resizeInPlace(void* pointer, size_t oldSize, size_t newSize) override;
+
         size_t getMarker();
+        //Rewinds to a marker taken earlier. Markers past the current top are ignored.
         void freeMarker(size_t marker);
 
         void clear();
@@ -80,6 +147,9 @@ namespace Air
         uint8_t* memory = nullptr;
         size_t totalSize = 0;
         size_t allocatedSize = 0;
+        MemoryBacking backing;
+        //Number of live ScopedArenaMarkers, used to catch scopes ending out of order.
+        uint32_t markerDepth = 0;
     };
 
     struct DoubleStackAllocator : public Allocator
@@ -113,14 +183,16 @@ namespace Air
         size_t totalSize = 0;
         size_t top = 0;
         size_t bottom = 0;
+        uint32_t topMarkerDepth = 0;
+        uint32_t bottomMarkerDepth = 0;
     };
 
-    //This allocator can only be reset.
+    //Everything is freed at once with clear(), or rewound to a marker.
     struct LinearAllocator : public Allocator
     {
         virtual ~LinearAllocator() override = default;
 
-        void init(size_t size);
+        void init(size_t size, const MemoryBacking& backing = MemoryBacking{});
         void shutdown();
 
         void* allocate(size_t size, size_t alignment) override;
@@ -128,11 +200,116 @@ namespace Air
 
         void deallocate(void* pointer) override;
 
+        //Only the most recent allocation can be resized.
+        bool resizeInPlace(void* pointer, size_t oldSize, size_t newSize) override;
+
+        size_t getMarker();
+        //Rewinds to a marker taken earlier. Markers past the current offset are ignored.
+        void freeMarker(size_t marker);
+
         void clear();
 
         uint8_t* memory = nullptr;
         size_t totalSize = 0;
         size_t allocatedSize = 0;
+        MemoryBacking backing;
+        uint32_t markerDepth = 0;
+    };
+
+    enum ArenaMarkerKind : uint8_t
+    {
+        ARENA_MARKER_LINEAR = 0,
+        ARENA_MARKER_STACK,
+        ARENA_MARKER_DOUBLE_STACK_TOP,
+        ARENA_MARKER_DOUBLE_STACK_BOTTOM,
+    };
+
+    //Remembers where an arena is and rewinds it there when the scope ends, so temporary memory can't leak arena space.
+    //Scopes nest and must end in reverse order, debug builds assert when they don't.
+    struct ScopedArenaMarker
+    {
+        explicit ScopedArenaMarker(LinearAllocator* arena);
+        explicit ScopedArenaMarker(StackAllocator* arena);
+        //top picks which end of the double stack the scope covers.
+        ScopedArenaMarker(DoubleStackAllocator* arena, bool top);
+        ~ScopedArenaMarker();
+
+        ScopedArenaMarker(const ScopedArenaMarker&) = delete;
+        ScopedArenaMarker& operator=(const ScopedArenaMarker&) = delete;
+
+        //Allocates from the arena, or from the scope's end of a double stack.
+        void* allocate(size_t size, size_t alignment);
+
+        Allocator* arena = nullptr;
+        size_t marker = 0;
+        uint32_t depth = 0;
+        ArenaMarkerKind kind = ARENA_MARKER_LINEAR;
+    };
+
+    struct ConcurrentLinearBlock;
+
+    //Linear allocator that can be shared between worker threads. Allocations bump the shared offset with an atomic fetch-add.
+    //With a non zero threadBlockSize every thread instead carves private blocks out of the arena and bumps those,
+    //so threads don't fight over the offset cache line. clear() means the same as LinearAllocator::clear()
+    //and must not run while other threads are still allocating.
+    struct ConcurrentLinearAllocator : public Allocator
+    {
+        virtual ~ConcurrentLinearAllocator() override = default;
+
+        void init(size_t size, size_t threadBlockSize = 0);
+        void shutdown();
+
+        void* allocate(size_t size, size_t alignment) override;
+        void* allocate(size_t size, size_t alignment, const char* file, int32_t line) override;
+
+        void deallocate(void* pointer) override;
+
+        void clear();
+
+        uint8_t* memory = nullptr;
+        size_t totalSize = 0;
+        size_t threadBlockSize = 0;
+        ConcurrentLinearBlock* threadBlocks = nullptr;
+        //Bumped by clear() so thread blocks from before the clear are dropped.
+        std::atomic<uint64_t> generation{ 1 };
+
+        alignas(64) std::atomic<size_t> allocatedSize{ 0 };
+    };
+
+    static constexpr uint32_t FRAME_ALLOCATOR_MAX_FRAMES = 4;
+
+    //A ring of linear arenas, one per frame in flight. Memory allocated during frame F stays valid until
+    //frame F + frameCount - 1 has finished, so the GPU and async jobs can keep reading it.
+    //beginFrame recycles the arena of the oldest frame. Nothing is freed individually.
+    struct FrameAllocator : public Allocator
+    {
+        virtual ~FrameAllocator() override = default;
+
+        void init(size_t sizePerFrame, uint32_t frameCount = 2, const MemoryBacking& backing = MemoryBacking{});
+        void shutdown();
+
+        //Call once at the start of every frame with an increasing frame index.
+        void beginFrame(uint64_t frameIndex);
+
+#if defined AIR_IMGUI
+        void debugUI();
+#endif //AIR_IMGUI
+
+        void* allocate(size_t size, size_t alignment) override;
+        void* allocate(size_t size, size_t alignment, const char* file, int32_t line) override;
+
+        void deallocate(void* pointer) override;
+
+        //Bytes used so far by a frame that is still in flight, 0 once its arena was recycled.
+        size_t highWaterMark(uint64_t frameIndex) const;
+
+        LinearAllocator arenas[FRAME_ALLOCATOR_MAX_FRAMES];
+        uint64_t arenaFrames[FRAME_ALLOCATOR_MAX_FRAMES] = {};
+        //Largest amount a single finished frame has used.
+        size_t peakHighWaterMark = 0;
+        uint64_t currentFrame = 0;
+        uint32_t currentArena = 0;
+        uint32_t frameCount = 0;
     };
 
     //DO NOT use this for runtime processes. ONLY compilation resources.
@@ -145,10 +322,86 @@ namespace Air
         void deallocate(void* pointer) override;
     };
 
+    struct PoolSlab;
+    struct PoolMagazine;
+
+    //Hands out elements of a single size from slabs taken from the backing allocator.
+    //Slabs are aligned to their own size (so at least a cache line), which lets any element find its slab and pool by masking.
+    //Free elements are linked through their own memory so there is no per element overhead.
+    //With thread local magazines every thread keeps a small stack of free elements and only takes the lock to refill or flush it.
+    struct PoolAllocator : public Allocator
+    {
+        virtual ~PoolAllocator() override = default;
+
+        //slabSize has to be a power of 2 and the backing allocator has to honour it as an alignment.
+        void init(Allocator* backingAllocator, size_t elementSize, size_t elementAlignment = 16, size_t slabSize = 64 * 1024,
+                  bool threadLocalMagazines = false);
+        void shutdown();
+
+        void* allocate(size_t size, size_t alignment) override;
+        void* allocate(size_t size, size_t alignment, const char* file, int32_t line) override;
+
+        void deallocate(void* pointer) override;
+
+        //Finds the pool that handed out pointer.
+        static PoolAllocator* owner(void* pointer, size_t slabSize);
+
+        Allocator* backingAllocator = nullptr;
+        PoolSlab* slabs = nullptr;
+        void* freeList = nullptr;
+        //Elements of the newest slab that have never been handed out.
+        uint8_t* slabCursor = nullptr;
+        uint8_t* slabEnd = nullptr;
+
+        PoolMagazine* magazines = nullptr;
+        std::mutex freeListMutex;
+
+        size_t elementSize = 0;
+        size_t elementAlignment = 0;
+        size_t slabSize = 0;
+        uint32_t elementsPerSlab = 0;
+        uint32_t slabCount = 0;
+    };
+
+    static constexpr size_t SLAB_SIZE_CLASSES[] = { 16, 32, 64, 128, 256 };
+    static constexpr uint32_t SLAB_SIZE_CLASS_COUNT = ArraySize(SLAB_SIZE_CLASSES);
+
+    //A PoolAllocator per size class. Meant for small objects only, anything over the biggest class is refused.
+    struct SlabAllocator : public Allocator
+    {
+        virtual ~SlabAllocator() override = default;
+
+        void init(Allocator* backingAllocator, size_t slabSize = 64 * 1024, bool threadLocalMagazines = false);
+        void shutdown();
+
+        void* allocate(size_t size, size_t alignment) override;
+        void* allocate(size_t size, size_t alignment, const char* file, int32_t line) override;
+
+        void deallocate(void* pointer) override;
+
+        PoolAllocator pools[SLAB_SIZE_CLASS_COUNT];
+        size_t slabSize = 0;
+    };
+
     struct MemoryServiceConfiguration 
     {
-        //We can only allocate 32MB of memory all at once by default.
+        //The heap starts with 32MB committed and grows in steps of the same size.
         size_t maximumDynamicSize = 32 * 1024 * 1024;
+        //Address space reserved for the heap to grow into. Only committed pages cost memory.
+        size_t dynamicReserveSize = size_t(4) * 1024 * 1024 * 1024;
+        //Give every thread its own small-block cache in front of the system heap.
+        bool multiThreadedHeap = false;
+        //Record call site, size and thread of every system heap allocation.
+        bool trackAllocations = false;
+        uint32_t maximumTrackedAllocations = 1024 * 1024;
+
+        size_t scratchSize = 8 * 1024 * 1024;
+        //Size of each per-frame arena, and how many frames can be in flight.
+        size_t frameAllocatorSize = 8 * 1024 * 1024;
+        uint32_t framesInFlight = 2;
+
+        //Page type and NUMA node for the system heap, scratch and frame allocators. Big heaps want huge pages to cut TLB misses.
+        MemoryBacking backing;
     };
 
     struct MemoryService : public Service 
@@ -165,7 +418,9 @@ namespace Air
 #endif
 
         LinearAllocator scratchAllocator;
+        FrameAllocator frameAllocator;
         HeapAllocator systemAllocator;
+        MemoryTracker tracker;
 
         //tests the allocators.
         void test();
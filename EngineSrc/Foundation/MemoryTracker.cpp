@@ -0,0 +1,237 @@
+#include "MemoryTracker.h"
+#include "Memory.h"
+#include "Time.h"
+#include "Log.h"
+#include "Assert.h"
+
+#include <stdlib.h>
+#include <new>
+
+namespace Air 
+{
+    //Records never move further than this from their home slot, which bounds the cost of a lookup that misses.
+    static constexpr uint32_t TRACKER_MAX_PROBE = 64;
+    static constexpr uintptr_t TRACKER_TOMBSTONE = 1;
+
+    static uint32_t trackerTableSize(uint32_t minimumSize)
+    {
+        uint32_t size = 64;
+        while (size < minimumSize)
+        {
+            size <<= 1;
+        }
+
+        return size;
+    }
+
+    static uint64_t trackerMix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDull;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ull;
+        value ^= value >> 33;
+        return value;
+    }
+
+    static uint32_t trackerFindCallSite(MemoryTracker* tracker, const char* file, int32_t line)
+    {
+        //Zero marks a free slot, so the key always has its low bit set.
+        const uint64_t key = trackerMix((uint64_t)(uintptr_t)file ^ ((uint64_t)(uint32_t)line << 32)) | 1;
+
+        uint32_t index = (uint32_t)key & tracker->callSiteMask;
+        for (uint32_t probe = 0; probe <= tracker->callSiteMask; ++probe)
+        {
+            MemoryCallSite& site = tracker->callSites[index];
+            uint64_t currentKey = site.key.load(std::memory_order_acquire);
+            if (currentKey == 0 && site.key.compare_exchange_strong(currentKey, key, std::memory_order_acq_rel))
+            {
+                site.file.store(file, std::memory_order_relaxed);
+                site.line.store(line, std::memory_order_relaxed);
+                return index;
+            }
+
+            if (currentKey == key)
+            {
+                return index;
+            }
+
+            index = (index + 1) & tracker->callSiteMask;
+        }
+
+        return UINT32_MAX;
+    }
+
+    void MemoryTracker::init(uint32_t maximumAllocations, uint32_t maximumCallSites)
+    {
+        //Timestamps need the performance counter frequency on Windows, and memory usually comes up first.
+        timeServiceInit();
+        startTime = timeNow();
+
+        const uint32_t allocationCount = trackerTableSize(maximumAllocations);
+        const uint32_t callSiteCount = trackerTableSize(maximumCallSites);
+        allocationMask = allocationCount - 1;
+        callSiteMask = callSiteCount - 1;
+
+        allocations = (MemoryAllocationRecord*)malloc(sizeof(MemoryAllocationRecord) * allocationCount);
+        callSites = (MemoryCallSite*)malloc(sizeof(MemoryCallSite) * callSiteCount);
+        AIR_ASSERTM(allocations != nullptr && callSites != nullptr, "Failed to allocate the memory tracker tables.");
+
+        for (uint32_t i = 0; i < allocationCount; ++i)
+        {
+            new (allocations + i) MemoryAllocationRecord();
+        }
+
+        for (uint32_t i = 0; i < callSiteCount; ++i)
+        {
+            new (callSites + i) MemoryCallSite();
+        }
+
+        droppedAllocations.store(0, std::memory_order_relaxed);
+        aprint("Memory tracker tracking up to %u allocations from %u call sites.\n", allocationCount, callSiteCount);
+    }
+
+    void MemoryTracker::shutdown()
+    {
+        free(allocations);
+        free(callSites);
+
+        allocations = nullptr;
+        callSites = nullptr;
+        allocationMask = callSiteMask = 0;
+    }
+
+    void MemoryTracker::recordAllocation(void* pointer, size_t size, const char* file, int32_t line)
+    {
+        const uint32_t callSiteIndex = trackerFindCallSite(this, file, line);
+        if (callSiteIndex == UINT32_MAX)
+        {
+            droppedAllocations.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const int64_t now = timeNow();
+        const uint32_t threadIndex = memoryThreadIndex();
+
+        uint32_t index = (uint32_t)trackerMix((uintptr_t)pointer) & allocationMask;
+        for (uint32_t probe = 0; probe < TRACKER_MAX_PROBE; ++probe)
+        {
+            MemoryAllocationRecord& record = allocations[index];
+            uintptr_t currentPointer = record.pointer.load(std::memory_order_relaxed);
+            if (currentPointer <= TRACKER_TOMBSTONE &&
+                record.pointer.compare_exchange_strong(currentPointer, (uintptr_t)pointer, std::memory_order_acquire))
+            {
+                //Only the allocating thread writes these. Whoever frees the pointer got it handed over after this returned.
+                record.size = size;
+                record.timestamp = now;
+                record.callSite = callSiteIndex;
+                record.threadIndex = threadIndex;
+
+                MemoryCallSite& site = callSites[callSiteIndex];
+                site.allocationCount.fetch_add(1, std::memory_order_relaxed);
+                site.totalBytes.fetch_add(size, std::memory_order_relaxed);
+                site.threadMask.fetch_or(1ull << (threadIndex < 63 ? threadIndex : 63), std::memory_order_relaxed);
+
+                const int64_t liveBytes = site.liveBytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+                int64_t peakBytes = site.peakBytes.load(std::memory_order_relaxed);
+                while (liveBytes > peakBytes && site.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed) == false)
+                {
+                }
+
+                int64_t firstTime = 0;
+                site.firstAllocationTime.compare_exchange_strong(firstTime, now, std::memory_order_relaxed);
+                site.lastAllocationTime.store(now, std::memory_order_relaxed);
+                return;
+            }
+
+            index = (index + 1) & allocationMask;
+        }
+
+        droppedAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void MemoryTracker::recordDeallocation(void* pointer)
+    {
+        uint32_t index = (uint32_t)trackerMix((uintptr_t)pointer) & allocationMask;
+        for (uint32_t probe = 0; probe < TRACKER_MAX_PROBE; ++probe)
+        {
+            MemoryAllocationRecord& record = allocations[index];
+            uintptr_t currentPointer = record.pointer.load(std::memory_order_acquire);
+            if (currentPointer == 0)
+            {
+                //Never recorded, either dropped or allocated before tracking started.
+                return;
+            }
+
+            if (currentPointer == (uintptr_t)pointer)
+            {
+                MemoryCallSite& site = callSites[record.callSite];
+                site.liveBytes.fetch_sub((int64_t)record.size, std::memory_order_relaxed);
+                site.freeCount.fetch_add(1, std::memory_order_relaxed);
+
+                record.pointer.store(TRACKER_TOMBSTONE, std::memory_order_release);
+                return;
+            }
+
+            index = (index + 1) & allocationMask;
+        }
+    }
+
+    void MemoryTracker::dump(uint32_t maximumCallSites) const
+    {
+        const uint32_t callSiteCount = callSiteMask + 1;
+        uint32_t* order = (uint32_t*)malloc(sizeof(uint32_t) * callSiteCount);
+        uint32_t usedCallSites = 0;
+        int64_t totalLiveBytes = 0;
+        for (uint32_t i = 0; i < callSiteCount; ++i)
+        {
+            if (callSites[i].key.load(std::memory_order_acquire))
+            {
+                order[usedCallSites++] = i;
+                totalLiveBytes += callSites[i].liveBytes.load(std::memory_order_relaxed);
+            }
+        }
+
+        //Only the top few are printed, so a partial selection sort is plenty.
+        const uint32_t printedCallSites = usedCallSites < maximumCallSites ? usedCallSites : maximumCallSites;
+        for (uint32_t i = 0; i < printedCallSites; ++i)
+        {
+            uint32_t largest = i;
+            for (uint32_t j = i + 1; j < usedCallSites; ++j)
+            {
+                if (callSites[order[j]].liveBytes.load(std::memory_order_relaxed) > callSites[order[largest]].liveBytes.load(std::memory_order_relaxed))
+                {
+                    largest = j;
+                }
+            }
+
+            const uint32_t swap = order[i];
+            order[i] = order[largest];
+            order[largest] = swap;
+        }
+
+        const int64_t now = timeNow();
+        aprint("Memory tracker: %u call sites, %lld live bytes, %llu allocations not tracked, %.2f seconds.\n", usedCallSites,
+               (long long)totalLiveBytes, (unsigned long long)droppedAllocations.load(std::memory_order_relaxed), timeDeltaSeconds(startTime, now));
+        aprint("%14s %14s %10s %10s %12s  %s\n", "live", "peak", "allocs", "frees", "allocs/sec", "call site");
+
+        for (uint32_t i = 0; i < printedCallSites; ++i)
+        {
+            const MemoryCallSite& site = callSites[order[i]];
+            const uint64_t allocationCount = site.allocationCount.load(std::memory_order_relaxed);
+
+            //Rate over the time this site has been active, so sites that only allocate at startup don't look idle.
+            const double activeSeconds = timeDeltaSeconds(site.firstAllocationTime.load(std::memory_order_relaxed), now);
+            const double allocationRate = activeSeconds > 0.001 ? (double)allocationCount / activeSeconds : (double)allocationCount;
+
+            const char* file = site.file.load(std::memory_order_relaxed);
+            aprint("%14lld %14lld %10llu %10llu %12.1f  %s(%d) threads 0x%llx\n",
+                   (long long)site.liveBytes.load(std::memory_order_relaxed), (long long)site.peakBytes.load(std::memory_order_relaxed),
+                   (unsigned long long)allocationCount, (unsigned long long)site.freeCount.load(std::memory_order_relaxed), allocationRate,
+                   file ? file : "unknown", site.line.load(std::memory_order_relaxed),
+                   (unsigned long long)site.threadMask.load(std::memory_order_relaxed));
+        }
+
+        free(order);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef MEMORY_TRACKER_HDR
+#define MEMORY_TRACKER_HDR
+
+#include "Platform.h"
+
+#include <atomic>
+
+namespace Air 
+{
+    //Per call site counters. Sites are keyed on the file pointer and line passed to allocate.
+    struct MemoryCallSite
+    {
+        std::atomic<uint64_t> key{ 0 };
+        std::atomic<const char*> file{ nullptr };
+        std::atomic<int32_t> line{ 0 };
+
+        std::atomic<int64_t> liveBytes{ 0 };
+        std::atomic<int64_t> peakBytes{ 0 };
+        std::atomic<uint64_t> totalBytes{ 0 };
+        std::atomic<uint64_t> allocationCount{ 0 };
+        std::atomic<uint64_t> freeCount{ 0 };
+        //Bit per memoryThreadIndex() that allocated from this site, threads past 63 share the top bit.
+        std::atomic<uint64_t> threadMask{ 0 };
+        std::atomic<int64_t> firstAllocationTime{ 0 };
+        std::atomic<int64_t> lastAllocationTime{ 0 };
+    };
+
+    //One live allocation. The pointer is the key of an open addressed table, so it is only ever written with a CAS.
+    struct MemoryAllocationRecord
+    {
+        std::atomic<uintptr_t> pointer{ 0 };
+        uint64_t size = 0;
+        int64_t timestamp = 0;
+        uint32_t callSite = 0;
+        uint32_t threadIndex = 0;
+    };
+
+    //Opt-in, lock free allocation tracking. Both tables are fixed size and allocated once in init, with malloc,
+    //so tracking never allocates through the allocator it is watching. When a table fills up the allocation
+    //is still served but not recorded, and droppedAllocations counts it.
+    struct MemoryTracker
+    {
+        void init(uint32_t maximumAllocations, uint32_t maximumCallSites = 4096);
+        void shutdown();
+
+        void recordAllocation(void* pointer, size_t size, const char* file, int32_t line);
+        void recordDeallocation(void* pointer);
+
+        //Prints live bytes, peak bytes and allocation rate for the call sites holding the most memory.
+        void dump(uint32_t maximumCallSites = 32) const;
+
+        MemoryAllocationRecord* allocations = nullptr;
+        MemoryCallSite* callSites = nullptr;
+        uint32_t allocationMask = 0;
+        uint32_t callSiteMask = 0;
+
+        std::atomic<uint64_t> droppedAllocations{ 0 };
+        int64_t startTime = 0;
+    };
+}
+
+#endif // !MEMORY_TRACKER_HDR
@@ -1,9 +1,51 @@
 #ifndef MEMORY_UTILS_HDR
 #define MEMORY_UTILS_HDR
 
-namespace Air 
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Air
 {
-    //TODO: add more utils or delete file if it's remains empty.
+    //Where an allocator gets its block of memory from. Each type falls back to the one before it when the OS can't provide it.
+    enum MemoryBackingType : uint8_t
+    {
+        MEMORY_BACKING_MALLOC = 0,
+        //Plain anonymous pages straight from the OS.
+        MEMORY_BACKING_PAGES,
+        //Anonymous pages with MADV_HUGEPAGE, the kernel uses 2MB pages where it can. Plain pages on Windows.
+        MEMORY_BACKING_TRANSPARENT_HUGE_PAGES,
+        //MAP_HUGETLB (MEM_LARGE_PAGES on Windows) from the preallocated huge page pool.
+        MEMORY_BACKING_EXPLICIT_HUGE_PAGES,
+    };
+
+    struct MemoryBacking
+    {
+        MemoryBackingType type = MEMORY_BACKING_MALLOC;
+        //NUMA node the pages are bound to, -1 leaves placement to the OS. Ignored for malloc.
+        int32_t numaNode = -1;
+        //Set by memoryBackingAllocate to the rounded size it mapped, which memoryBackingFree unmaps. type can fall back
+        //to one with a smaller page size after the mapping is made, so it can't be worked out again from type.
+        size_t mappedSize = 0;
+    };
+
+    //Virtual memory helpers. Sizes and addresses have to be multiples of memoryPageSize().
+    size_t memoryPageSize();
+    size_t memoryHugePageSize();
+
+    //Reserves address space without backing it with any physical memory.
+    //With a backing the range is set up for its page type and NUMA node, and backing is updated to what was actually used.
+    //Reservations never get explicit huge pages, those would all be taken from the pool up front, see memoryBackingAllocate.
+    void* memoryReserve(size_t size, MemoryBacking* backing = nullptr);
+    //Makes part of a reservation usable. Physical pages are only paid for when they are first touched.
+    bool memoryCommit(void* address, size_t size);
+    //Hands the physical pages back to the OS but keeps the address range reserved.
+    void memoryDecommit(void* address, size_t size);
+    void memoryRelease(void* address, size_t size);
+
+    //Allocates a fixed block of size bytes for an allocator. backing is updated to what was actually used,
+    //pass the same size and backing to memoryBackingFree.
+    void* memoryBackingAllocate(size_t size, MemoryBacking& backing);
+    void memoryBackingFree(void* memory, size_t size, const MemoryBacking& backing);
 }
 
 #endif // !MEMORY_UTILS_HDR
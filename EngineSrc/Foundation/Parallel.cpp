@@ -0,0 +1,109 @@
+#include "Parallel.h"
+
+#include <vender/enkiTS/TaskScheduler.h>
+
+namespace Air
+{
+    struct ParallelTaskSet : public enki::ITaskSet
+    {
+        ParallelTaskSet(uint32_t count, uint32_t grainSize, ParallelRangeFunction function, void* userData)
+            : enki::ITaskSet(count, grainSize), function(function), userData(userData)
+        {
+        }
+
+        void ExecuteRange(enki::TaskSetPartition range, uint32_t threadNum) override
+        {
+            function(userData, range.start, range.end, threadNum);
+        }
+
+        ParallelRangeFunction function;
+        void* userData;
+    };
+
+    void ParallelContext::init(enki::TaskScheduler* scheduler, Allocator* allocator, size_t scratchSizePerWorker)
+    {
+        AIR_ASSERTM(scratchSizePerWorker > 0, "Parallel algorithms need some scratch memory per worker.");
+
+        this->scheduler = scheduler;
+        this->allocator = allocator;
+        workerCount = scheduler ? scheduler->GetNumTaskThreads() : 1;
+
+        scratch = (LinearAllocator*)air_allocaa(sizeof(LinearAllocator) * workerCount, allocator, alignof(LinearAllocator));
+        for (uint32_t i = 0; i < workerCount; ++i)
+        {
+            new (&scratch[i]) LinearAllocator();
+            scratch[i].init(scratchSizePerWorker);
+        }
+    }
+
+    void ParallelContext::shutdown()
+    {
+        for (uint32_t i = 0; i < workerCount; ++i)
+        {
+            scratch[i].shutdown();
+            scratch[i].~LinearAllocator();
+        }
+
+        air_free(scratch, allocator);
+        scratch = nullptr;
+        workerCount = 0;
+        scheduler = nullptr;
+    }
+
+    uint32_t ParallelContext::currentThread() const
+    {
+        return scheduler ? scheduler->GetThreadNum() : 0;
+    }
+
+    LinearAllocator* ParallelContext::workerScratch(uint32_t threadIndex)
+    {
+        AIR_ASSERTM(threadIndex < workerCount, "Thread %u isn't one of the scheduler's task threads.", threadIndex);
+        return &scratch[threadIndex];
+    }
+
+    ParallelScratch::ParallelScratch(ParallelContext& context)
+        : arena(context.workerScratch(context.currentThread())), fallback(context.allocator), marker(arena)
+    {
+    }
+
+    ParallelScratch::~ParallelScratch()
+    {
+        for (uint32_t i = 0; i < fallbackCount; ++i)
+        {
+            air_free(fallbackAllocations[i], fallback);
+        }
+    }
+
+    void* ParallelScratch::allocate(size_t size, size_t alignment)
+    {
+        if (memoryAlign(arena->allocatedSize, alignment) + size <= arena->totalSize)
+        {
+            return marker.allocate(size, alignment);
+        }
+
+        AIR_ASSERTM(fallbackCount < PARALLEL_SCRATCH_MAX_ALLOCATIONS, "Too many scratch allocations spilled out of the worker arena.");
+        void* memory = air_allocaa(size, fallback, alignment);
+        fallbackAllocations[fallbackCount++] = memory;
+        return memory;
+    }
+
+    void parallelRun(ParallelContext& context, uint32_t count, uint32_t grainSize, ParallelRangeFunction function, void* userData)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        grainSize = grainSize ? grainSize : 1;
+        if (context.scheduler == nullptr || context.workerCount <= 1 || count <= grainSize)
+        {
+            function(userData, 0, count, context.currentThread());
+            return;
+        }
+
+        //The calling thread helps out with the ranges while it waits, so this is safe to call from inside a task.
+        ParallelTaskSet taskSet(count, grainSize, function, userData);
+        context.scheduler->AddTaskSetToPipe(&taskSet);
+        context.scheduler->WaitforTask(&taskSet);
+    }
+}
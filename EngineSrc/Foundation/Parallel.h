@@ -0,0 +1,450 @@
+#ifndef PARALLEL_HDR
+#define PARALLEL_HDR
+
+#include "Platform.h"
+#include "Memory.h"
+#include "Array.h"
+#include "Assert.h"
+
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+namespace enki
+{
+    class TaskScheduler;
+}
+
+namespace Air
+{
+    //Ranges handed to a worker are never smaller than this unless the whole job is.
+    static constexpr uint32_t PARALLEL_DEFAULT_GRAIN_SIZE = 4096;
+    //Allocations that an algorithm can make out of one ParallelScratch before it runs out of slots.
+    static constexpr uint32_t PARALLEL_SCRATCH_MAX_ALLOCATIONS = 4;
+
+    //Shares an enkiTS scheduler between the parallel algorithms and gives every task thread its own
+    //linear arena for temporary memory. The scheduler is owned by whoever made it.
+    struct ParallelContext
+    {
+        void init(enki::TaskScheduler* scheduler, Allocator* allocator, size_t scratchSizePerWorker);
+        void shutdown();
+
+        //Index of the calling thread in the scheduler, 0 when there is no scheduler.
+        uint32_t currentThread() const;
+        //Scratch arena for a thread index handed to a range function. Only that thread may use it.
+        LinearAllocator* workerScratch(uint32_t threadIndex);
+
+        enki::TaskScheduler* scheduler = nullptr;
+        Allocator* allocator = nullptr;
+        LinearAllocator* scratch = nullptr;
+        uint32_t workerCount = 0;
+    };
+
+    //Temporary memory for one algorithm call. Comes from the calling thread's scratch arena, which is rewound when
+    //this goes out of scope, and falls back to the context allocator when the arena is too small.
+    struct ParallelScratch
+    {
+        explicit ParallelScratch(ParallelContext& context);
+        ~ParallelScratch();
+
+        ParallelScratch(const ParallelScratch&) = delete;
+        ParallelScratch& operator=(const ParallelScratch&) = delete;
+
+        void* allocate(size_t size, size_t alignment);
+
+        template<typename T>
+        T* allocateArray(uint32_t count)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "Scratch memory is never destroyed, only rewound.");
+            return (T*)allocate(sizeof(T) * (count ? count : 1), alignof(T));
+        }
+
+        LinearAllocator* arena = nullptr;
+        Allocator* fallback = nullptr;
+        ScopedArenaMarker marker;
+        void* fallbackAllocations[PARALLEL_SCRATCH_MAX_ALLOCATIONS];
+        uint32_t fallbackCount = 0;
+    };
+
+    //start, end and the index of the thread running the range.
+    using ParallelRangeFunction = void(*)(void* userData, uint32_t start, uint32_t end, uint32_t threadIndex);
+
+    //Splits [0, count) into ranges of at least grainSize and runs them across the scheduler, returning once all of
+    //them are done. Runs inline on the calling thread when there is only one range or no scheduler.
+    void parallelRun(ParallelContext& context, uint32_t count, uint32_t grainSize, ParallelRangeFunction function, void* userData);
+
+    inline uint32_t parallelChunkCount(uint32_t count, uint32_t grainSize)
+    {
+        grainSize = grainSize ? grainSize : 1;
+        return (count + grainSize - 1) / grainSize;
+    }
+
+    //function(start, end, threadIndex) over [0, count).
+    template<typename Function>
+    void parallelFor(ParallelContext& context, uint32_t count, uint32_t grainSize, Function function)
+    {
+        parallelRun(context, count, grainSize, [](void* userData, uint32_t start, uint32_t end, uint32_t threadIndex)
+        {
+            (*(Function*)userData)(start, end, threadIndex);
+        }, &function);
+    }
+
+    //function(element) for every element of the view.
+    template<typename T, typename Function>
+    void parallelFor(ParallelContext& context, ArrayView<T> view, uint32_t grainSize, Function function)
+    {
+        parallelFor(context, view.size, grainSize, [&](uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+        {
+            for (uint32_t i = start; i < end; ++i)
+            {
+                function(view.data[i]);
+            }
+        });
+    }
+
+    template<typename T, typename Function>
+    void parallelFor(ParallelContext& context, Array<T>& array, uint32_t grainSize, Function function)
+    {
+        parallelFor(context, ArrayView<T>(array.data, array.size), grainSize, function);
+    }
+
+    //Unlike parallelFor every call gets exactly one grainSize chunk, so the chunk index is stable between passes.
+    //function(chunkIndex, start, end, threadIndex).
+    template<typename Function>
+    void parallelForChunks(ParallelContext& context, uint32_t count, uint32_t grainSize, Function function)
+    {
+        grainSize = grainSize ? grainSize : 1;
+        parallelFor(context, parallelChunkCount(count, grainSize), 1, [&](uint32_t firstChunk, uint32_t lastChunk, uint32_t threadIndex)
+        {
+            for (uint32_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+            {
+                const uint32_t start = chunk * grainSize;
+                const uint32_t end = count - start < grainSize ? count : start + grainSize;
+                function(chunk, start, end, threadIndex);
+            }
+        });
+    }
+
+    //Folds each chunk with fold(result, element) and then combines the chunk results in order with combine(a, b).
+    //Only needs the operation to be associative, the result doesn't change with the worker count.
+    template<typename T, typename Result, typename Fold, typename Combine>
+    Result parallelReduce(ParallelContext& context, ArrayView<T> view, uint32_t grainSize, Result identity, Fold fold, Combine combine)
+    {
+        const uint32_t chunkCount = parallelChunkCount(view.size, grainSize);
+        if (chunkCount <= 1)
+        {
+            Result result = identity;
+            for (uint32_t i = 0; i < view.size; ++i)
+            {
+                result = fold(result, view.data[i]);
+            }
+            return result;
+        }
+
+        ParallelScratch scratch(context);
+        Result* partials = scratch.allocateArray<Result>(chunkCount);
+        parallelForChunks(context, view.size, grainSize, [&](uint32_t chunk, uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+        {
+            Result result = identity;
+            for (uint32_t i = start; i < end; ++i)
+            {
+                result = fold(result, view.data[i]);
+            }
+            new (&partials[chunk]) Result(result);
+        });
+
+        Result result = partials[0];
+        for (uint32_t chunk = 1; chunk < chunkCount; ++chunk)
+        {
+            result = combine(result, partials[chunk]);
+        }
+        return result;
+    }
+
+    //Running sum of input into output, which can be the same memory. Exclusive sums leave the total of everything
+    //before an element in its slot, inclusive ones add the element itself. Returns the total.
+    template<typename T>
+    T parallelPrefixSum(ParallelContext& context, ArrayView<T> input, ArrayView<T> output, uint32_t grainSize, bool exclusive = false)
+    {
+        AIR_ASSERTM(output.size >= input.size, "Prefix sum output is smaller than the input.");
+
+        auto scanRange = [&](uint32_t start, uint32_t end, T running)
+        {
+            for (uint32_t i = start; i < end; ++i)
+            {
+                const T value = input.data[i];
+                if (exclusive)
+                {
+                    output.data[i] = running;
+                    running += value;
+                }
+                else
+                {
+                    running += value;
+                    output.data[i] = running;
+                }
+            }
+            return running;
+        };
+
+        const uint32_t chunkCount = parallelChunkCount(input.size, grainSize);
+        if (chunkCount <= 1)
+        {
+            return scanRange(0, input.size, T{});
+        }
+
+        //Sum every chunk, scan the chunk sums on this thread and then rescan the chunks from their offsets.
+        ParallelScratch scratch(context);
+        T* offsets = scratch.allocateArray<T>(chunkCount);
+        parallelForChunks(context, input.size, grainSize, [&](uint32_t chunk, uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+        {
+            T sum{};
+            for (uint32_t i = start; i < end; ++i)
+            {
+                sum += input.data[i];
+            }
+            offsets[chunk] = sum;
+        });
+
+        T total{};
+        for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            const T sum = offsets[chunk];
+            offsets[chunk] = total;
+            total += sum;
+        }
+
+        parallelForChunks(context, input.size, grainSize, [&](uint32_t chunk, uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+        {
+            scanRange(start, end, offsets[chunk]);
+        });
+
+        return total;
+    }
+
+    //Stable LSD radix sort on an unsigned integer key, one byte per pass. Every pass builds a histogram per chunk, turns
+    //them into scatter offsets on the calling thread and scatters the chunks in parallel. Passes where every key has
+    //the same byte are skipped, so small keys in wide types don't pay for the empty bytes.
+    template<typename T, typename KeyFunction>
+    void parallelRadixSort(ParallelContext& context, ArrayView<T> items, uint32_t grainSize, KeyFunction key)
+    {
+        using Key = std::decay_t<decltype(key(items.data[0]))>;
+        static_assert(std::is_integral_v<Key> && std::is_unsigned_v<Key>, "Radix sort keys have to be unsigned integers.");
+        static_assert(std::is_trivially_copyable_v<T>, "Radix sort moves elements with plain copies.");
+
+        const uint32_t count = items.size;
+        if (count <= 1)
+        {
+            return;
+        }
+
+        grainSize = grainSize ? grainSize : 1;
+        const uint32_t chunkCount = parallelChunkCount(count, grainSize);
+
+        ParallelScratch scratch(context);
+        T* temporary = scratch.allocateArray<T>(count);
+        uint32_t* histograms = scratch.allocateArray<uint32_t>(chunkCount * 256);
+
+        T* source = items.data;
+        T* destination = temporary;
+        for (uint32_t shift = 0; shift < sizeof(Key) * 8; shift += 8)
+        {
+            parallelForChunks(context, count, grainSize, [&](uint32_t chunk, uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+            {
+                uint32_t* histogram = histograms + chunk * 256;
+                memset(histogram, 0, sizeof(uint32_t) * 256);
+                for (uint32_t i = start; i < end; ++i)
+                {
+                    ++histogram[(key(source[i]) >> shift) & 0xFF];
+                }
+            });
+
+            bool skipPass = false;
+            uint32_t offset = 0;
+            for (uint32_t digit = 0; digit < 256 && skipPass == false; ++digit)
+            {
+                const uint32_t digitStart = offset;
+                for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+                {
+                    uint32_t& slot = histograms[chunk * 256 + digit];
+                    const uint32_t digitCount = slot;
+                    slot = offset;
+                    offset += digitCount;
+                }
+                skipPass = offset - digitStart == count;
+            }
+
+            if (skipPass)
+            {
+                continue;
+            }
+
+            parallelForChunks(context, count, grainSize, [&](uint32_t chunk, uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+            {
+                uint32_t* offsets = histograms + chunk * 256;
+                for (uint32_t i = start; i < end; ++i)
+                {
+                    destination[offsets[(key(source[i]) >> shift) & 0xFF]++] = source[i];
+                }
+            });
+
+            std::swap(source, destination);
+        }
+
+        if (source != items.data)
+        {
+            parallelFor(context, count, grainSize, [&](uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+            {
+                memcpy(items.data + start, source + start, sizeof(T) * (end - start));
+            });
+        }
+    }
+
+    template<typename T, typename Less>
+    void parallelMergeRuns(const T* left, const T* leftEnd, const T* right, const T* rightEnd, T* output, Less& less)
+    {
+        while (left != leftEnd && right != rightEnd)
+        {
+            //Take from the right only when it is strictly smaller, that keeps the merge stable.
+            *output++ = less(*right, *left) ? *right++ : *left++;
+        }
+        while (left != leftEnd)
+        {
+            *output++ = *left++;
+        }
+        while (right != rightEnd)
+        {
+            *output++ = *right++;
+        }
+    }
+
+    //Stable single threaded merge sort of data, temporary has to hold count elements.
+    template<typename T, typename Less>
+    void parallelSortRange(T* data, T* temporary, uint32_t count, Less& less)
+    {
+        static constexpr uint32_t INSERTION_RUN = 16;
+
+        for (uint32_t start = 0; start < count; start += INSERTION_RUN)
+        {
+            const uint32_t end = count - start < INSERTION_RUN ? count : start + INSERTION_RUN;
+            for (uint32_t i = start + 1; i < end; ++i)
+            {
+                T value = data[i];
+                uint32_t j = i;
+                for (; j > start && less(value, data[j - 1]); --j)
+                {
+                    data[j] = data[j - 1];
+                }
+                data[j] = value;
+            }
+        }
+
+        T* source = data;
+        T* destination = temporary;
+        for (uint32_t width = INSERTION_RUN; width < count; width *= 2)
+        {
+            for (uint32_t start = 0; start < count; start += width * 2)
+            {
+                const uint32_t middle = count - start < width ? count : start + width;
+                const uint32_t end = count - middle < width ? count : middle + width;
+                parallelMergeRuns(source + start, source + middle, source + middle, source + end, destination + start, less);
+            }
+            std::swap(source, destination);
+        }
+
+        if (source != data)
+        {
+            memcpy(data, source, sizeof(T) * count);
+        }
+    }
+
+    //Stable merge sort for anything with a less than comparison. Chunks of grainSize are sorted in parallel, then
+    //neighbouring runs are merged pairwise, so the last few merge passes have less parallelism than the first ones.
+    template<typename T, typename Less>
+    void parallelSort(ParallelContext& context, ArrayView<T> items, uint32_t grainSize, Less less)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Parallel merge sort moves elements with plain copies.");
+
+        const uint32_t count = items.size;
+        if (count <= 1)
+        {
+            return;
+        }
+
+        grainSize = grainSize ? grainSize : 1;
+
+        ParallelScratch scratch(context);
+        T* temporary = scratch.allocateArray<T>(count);
+
+        parallelForChunks(context, count, grainSize, [&](uint32_t /*chunk*/, uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+        {
+            parallelSortRange(items.data + start, temporary + start, end - start, less);
+        });
+
+        T* source = items.data;
+        T* destination = temporary;
+        for (uint32_t width = grainSize; width < count; width *= 2)
+        {
+            const uint32_t pairCount = parallelChunkCount(count, width * 2);
+            parallelFor(context, pairCount, 1, [&](uint32_t firstPair, uint32_t lastPair, uint32_t /*threadIndex*/)
+            {
+                for (uint32_t pair = firstPair; pair < lastPair; ++pair)
+                {
+                    const uint32_t start = pair * width * 2;
+                    const uint32_t middle = count - start < width ? count : start + width;
+                    const uint32_t end = count - middle < width ? count : middle + width;
+                    parallelMergeRuns(source + start, source + middle, source + middle, source + end, destination + start, less);
+                }
+            });
+            std::swap(source, destination);
+
+            //Stops width from wrapping around on huge inputs.
+            if (width > count / 2)
+            {
+                break;
+            }
+        }
+
+        if (source != items.data)
+        {
+            parallelFor(context, count, grainSize, [&](uint32_t start, uint32_t end, uint32_t /*threadIndex*/)
+            {
+                memcpy(items.data + start, source + start, sizeof(T) * (end - start));
+            });
+        }
+    }
+
+    //Integer keys take the radix sort. Signed keys get their sign bit flipped so negatives order before positives.
+    template<typename T>
+    void parallelSort(ParallelContext& context, ArrayView<T> items, uint32_t grainSize)
+    {
+        static_assert(std::is_integral_v<T>, "Pass a comparison to sort anything that isn't an integer.");
+
+        using Key = std::make_unsigned_t<T>;
+        parallelRadixSort(context, items, grainSize, [](T value)
+        {
+            if constexpr (std::is_signed_v<T>)
+            {
+                return (Key)((Key)value ^ ((Key)1 << (sizeof(Key) * 8 - 1)));
+            }
+            else
+            {
+                return (Key)value;
+            }
+        });
+    }
+
+    template<typename T>
+    void parallelSort(ParallelContext& context, Array<T>& array, uint32_t grainSize)
+    {
+        parallelSort(context, ArrayView<T>(array.data, array.size), grainSize);
+    }
+
+    template<typename T, typename Less>
+    void parallelSort(ParallelContext& context, Array<T>& array, uint32_t grainSize, Less less)
+    {
+        parallelSort(context, ArrayView<T>(array.data, array.size), grainSize, less);
+    }
+}
+
+#endif // !PARALLEL_HDR
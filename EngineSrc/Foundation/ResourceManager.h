@@ -3,7 +3,7 @@
 
 #include "Platform.h"
 #include "Assert.h"
-#include "HashMap.h"
+#include "ConcurrentHashMap.h"
 
 namespace Air 
 {
@@ -111,8 +111,10 @@ namespace Air
         void setLoader(const char* resourceType, ResourceLoader* loader);
         void setCompiler(const char* resourceType, ResourceCompiler* compiler);
 
-        FlatHashMap<uint64_t, ResourceLoader*> loaders;
-        FlatHashMap<uint64_t, ResourceCompiler*> compilers;
+        //Both keyed by the hashed resource type name. Loaders look them up from any thread while the main thread
+        //registers new types, so reads never take a lock.
+        SnapshotHashMap<uint64_t, ResourceLoader*, HashMapIdentityHasher> loaders;
+        SnapshotHashMap<uint64_t, ResourceCompiler*, HashMapIdentityHasher> compilers;
 
         Allocator* allocator = nullptr;
         ResourceFilenameResolver* filenameResolver;
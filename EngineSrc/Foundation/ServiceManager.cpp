@@ -24,8 +24,7 @@ namespace Air
     void ServiceManager::addService(Service* service, const char* name) 
     {
         uint64_t hashName = hashCalculate(name);
-        FlatHashMapIterator iterator = services.find(hashName);
-        AIR_ASSERTM(iterator.isInvalid(), "Overwriting service %s, is this intended?", name);
+        AIR_ASSERTM(services.contains(hashName) == false, "Overwriting service %s, is this intended?", name);
         services.insert(hashName, service);
     }
 
@@ -2,7 +2,7 @@
 #define SERVICE_MANAGER_HDR
 
 #include "Array.h"
-#include "HashMap.h"
+#include "ConcurrentHashMap.h"
 
 namespace Air 
 {
@@ -32,7 +32,8 @@ namespace Air
 
         static ServiceManager* instance;
 
-        FlatHashMap<uint64_t, Service*> services;
+        //Keyed by the hashed name. Looked up from any thread, services are only added and removed now and then.
+        SnapshotHashMap<uint64_t, Service*, HashMapIdentityHasher> services;
         Allocator* allocator = nullptr;
     };
 }
@@ -18,8 +18,291 @@
 #define AIR_ASSERT_OVERFLOW()
 #endif
 
+//stringLength reads whole aligned blocks, so it can look at bytes after the terminator that belong to something else.
+//They are always in the same page so it can't fault, but the address sanitiser doesn't know that.
+#if defined(_MSC_VER)
+#define AIR_NO_SANITIZE_ADDRESS __declspec(no_sanitize_address)
+#else
+#define AIR_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+
 namespace Air 
 {
+    //Keyed by the string hash, so the map doesn't hash it a second time.
+    struct StringIndexMap : public FlatHashMap<uint64_t, uint32_t, HashMapIdentityHasher>
+    {
+    };
+
+#if AIR_HASH_MAP_X86
+    //Picked once, the same way FlatHashMap picks its group.
+    static const bool STRING_USE_AVX2 = hashMapCpuFeatures().avx2;
+#endif
+
+    //Compares strings shorter than 16 characters without reading past either. Two loads from each end overlap
+    //in the middle and cover every character between them.
+    static bool stringBytesEqualShort(const char* a, const char* b, size_t length)
+    {
+        if (length >= 8)
+        {
+            uint64_t a0, a1, b0, b1;
+            memcpy(&a0, a, 8);
+            memcpy(&b0, b, 8);
+            memcpy(&a1, a + length - 8, 8);
+            memcpy(&b1, b + length - 8, 8);
+            return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+        }
+
+        if (length >= 4)
+        {
+            uint32_t a0, a1, b0, b1;
+            memcpy(&a0, a, 4);
+            memcpy(&b0, b, 4);
+            memcpy(&a1, a + length - 4, 4);
+            memcpy(&b1, b + length - 4, 4);
+            return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+        }
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (a[i] != b[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static size_t stringFindScalar(const char* text, size_t length, char character)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (text[i] == character)
+            {
+                return i;
+            }
+        }
+        return StringView::NOT_FOUND;
+    }
+
+#if AIR_HASH_MAP_X86 == 0
+    static bool stringBytesEqualScalar(const char* a, const char* b, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8)
+        {
+            uint64_t x, y;
+            memcpy(&x, a + i, 8);
+            memcpy(&y, b + i, 8);
+            if (x != y)
+            {
+                return false;
+            }
+        }
+        return stringBytesEqualShort(a + i, b + i, length - i);
+    }
+
+    static size_t stringLengthScalar(const char* text)
+    {
+        const char* end = text;
+        while (*end)
+        {
+            ++end;
+        }
+        return end - text;
+    }
+#endif
+
+#if AIR_HASH_MAP_X86
+    static bool stringBytesEqualSse2(const char* a, const char* b, size_t length)
+    {
+        if (length < 16)
+        {
+            return stringBytesEqualShort(a, b, length);
+        }
+
+        //The last block starts 16 from the end and overlaps ones already compared instead of falling back to bytes.
+        for (size_t i = 0; ; i += 16)
+        {
+            const size_t offset = i + 16 <= length ? i : length - 16;
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + offset));
+            const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + offset));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+            {
+                return false;
+            }
+            if (offset + 16 == length)
+            {
+                return true;
+            }
+        }
+    }
+
+    AIR_TARGET_AVX2 static bool stringBytesEqualAvx2(const char* a, const char* b, size_t length)
+    {
+        if (length < 32)
+        {
+            return stringBytesEqualSse2(a, b, length);
+        }
+
+        for (size_t i = 0; ; i += 32)
+        {
+            const size_t offset = i + 32 <= length ? i : length - 32;
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + offset));
+            const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + offset));
+            if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFF)
+            {
+                return false;
+            }
+            if (offset + 32 == length)
+            {
+                return true;
+            }
+        }
+    }
+
+    //Strings shorter than 16 eight bytes at a time. A byte of word ^ pattern is zero where the character is, and
+    //(x - 0x01..) & ~x & 0x80.. sets the top bit of the first zero byte. Bytes above it can be wrong, but only the
+    //lowest set bit is used. x86 is little endian, so the lowest byte comes first in the string.
+    static size_t stringFindShort(const char* text, size_t length, char character)
+    {
+        if (length < 8)
+        {
+            return stringFindScalar(text, length, character);
+        }
+
+        const uint64_t pattern = 0x0101010101010101ull * (uint8_t)character;
+        const size_t offsets[2] = { 0, length - 8 };
+        for (size_t offset : offsets)
+        {
+            uint64_t word;
+            memcpy(&word, text + offset, 8);
+            word ^= pattern;
+            const uint64_t zeros = (word - 0x0101010101010101ull) & ~word & 0x8080808080808080ull;
+            if (zeros)
+            {
+                return offset + trailingZerosU64(zeros) / 8;
+            }
+        }
+        return StringView::NOT_FOUND;
+    }
+
+    static size_t stringFindSse2(const char* text, size_t length, char character)
+    {
+        if (length < 16)
+        {
+            return stringFindShort(text, length, character);
+        }
+
+        const __m128i needle = _mm_set1_epi8(character);
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+            const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+            if (mask)
+            {
+                return i + trailingZerosU32(mask);
+            }
+        }
+
+        if (i == length)
+        {
+            return StringView::NOT_FOUND;
+        }
+
+        //The last 16 characters, with the ones the loop already looked at shifted out.
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + length - 16));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)) >> (i - (length - 16));
+        return mask ? i + trailingZerosU32(mask) : StringView::NOT_FOUND;
+    }
+
+    AIR_TARGET_AVX2 static size_t stringFindAvx2(const char* text, size_t length, char character)
+    {
+        if (length < 32)
+        {
+            return stringFindSse2(text, length, character);
+        }
+
+        const __m256i needle = _mm256_set1_epi8(character);
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+            const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+            if (mask)
+            {
+                return i + trailingZerosU32(mask);
+            }
+        }
+
+        if (i == length)
+        {
+            return StringView::NOT_FOUND;
+        }
+
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + length - 32));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)) >> (i - (length - 32));
+        return mask ? i + trailingZerosU32(mask) : StringView::NOT_FOUND;
+    }
+
+    //Aligned loads never cross into the next page, so reading past the terminator can't fault.
+    AIR_NO_SANITIZE_ADDRESS static size_t stringLengthSse2(const char* text)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const uintptr_t misalignment = reinterpret_cast<uintptr_t>(text) & 15;
+        const char* block = text - misalignment;
+
+        //Bytes before text in the first block are shifted out of the mask.
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(block)), zero)) >> misalignment;
+        if (mask)
+        {
+            return trailingZerosU32(mask);
+        }
+
+        while (true)
+        {
+            block += 16;
+            mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(block)), zero));
+            if (mask)
+            {
+                return (block - text) + trailingZerosU32(mask);
+            }
+        }
+    }
+
+    AIR_TARGET_AVX2 AIR_NO_SANITIZE_ADDRESS static size_t stringLengthAvx2(const char* text)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const uintptr_t misalignment = reinterpret_cast<uintptr_t>(text) & 31;
+        const char* block = text - misalignment;
+
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(block)), zero)) >> misalignment;
+        if (mask)
+        {
+            return trailingZerosU32(mask);
+        }
+
+        while (true)
+        {
+            block += 32;
+            mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(reinterpret_cast<const __m256i*>(block)), zero));
+            if (mask)
+            {
+                return (block - text) + trailingZerosU32(mask);
+            }
+        }
+    }
+#endif
+
+    static bool stringBytesEqual(const char* a, const char* b, size_t length)
+    {
+#if AIR_HASH_MAP_X86
+        return STRING_USE_AVX2 ? stringBytesEqualAvx2(a, b, length) : stringBytesEqualSse2(a, b, length);
+#else
+        return stringBytesEqualScalar(a, b, length);
+#endif
+    }
+
     bool StringView::equals(const StringView& rhs, const StringView& lhs) 
     {
         if (rhs.length != lhs.length) 
@@ -27,15 +310,69 @@ namespace Air
             return false;
         }
 
-        for (uint32_t i = 0; i < rhs.length; ++i) 
+        return stringBytesEqual(rhs.text, lhs.text, rhs.length);
+    }
+
+    size_t StringView::find(const StringView& string, char character)
+    {
+#if AIR_HASH_MAP_X86
+        return STRING_USE_AVX2 ? stringFindAvx2(string.text, string.length, character) : stringFindSse2(string.text, string.length, character);
+#else
+        return stringFindScalar(string.text, string.length, character);
+#endif
+    }
+
+    size_t StringView::find(const StringView& string, const StringView& pattern)
+    {
+        if (pattern.length == 0)
+        {
+            return 0;
+        }
+        if (pattern.length > string.length)
+        {
+            return NOT_FOUND;
+        }
+        if (pattern.length == 1)
+        {
+            return find(string, pattern.text[0]);
+        }
+
+        const size_t lastStart = string.length - pattern.length;
+        const char first = pattern.text[0];
+        const char last = pattern.text[pattern.length - 1];
+        size_t i = 0;
+
+#if AIR_HASH_MAP_X86
+        //Only starts where the first and the last character both match are compared in full, 16 starts at a time.
+        const __m128i firstNeedle = _mm_set1_epi8(first);
+        const __m128i lastNeedle = _mm_set1_epi8(last);
+        for (; i + 16 <= lastStart + 1; i += 16)
         {
-            if (rhs.text[i] != lhs.text[i])
+            const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(string.text + i));
+            const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(string.text + i + pattern.length - 1));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, firstNeedle), _mm_cmpeq_epi8(blockLast, lastNeedle)));
+            while (mask)
             {
-                return false;
+                const size_t start = i + trailingZerosU32(mask);
+                if (stringBytesEqual(string.text + start + 1, pattern.text + 1, pattern.length - 2))
+                {
+                    return start;
+                }
+                mask &= mask - 1;
             }
         }
+#endif
 
-        return true;
+        for (; i <= lastStart; ++i)
+        {
+            if (string.text[i] == first && string.text[i + pattern.length - 1] == last &&
+                stringBytesEqual(string.text + i + 1, pattern.text + 1, pattern.length - 2))
+            {
+                return i;
+            }
+        }
+
+        return NOT_FOUND;
     }
 
     void StringView::copyTo(const StringView& string, char* buffer, size_t bufferSize) 
@@ -46,6 +383,27 @@ namespace Air
         buffer[string.length] = 0;
     }
 
+    size_t stringLength(const char* text)
+    {
+#if AIR_HASH_MAP_X86
+        return STRING_USE_AVX2 ? stringLengthAvx2(text) : stringLengthSse2(text);
+#else
+        return stringLengthScalar(text);
+#endif
+    }
+
+    uint64_t stringHashAndLength(const char* text, size_t* length, uint64_t seed)
+    {
+        //Two passes, wyhash picks how it reads the characters from the length so it can't start before the
+        //terminator is found. libc strlen is the fastest way to find it.
+        const size_t textLength = strlen(text);
+        if (length)
+        {
+            *length = textLength;
+        }
+        return wyhash(text, textLength, seed, _wyp);
+    }
+
     void StringBuffer::init(size_t size, Allocator* allocator) 
     {
         if (data) 
@@ -276,14 +634,15 @@ namespace Air
     {
         allocator = alloc;
         //Allocate also memory for the has map.
-        char* allocateMemory = static_cast<char*>(allocator->allocate(size + sizeof(FlatHashMap<uint64_t, uint32_t>) 
-                                                                           + sizeof(FlatHashMapIterator), 1));
-        stringToIndex = (FlatHashMap<uint64_t, uint32_t>*)allocateMemory;
+        char* allocateMemory = static_cast<char*>(allocator->allocate(size + sizeof(StringIndexMap) 
+                                                                           + sizeof(FlatHashMapIterator), alignof(StringIndexMap)));
+        stringToIndex = new (allocateMemory) StringIndexMap();
         stringToIndex->init(allocator, 8);
         stringToIndex->setDefaultValue(UINT32_MAX);
 
-        stringIterator = reinterpret_cast<FlatHashMapIterator*>(allocateMemory + sizeof(FlatHashMapIterator));
-        data = allocateMemory + sizeof(FlatHashMap<uint64_t, uint32_t>) + sizeof(FlatHashMapIterator);
+        //The iterator sits after the map, not on top of it.
+        stringIterator = reinterpret_cast<FlatHashMapIterator*>(allocateMemory + sizeof(StringIndexMap));
+        data = allocateMemory + sizeof(StringIndexMap) + sizeof(FlatHashMapIterator);
 
         bufferSize = size;
         currentSize = 0;
@@ -292,6 +651,7 @@ namespace Air
     void StringArray::shutdown() 
     {
         //stringToIndex contains all the memory including data.
+        stringToIndex->shutdown();
         air_free(stringToIndex, allocator);
         bufferSize = currentSize = 0;
     }
@@ -340,7 +700,7 @@ namespace Air
     {
         static size_t seed = 0xF2EA4FFAD;
         const size_t length = strlen(string);
-        const size_t hashedString = hashBytes((void *)string, length, seed);
+        const size_t hashedString = hashBytes((void*)string, length, seed);
 
         uint32_t stringIndex = stringToIndex->get(hashedString);
         if (stringIndex != UINT32_MAX) 
@@ -7,21 +7,33 @@ namespace Air
 {
     struct Allocator;
 
-    template<typename K, typename V>
-    struct FlatHashMap;
+    //FlatHashMap of string hash to offset, defined in String.cpp so this header doesn't need HashMap.h.
+    struct StringIndexMap;
 
     struct FlatHashMapIterator;
 
     //String view that reference an already existing stream of chars.
+    //equals and find use SSE2 or AVX2 when the CPU has them and plain loops everywhere else.
     struct StringView 
     {
+        static constexpr size_t NOT_FOUND = SIZE_MAX;
+
         char* text;
         size_t length;
 
         static bool equals(const StringView& rhs, const StringView& lhs);
         static void copyTo(const StringView& string, char* buffer, size_t bufferSize);
+
+        //Index of the first match in string, NOT_FOUND if there isn't one. An empty pattern matches at 0.
+        static size_t find(const StringView& string, char character);
+        static size_t find(const StringView& string, const StringView& pattern);
     };
 
+    //Same as strlen, with the same SIMD paths as StringView.
+    size_t stringLength(const char* text);
+    //Length and hash of a null terminated string, strlen followed by hashBytes with the same seed. length can be null.
+    uint64_t stringHashAndLength(const char* text, size_t* length, uint64_t seed = 0);
+
     //A class that pre-allocates a buffer and appends string to it.
     //Reserve an additional byte for the null termination when need.
     struct StringBuffer 
@@ -75,7 +87,7 @@ namespace Air
 
         const char* intern(const char* string);
 
-        FlatHashMap<uint64_t, uint32_t>* stringToIndex;
+        StringIndexMap* stringToIndex;
         FlatHashMapIterator* stringIterator;
 
         char* data = nullptr;